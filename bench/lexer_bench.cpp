@@ -0,0 +1,73 @@
+// Tokens-per-second benchmark for the lexer.
+//
+// Usage: lexer_bench <file> [repeat] [rounds] [scalar|sse2|avx2] [switch|dfa]
+// The input file is concatenated `repeat` times in memory so that small test
+// programs can be blown up to realistic sizes without touching the disk.
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+#include <fmt/core.h>
+
+#include "diagnostics/diagnostics.hpp"
+#include "lexer/lexer.hpp"
+#include "lexer/scan.hpp"
+#include "lexer/token.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fmt::print(stderr, "usage: {} <file> [repeat] [rounds]\n", argv[0]);
+    return 1;
+  }
+  int repeat = argc > 2 ? std::atoi(argv[2]) : 1000;
+  int rounds = argc > 3 ? std::atoi(argv[3]) : 5;
+  auto engine = LexerEngine::SWITCH;
+  for (int i = 4; i < argc; ++i) {
+    std::string_view name = argv[i];
+    if (name == "dfa")
+      engine = LexerEngine::DFA;
+    for (auto isa : {ScanIsa::SCALAR, ScanIsa::SSE2, ScanIsa::AVX2}) {
+      if (name == to_string(isa) && scan_isa_supported(isa))
+        set_scan_isa(isa);
+    }
+  }
+
+  auto file = SourceBuffer::from_file(argv[1]);
+  if (!file) {
+    fmt::print(stderr, "{}: No such file or directory\n", argv[1]);
+    return 1;
+  }
+  std::string text;
+  text.reserve(file->size() * repeat);
+  for (int i = 0; i < repeat; ++i)
+    text.append(file->view());
+  SourceManager sources;
+  auto id = sources.add_file(SourceBuffer::from_string(text, file->name()));
+  const auto &source = sources.buffer(id);
+
+  double best = 0;
+  std::size_t tokens = 0;
+  for (int round = 0; round < rounds; ++round) {
+    Diagnostics diag;
+    auto start = std::chrono::steady_clock::now();
+    Lexer lexer(sources, id, diag, engine);
+    tokens = lexer.gen_token().size();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (round == 0 || elapsed.count() < best)
+      best = elapsed.count();
+  }
+
+  fmt::print("sizeof(Token): {} bytes\n", sizeof(Token));
+  fmt::print("scanner:       {}\n", to_string(active_scan_functions().isa));
+  fmt::print("engine:        {}\n",
+             engine == LexerEngine::DFA ? "dfa" : "switch");
+  fmt::print("input:         {:.1f} MB, {} tokens\n", source.size() / 1e6,
+             tokens);
+  fmt::print("best of {}:     {:.3f} s, {:.1f} MB/s, {:.2f} Mtokens/s\n",
+             rounds, best, source.size() / 1e6 / best, tokens / 1e6 / best);
+  return 0;
+}
@@ -0,0 +1,136 @@
+// Name analysis on locals in deeply nested scopes, and the symbol table
+// behind it against a stack of hash maps, one per scope.
+//
+// Usage: name_bench [depth] [width] [rounds]
+// The program is one function of `depth` nested scopes, each declaring
+// `width` locals, by default 1000 x 100 = 100k locals. Every local hides the
+// one of the same name a scope further out and reads two others.
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "common.hpp"
+#include "frontend/frontend.hpp"
+#include "sema/name_analysis.hpp"
+#include "sema/symbol_table.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+std::string program(int depth, int width) {
+  std::string text = "int main() {\n";
+  for (int i = 0; i < width; ++i)
+    text.append(fmt::format("int v{} = {};\n", i, i));
+  for (int level = 0; level < depth; ++level) {
+    text.append("{\n");
+    for (int i = 0; i < width; ++i)
+      text.append(fmt::format("int v{} = v{} + v{};\n", i, i,
+                              (i + width - 1) % width));
+  }
+  text.append(depth, '}');
+  text.append("\nreturn v0;\n}\n");
+  return text;
+}
+
+// The scopes, declarations and lookups name analysis makes on the program
+template <typename Table> void replay(Table &table, int depth, int width) {
+  for (int level = 0; level < depth; ++level) {
+    table.enter_scope();
+    for (std::uint32_t i = 0; i < static_cast<std::uint32_t>(width); ++i) {
+      table.lookup(Symbol{i});
+      table.lookup(Symbol{(i + width - 1) % width});
+      table.declare(Symbol{i}, level * width + i);
+    }
+  }
+  for (int level = 0; level < depth; ++level)
+    table.exit_scope();
+}
+
+// One map per scope: entering builds one, leaving destroys it, and a lookup
+// searches the maps from the innermost out
+class MapStack {
+public:
+  void enter_scope() { scopes.emplace_back(); }
+  void exit_scope() { scopes.pop_back(); }
+  bool declare(Symbol name, std::uint32_t value) {
+    return scopes.back().emplace(name.id, value).second;
+  }
+  std::uint32_t lookup(Symbol name) const {
+    for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+      if (auto found = scope->find(name.id); found != scope->end())
+        return found->second;
+    }
+    return SymbolTable::none;
+  }
+
+private:
+  std::vector<std::unordered_map<std::uint32_t, std::uint32_t>> scopes =
+      std::vector<std::unordered_map<std::uint32_t, std::uint32_t>>(1);
+};
+
+template <typename Make>
+double best_of(int rounds, int depth, int width, Make make) {
+  double best = 0;
+  for (int round = 0; round < rounds; ++round) {
+    auto table = make();
+    auto start = Clock::now();
+    replay(table, depth, width);
+    auto elapsed = seconds_since(start);
+    if (round == 0 || elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  int depth = argc > 1 ? std::atoi(argv[1]) : 1000;
+  int width = argc > 2 ? std::atoi(argv[2]) : 100;
+  int rounds = argc > 3 ? std::atoi(argv[3]) : 5;
+
+  SourceManager sources;
+  auto file =
+      sources.add_file(SourceBuffer::from_string(program(depth, width)));
+  double best_resolve = 0;
+  std::size_t decls = 0;
+  for (int round = 0; round < rounds; ++round) {
+    auto result = parse_unit(sources, file, CigridFlags{});
+    if (!result.ok()) {
+      fmt::print(stderr, "the generated program does not parse\n");
+      return 1;
+    }
+    auto start = Clock::now();
+    auto names = resolve_names(*result.prog, result.diag);
+    auto elapsed = seconds_since(start);
+    if (!names.ok()) {
+      fmt::print(stderr, "name analysis failed: {}\n", names.error->message);
+      return 1;
+    }
+    decls = names.decls.size();
+    if (round == 0 || elapsed < best_resolve)
+      best_resolve = elapsed;
+  }
+  auto table = best_of(rounds, depth, width, [] { return SymbolTable(); });
+  auto maps = best_of(rounds, depth, width, [] { return MapStack(); });
+
+  double locals = static_cast<double>(depth + 1) * width;
+  fmt::print("scopes:        {} deep, {} locals each\n", depth, width);
+  fmt::print("declarations:  {}\n", decls);
+  fmt::print("best of {}:     resolve {:.3f} s ({:.0f} ns per local)\n",
+             rounds, best_resolve, best_resolve / locals * 1e9);
+  fmt::print("symbol table:  {:.3f} s\n", table);
+  fmt::print("map per scope: {:.3f} s\n", maps);
+  return 0;
+}
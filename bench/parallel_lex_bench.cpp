@@ -0,0 +1,109 @@
+// Scaling benchmark for chunked parallel lexing.
+//
+// Usage: parallel_lex_bench <file> [repeat] [max_threads] [rounds]
+// Lexes the input (concatenated `repeat` times in memory) sequentially and
+// then with lex_parallel on 1 to max_threads threads, checking that every
+// run produces the sequential token stream.
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "diagnostics/diagnostics.hpp"
+#include "interner/interner.hpp"
+#include "lexer/lexer.hpp"
+#include "lexer/parallel_lexer.hpp"
+#include "lexer/token.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "support/thread_pool.hpp"
+
+namespace {
+
+template <typename F> double best_of(int rounds, F &&run) {
+  double best = 0;
+  for (int round = 0; round < rounds; ++round) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (round == 0 || elapsed.count() < best)
+      best = elapsed.count();
+  }
+  return best;
+}
+
+bool same_tokens(const std::vector<Token> &a, const std::vector<Token> &b) {
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(),
+                    [](const Token &x, const Token &y) {
+                      return x.kind == y.kind && x.offset == y.offset &&
+                             x.length == y.length && x.payload == y.payload;
+                    });
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fmt::print(stderr, "usage: {} <file> [repeat] [max_threads] [rounds]\n",
+               argv[0]);
+    return 1;
+  }
+  int repeat = argc > 2 ? std::atoi(argv[2]) : 1000;
+  unsigned max_threads = argc > 3 ? std::atoi(argv[3])
+                                  : std::thread::hardware_concurrency();
+  int rounds = argc > 4 ? std::atoi(argv[4]) : 5;
+  max_threads = std::max(1u, max_threads);
+
+  auto file = SourceBuffer::from_file(argv[1]);
+  if (!file) {
+    fmt::print(stderr, "{}: No such file or directory\n", argv[1]);
+    return 1;
+  }
+  std::string text;
+  text.reserve(file->size() * repeat);
+  for (int i = 0; i < repeat; ++i)
+    text.append(file->view());
+  SourceManager sources;
+  auto id = sources.add_file(SourceBuffer::from_string(text, file->name()));
+  double megabytes = sources.buffer(id).size() / 1e6;
+
+  std::vector<Token> expected;
+  double sequential = best_of(rounds, [&] {
+    Diagnostics diag;
+    Lexer lexer(sources, id, diag);
+    expected = lexer.gen_token();
+  });
+  double split = best_of(rounds, [&] {
+    find_chunk_boundaries(sources.buffer(id).view(), max_threads * 4);
+  });
+
+  fmt::print("input:         {:.1f} MB, {} tokens\n", megabytes,
+             expected.size());
+  fmt::print("sequential:    {:.3f} s, {:.1f} MB/s\n", sequential,
+             megabytes / sequential);
+  fmt::print("split pass:    {:.3f} s, {:.1f} MB/s\n", split,
+             megabytes / split);
+  fmt::print("{:>8} {:>10} {:>10} {:>8}\n", "threads", "seconds", "MB/s",
+             "speedup");
+  for (unsigned threads = 1; threads <= max_threads; ++threads) {
+    ThreadPool pool(threads);
+    std::vector<Token> tokens;
+    double elapsed = best_of(rounds, [&] {
+      Diagnostics diag;
+      tokens = lex_parallel(sources, id, diag, pool);
+    });
+    if (!same_tokens(tokens, expected)) {
+      fmt::print(stderr, "{} threads: token stream differs\n", threads);
+      return 1;
+    }
+    fmt::print("{:>8} {:>10.3f} {:>10.1f} {:>7.2f}x\n", threads, elapsed,
+               megabytes / elapsed, sequential / elapsed);
+  }
+  return 0;
+}
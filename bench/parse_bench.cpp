@@ -0,0 +1,119 @@
+// Allocation and time benchmark for the parser.
+//
+// Usage: parse_bench <file> [repeat] [rounds] [tree|flat] [threads]
+// The input file is concatenated `repeat` times in memory, then lexed and
+// parsed into a Prog, or into a FlatAst with "flat". With more than one
+// thread the globals are parsed in parallel, as with --parse-threads. Heap
+// allocations are counted by replacing the global operator new, so the
+// numbers cover the lexer, the parser and the AST.
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <string_view>
+
+#include <fmt/core.h>
+
+#include "common.hpp"
+#include "diagnostics/diagnostics.hpp"
+#include "parser/flat_ast.hpp"
+#include "parser/parser.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+
+namespace {
+std::size_t allocations = 0;
+std::size_t allocated_bytes = 0;
+
+std::size_t ast_bytes(const Prog &prog) { return prog.arena.bytes_used(); }
+
+template <typename Table> std::size_t table_bytes(const Table &table) {
+  std::size_t bytes =
+      table.size() * (sizeof(table.kind[0]) + sizeof(SourceLoc));
+  for (const auto &operand : table.operands)
+    bytes += operand.size() * sizeof(operand[0]);
+  return bytes;
+}
+
+std::size_t ast_bytes(const FlatAst &ast) {
+  return table_bytes(ast.types) + table_bytes(ast.exprs) +
+         table_bytes(ast.stmts) + table_bytes(ast.globals) +
+         ast.lists.size() * sizeof(ast.lists[0]);
+}
+} // namespace
+
+void *operator new(std::size_t size) {
+  ++allocations;
+  allocated_bytes += size;
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  std::abort();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fmt::print(stderr,
+               "usage: {} <file> [repeat] [rounds] [tree|flat] [threads]\n",
+               argv[0]);
+    return 1;
+  }
+  int repeat = argc > 2 ? std::atoi(argv[2]) : 1000;
+  int rounds = argc > 3 ? std::atoi(argv[3]) : 5;
+  bool flat = argc > 4 && std::string_view(argv[4]) == "flat";
+  unsigned threads = argc > 5 ? std::atoi(argv[5]) : 1;
+
+  auto file = SourceBuffer::from_file(argv[1]);
+  if (!file) {
+    fmt::print(stderr, "{}: No such file or directory\n", argv[1]);
+    return 1;
+  }
+  std::string text;
+  text.reserve(file->size() * repeat);
+  for (int i = 0; i < repeat; ++i)
+    text.append(file->view());
+  SourceManager sources;
+  auto id = sources.add_file(SourceBuffer::from_string(text, file->name()));
+
+  double best_parse = 0, best_free = 0;
+  std::size_t parse_allocs = 0, parse_bytes = 0, tree_bytes = 0;
+  for (int round = 0; round < rounds; ++round) {
+    CigridFlags flags;
+    flags.parse_threads = threads;
+    Diagnostics diag;
+    auto allocs_before = allocations, bytes_before = allocated_bytes;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point parsed, freed;
+    auto run = [&](auto parser) {
+      auto ast = parser.parse();
+      parsed = std::chrono::steady_clock::now();
+      parse_allocs = allocations - allocs_before;
+      parse_bytes = allocated_bytes - bytes_before;
+      tree_bytes = ast_bytes(*ast);
+      ast.reset();
+      freed = std::chrono::steady_clock::now();
+    };
+    if (flat)
+      run(FlatParser(sources, id, diag, flags));
+    else
+      run(Parser(sources, id, diag, flags));
+
+    std::chrono::duration<double> parse = parsed - start;
+    std::chrono::duration<double> free = freed - parsed;
+    if (round == 0 || parse.count() < best_parse)
+      best_parse = parse.count();
+    if (round == 0 || free.count() < best_free)
+      best_free = free.count();
+  }
+
+  fmt::print("ast:           {}\n", flat ? "flat" : "tree");
+  fmt::print("threads:       {}\n", threads);
+  fmt::print("input:         {:.1f} MB\n", sources.buffer(id).size() / 1e6);
+  fmt::print("ast size:      {:.1f} MB\n", tree_bytes / 1e6);
+  fmt::print("allocations:   {} ({:.1f} MB)\n", parse_allocs,
+             parse_bytes / 1e6);
+  fmt::print("best of {}:     parse {:.3f} s, free {:.3f} s\n", rounds,
+             best_parse, best_free);
+  return 0;
+}
@@ -0,0 +1,105 @@
+// Scaling benchmark for name analysis and type checking of function bodies.
+//
+// Usage: sema_bench [functions] [max_threads] [rounds]
+// Generates a program of `functions` functions with loops, locals, struct
+// accesses and calls, then resolves names and checks types on 1 to
+// max_threads threads, checking that every run reports no error.
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include <fmt/core.h>
+
+#include "common.hpp"
+#include "frontend/frontend.hpp"
+#include "sema/name_analysis.hpp"
+#include "sema/type_checker.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "support/thread_pool.hpp"
+
+namespace {
+
+template <typename F> double best_of(int rounds, F &&run) {
+  double best = 0;
+  for (int round = 0; round < rounds; ++round) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (round == 0 || elapsed.count() < best)
+      best = elapsed.count();
+  }
+  return best;
+}
+
+std::string program(int functions) {
+  std::string text = "struct Node {\n  int value;\n  Node* next;\n};\n"
+                     "int f0(Node* list, int n) {\n  return n;\n}\n";
+  for (int i = 1; i < functions; ++i) {
+    text += fmt::format("int f{}(Node* list, int n) {{\n"
+                        "  int sum = 0;\n  int i = 0;\n",
+                        i);
+    for (int block = 0; block < 8; ++block) {
+      text += fmt::format(
+          "  while (i < n) {{\n"
+          "    Node* node = list;\n    int k = {0};\n"
+          "    while (node != 0 && k < n) {{\n"
+          "      sum = sum + node[0].value * k - (i << 2);\n"
+          "      node = node[0].next;\n      k = k + 1;\n    }}\n"
+          "    if (sum > {1}) {{\n      sum = sum % {1};\n    }}\n"
+          "    i = i + 1;\n  }}\n",
+          block, 1000 + block);
+    }
+    text += fmt::format("  return sum + f{}(list, n - 1);\n}}\n", i - 1);
+  }
+  return text;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  int functions = argc > 1 ? std::atoi(argv[1]) : 5000;
+  unsigned max_threads = argc > 2 ? std::atoi(argv[2])
+                                  : std::thread::hardware_concurrency();
+  int rounds = argc > 3 ? std::atoi(argv[3]) : 5;
+  max_threads = std::max(1u, max_threads);
+
+  SourceManager sources;
+  auto file = sources.add_file(SourceBuffer::from_string(program(functions)));
+  auto result = parse_unit(sources, file, CigridFlags{});
+  if (!result.ok()) {
+    fmt::print(stderr, "generated program does not parse\n");
+    return 1;
+  }
+  double megabytes = sources.buffer(file).size() / 1e6;
+  fmt::print("input:         {:.1f} MB, {} functions\n", megabytes,
+             functions);
+  fmt::print("{:>8} {:>10} {:>10} {:>8}\n", "threads", "names", "types",
+             "speedup");
+
+  double serial = 0;
+  for (unsigned threads = 1; threads <= max_threads; ++threads) {
+    ThreadPool pool(threads);
+    bool ok = true;
+    Names names;
+    double resolve = best_of(rounds, [&] {
+      names = resolve_names(*result.prog, result.diag, pool);
+      ok = ok && names.ok();
+    });
+    double check = best_of(rounds, [&] {
+      ok = ok && check_types(*result.prog, names, result.diag, pool).ok();
+    });
+    if (!ok) {
+      fmt::print(stderr, "{} threads: analysis failed\n", threads);
+      return 1;
+    }
+    if (threads == 1)
+      serial = resolve + check;
+    fmt::print("{:>8} {:>10.3f} {:>10.3f} {:>7.2f}x\n", threads, resolve,
+               check, serial / (resolve + check));
+  }
+  return 0;
+}
@@ -0,0 +1,131 @@
+// Latency of incremental re-analysis with Session, against parsing the whole
+// document again after every edit.
+//
+// Usage: session_bench <file> <trace> [repeat]
+// The document is the file concatenated `repeat` times; the edits of the
+// trace (see traces/typing.trace) are replayed on its middle copy.
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "common.hpp"
+#include "frontend/frontend.hpp"
+#include "frontend/session.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+std::string unescape(const std::string &text) {
+  std::string result;
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    if (text[i] == '\\' && i + 1 < text.size()) {
+      ++i;
+      result.push_back(text[i] == 'n' ? '\n' : text[i]);
+    } else {
+      result.push_back(text[i]);
+    }
+  }
+  return result;
+}
+
+// One edit per line: offset, replaced length, escaped replacement
+bool read_trace(const char *path, std::uint32_t base,
+                std::vector<TextEdit> &edits) {
+  std::ifstream in(path);
+  if (!in)
+    return false;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    auto space = line.find(' ');
+    auto second = line.find(' ', space + 1);
+    auto offset = std::strtoul(line.c_str(), nullptr, 10);
+    auto length = std::strtoul(line.c_str() + space + 1, nullptr, 10);
+    auto replacement =
+        second == std::string::npos ? "" : unescape(line.substr(second + 1));
+    edits.push_back(TextEdit{base + static_cast<std::uint32_t>(offset),
+                             static_cast<std::uint32_t>(length),
+                             std::move(replacement)});
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    fmt::print(stderr, "usage: {} <file> <trace> [repeat]\n", argv[0]);
+    return 1;
+  }
+  int repeat = argc > 3 ? std::atoi(argv[3]) : 500;
+
+  auto file = SourceBuffer::from_file(argv[1]);
+  if (!file) {
+    fmt::print(stderr, "{}: No such file or directory\n", argv[1]);
+    return 1;
+  }
+  std::string text;
+  text.reserve(file->size() * repeat);
+  for (int i = 0; i < repeat; ++i)
+    text.append(file->view());
+  std::vector<TextEdit> edits;
+  auto base = static_cast<std::uint32_t>(file->size() * (repeat / 2));
+  if (!read_trace(argv[2], base, edits)) {
+    fmt::print(stderr, "{}: No such file or directory\n", argv[2]);
+    return 1;
+  }
+
+  // What every keystroke costs without a session
+  double full_parse = 0;
+  for (int round = 0; round < 3; ++round) {
+    SourceManager sources;
+    auto id = sources.add_file(SourceBuffer::from_string(text));
+    auto start = Clock::now();
+    auto result = parse_unit(sources, id, CigridFlags{});
+    auto elapsed = seconds_since(start);
+    if (round == 0 || elapsed < full_parse)
+      full_parse = elapsed;
+  }
+
+  auto start = Clock::now();
+  Session session(text);
+  auto open = seconds_since(start);
+
+  double total = 0, slowest = 0;
+  std::size_t relexed = 0, reparsed = 0;
+  for (const auto &edit : edits) {
+    start = Clock::now();
+    session.edit(edit);
+    auto elapsed = seconds_since(start);
+    total += elapsed;
+    slowest = std::max(slowest, elapsed);
+    relexed += session.last_edit().relexed_bytes;
+    reparsed += session.last_edit().reparsed_globals;
+  }
+
+  auto count = std::max<std::size_t>(edits.size(), 1);
+  fmt::print("document:      {:.1f} MB\n", text.size() / 1e6);
+  fmt::print("full parse:    {:.3f} ms\n", full_parse * 1e3);
+  fmt::print("open session:  {:.3f} ms\n", open * 1e3);
+  fmt::print("edits:         {}\n", edits.size());
+  fmt::print("per edit:      {:.3f} ms average, {:.3f} ms slowest\n",
+             total / count * 1e3, slowest * 1e3);
+  fmt::print("per edit:      {:.0f} bytes relexed, {:.1f} globals reparsed\n",
+             static_cast<double>(relexed) / count,
+             static_cast<double>(reparsed) / count);
+  fmt::print("final state:   {}\n", session.ok() ? "ok" : "syntax errors");
+  return 0;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include "diagnostics/diagnostics.hpp"
+#include "parser/ast.hpp"
+#include "sema/name_analysis.hpp"
+#include "sema/type_checker.hpp"
+
+// The x86-64 machine code is generated for: the host's if it is one, Linux
+// otherwise. Null, with a fatal diagnostic, if LLVM cannot make it.
+std::unique_ptr<llvm::TargetMachine> x86_64_target(Diagnostics &diag);
+
+// Lowers `prog`, whose names are resolved and types checked, to LLVM IR for
+// `target`. int is i32 and char i8, sign extended where they mix; a pointer
+// points to the lowered pointee, void* to i8. A struct is an LLVM struct
+// with its fields in the order StructLayouts placed them, so packing
+// carries over. new[] calls malloc and delete[] free. A global initializer
+// that does not fold to a constant is run by a module constructor.
+//
+// Walks the tree with an explicit stack, so any depth of nesting is fine.
+std::unique_ptr<llvm::Module>
+generate_module(const Prog &prog, const Names &names, Types &types,
+                llvm::LLVMContext &context, const llvm::TargetMachine &target,
+                std::string_view name);
+
+// Writes `module` to `path` as an object file. False, with a fatal
+// diagnostic, if the file cannot be written.
+bool emit_object(llvm::Module &module, llvm::TargetMachine &target,
+                 const std::string &path, Diagnostics &diag);
@@ -1,10 +1,19 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
+
 struct Position {
   int line;
   int column;
 };
 
+// Byte offset into the files of a SourceManager, laid out one after another.
+// Turned into a Position only when a message is actually printed.
+struct SourceLoc {
+  std::uint32_t offset;
+};
+
 struct CigridFlags {
   bool pretty_print = false;
   bool line_error = false;
@@ -14,6 +23,27 @@ struct CigridFlags {
   bool compile = false;
   bool asm_gen = false;
   bool liveness = false;
+  bool dfa_lexer = false;
+  // Reorder struct fields to minimize padding
+  bool pack_structs = false;
+  // Print the size of every struct, in declaration order and packed
+  bool layout_report = false;
+  // Lex on this many threads when above 1
+  unsigned lex_threads = 1;
+  // Parse the top-level globals on this many threads when above 1
+  unsigned parse_threads = 1;
+  // Pretty-print the globals on this many threads when above 1
+  unsigned print_threads = 1;
+  // Resolve names and check types of function bodies on this many threads
+  unsigned sema_threads = 1;
+  // Lex and parse the input while it is being read, e.g. from a pipe
+  bool stream = false;
+  // Parse into the flat FlatAst tables, then convert for the later passes
+  bool flat_ast = false;
+  // Object file written by --compile; empty for the input's name with .o
+  std::string output;
+  // Print the LLVM IR of --compile to stdout
+  bool emit_llvm = false;
 };
 
 // Overload template to visit std::variant types
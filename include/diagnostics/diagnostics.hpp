@@ -1,36 +1,86 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <fmt/color.h>
 #include <fmt/core.h>
+#include <fmt/format.h>
 
 #include "common.hpp"
 
+class SourceManager;
+
 // Could add severity level in the future
 enum class Severity { Note, Warning, Error, Fatal };
 
+// The compilation phase reporting a message. Messages at the same location
+// print in this order, as a sequential compilation would report them.
+enum class Phase { Driver, Lex, Parse, Names, Types };
+
+// Collects the messages of a compilation. Any number of threads may report
+// at once: each appends to a buffer of its own, found without locking after
+// its first message, and the counts are atomic so that a phase can stop
+// early once something failed.
+//
+// print_all() sorts the messages by location and phase, so a parallel run
+// prints exactly what a sequential one would. Messages of one thread keep
+// their order; only the order of two threads' messages at the very same
+// location and phase is left open.
 class Diagnostics {
 public:
-  void error(Position pos, std::string message);
-  bool has_errors() const;
+  Diagnostics();
+  Diagnostics(Diagnostics &&other) noexcept;
+  Diagnostics &operator=(Diagnostics &&other) noexcept;
+  ~Diagnostics();
+
+  // Safe to call from several threads
+  void error(Phase phase, SourceLoc loc, std::string message);
   void fatal(std::string message);
-  void print_all();
+  bool has_errors() const;
+  int error_count() const;
+
+  // These must not run while other threads are still reporting
+  //
+  // Takes over the messages of `other`
+  void merge(Diagnostics &&other);
+  // Locations are turned into file:line:column here, and only here
+  void print_all(const SourceManager &sources, fmt::memory_buffer &out) const;
+  // Prints to stderr
+  void print_all(const SourceManager &sources) const;
 
 private:
   // TODO: just realized that not all diagmessage has line and column: file not
   // found e.g.
   struct DiagMessage {
     Severity level;
+    Phase phase;
     std::string message;
-    std::optional<Position> pos;
+    std::optional<SourceLoc> loc;
+  };
+  // The messages of one thread, in the order it reported them
+  struct Buffer {
+    std::thread::id thread;
+    std::vector<DiagMessage> messages;
   };
+  struct State {
+    // Tells the sinks apart in the per-thread cache, unlike addresses it is
+    // never reused
+    std::uint64_t id;
+    // Guards `buffers`, which is only touched on a thread's first message
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    std::atomic<int> counts[4] = {};
+  };
+
+  void report(DiagMessage message);
+  // The calling thread's buffer
+  Buffer &local_buffer();
 
-  std::vector<DiagMessage> messages;
-  int note_count = 0;
-  int error_count = 0;
-  int warning_count = 0;
-  int fatal_count = 0;
-};
\ No newline at end of file
+  std::unique_ptr<State> state;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+
+#include "common.hpp"
+#include "diagnostics/diagnostics.hpp"
+#include "lexer/stream_lexer.hpp"
+#include "parser/ast.hpp"
+#include "parser/parser.hpp"
+#include "source/source_manager.hpp"
+
+// Entry points of the cigrid_frontend library. They never print or exit, so
+// a host process can parse any number of units one after another; each
+// unit's outcome comes back as a ParseResult.
+struct ParseResult {
+  // Null when parsing stopped at a syntax error
+  std::unique_ptr<Prog> prog;
+  // The syntax error that stopped parsing, if any
+  std::optional<ParseError> error;
+  // Everything reported for the unit: lexer errors and the syntax error
+  Diagnostics diag;
+
+  bool ok() const { return prog != nullptr; }
+};
+
+// Parses a file already added to `sources`. With flags.flat_ast the unit
+// goes through FlatParser and is converted to the pointer tree.
+ParseResult parse_unit(const SourceManager &sources, FileId file,
+                       const CigridFlags &flags);
+
+// Parses a file from sources.add_stream() while `read` delivers its bytes
+ParseResult parse_stream(SourceManager &sources, FileId file,
+                         StreamLexer::ReadFn read, const CigridFlags &flags);
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hpp"
+#include "frontend/frontend.hpp"
+#include "lexer/token.hpp"
+#include "parser/ast.hpp"
+#include "printer/ast_printer.hpp"
+#include "source/source_manager.hpp"
+
+// Replaces `length` bytes at `offset` of the document by `replacement`
+struct TextEdit {
+  std::uint32_t offset;
+  std::uint32_t length;
+  std::string replacement;
+};
+
+// Work done by the last Session::edit()
+struct EditStats {
+  // Bytes lexed to find where the token stream re-synchronizes
+  std::size_t relexed_bytes = 0;
+  // Globals parsed again, every other one kept its AST
+  std::size_t reparsed_globals = 0;
+  // The whole document was parsed again to drop the files of replaced
+  // units: no AST or location from before the edit is valid any more
+  bool rebuilt = false;
+};
+
+// A document kept parsed across edits, for editors that re-analyse it on
+// every keystroke. The document is cut into units of one top-level global
+// each, together with the whitespace and comments after it, and each unit is
+// a file of its own in the session's SourceManager. An edit re-lexes the
+// units it touches, growing that region until its tokens end cleanly between
+// two globals, and parses only the globals found there again. The other
+// units keep their AST, whose locations point into their own files and so
+// stay valid; the cost of an edit follows the size of the globals it
+// touches, not the size of the document.
+//
+// A region that leaves braces open grows up to a unit that can close them.
+// If none can, it grows until its parse fails before its end, which is
+// where a parse from scratch fails too. Likewise a stray '}' pulls in the
+// unit before it that left braces open.
+//
+// A SourceManager never drops a single file, so replaced units stay in it
+// for a while. Once they take more location space than the live units, with
+// some slack, the session lexes and parses its text again into an emptied
+// SourceManager. Its location space stays within a constant factor of the
+// document, and the rebuilds cost no more than the edits that made them
+// necessary.
+//
+// Names and string literals are interned in Interner::global() like those
+// of any other Prog, since Symbol spellings are looked up there. That table
+// never shrinks: it keeps every distinct spelling the session has lexed,
+// including those of half-typed names, for the life of the process. It
+// grows with the distinct spellings typed, not with the number of edits.
+class Session {
+public:
+  // Parallel lexing and parsing are turned off, units are small
+  explicit Session(std::string_view text, const CigridFlags &flags = {});
+  Session(const Session &) = delete;
+  Session &operator=(const Session &) = delete;
+
+  // `edit` must lie within the document
+  void edit(const TextEdit &edit);
+  const EditStats &last_edit() const { return stats; }
+
+  std::size_t size() const;
+  std::string text() const;
+
+  // True when every global parsed
+  bool ok() const;
+  // Syntax errors of the globals that did not parse, in document order
+  std::vector<ParseError> errors() const;
+  // Globals in document order, leaving out those that did not parse
+  std::vector<GlobalNode *> globals() const;
+  void print(ASTPrinter &printer) const;
+  // Line and column in the current document of a location in the AST or in
+  // errors()
+  Position position(SourceLoc loc) const;
+  const SourceManager &source_manager() const { return sources; }
+
+private:
+  struct Unit {
+    FileId file;
+    // Where the unit begins in the document, and its size there
+    std::uint32_t start;
+    std::uint32_t length;
+    Position position;
+    ParseResult result;
+    // Braces opened minus braces closed over the unit, and the lowest that
+    // count gets on the way; below zero only with a stray '}'
+    int brace_balance = 0;
+    int min_brace_balance = 0;
+  };
+  using Units = std::vector<std::unique_ptr<Unit>>;
+
+  std::size_t unit_at(std::uint32_t offset) const;
+  // First unit from `next` on that closes `open` braces left open before it,
+  // or the number of units
+  std::size_t closing_unit(std::size_t next, int open) const;
+  // Last unit before `first` with braces still open where `first` begins,
+  // or `first`
+  std::size_t opening_unit(std::size_t first) const;
+  std::string_view unit_text(const Unit &unit) const;
+  // Splits `text` into units, the first file of an empty SourceManager
+  // labelling its lexer diagnostics
+  void load(std::string_view text);
+  // Loads the document again, dropping every file of the SourceManager
+  void rebuild();
+  // Splits `text`, lexed into `tokens` and placed at `start` and `position`
+  // of the document, into units and parses them. `at_end` if the text ends
+  // the document.
+  Units build(std::string_view text, std::span<const Token> tokens,
+              std::uint32_t start, Position position, bool at_end);
+
+  CigridFlags flags;
+  SourceManager sources;
+  // Empty file standing for text lexed outside of any unit
+  FileId lex_label = 0;
+  Units units;
+  // Unit of each file in `sources` that is still part of the document
+  std::unordered_map<FileId, Unit *> unit_of_file;
+  EditStats stats;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+// Dense handle of an interned string. Two symbols are equal iff their
+// spellings are equal, so comparing names is a single integer compare.
+struct Symbol {
+  std::uint32_t id;
+
+  bool operator==(const Symbol &) const = default;
+  // Spelling of the symbol, looked up in the global interner
+  std::string_view str() const;
+};
+
+// String table. Each distinct string is stored once and gets the next free
+// Symbol id. Symbols in the AST always come from the process-wide global()
+// table, whose text stays valid until the process exits; local tables are
+// for workers that later merge their strings into it. Not thread-safe.
+class Interner {
+public:
+  Interner();
+  Interner(const Interner &) = delete;
+  Interner &operator=(const Interner &) = delete;
+
+  static Interner &global();
+
+  // FNV-1a, one byte at a time with hash_step()
+  static constexpr std::uint64_t hash_seed = 0xcbf29ce484222325ULL;
+  static constexpr std::uint64_t hash_step(std::uint64_t hash, char c) {
+    return (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+  }
+  static std::uint64_t hash(std::string_view text);
+
+  Symbol intern(std::string_view text) { return intern(text, hash(text)); }
+  // `hash` must be Interner::hash(text)
+  Symbol intern(std::string_view text, std::uint64_t hash);
+  std::string_view lookup(Symbol symbol) const { return strings[symbol.id]; }
+  std::size_t size() const { return strings.size(); }
+
+private:
+  const char *store(std::string_view text);
+  void grow();
+
+  // Open addressing with linear probing, capacity is a power of two. Slots
+  // are placed by the low 32 bits of the hash, which are kept for regrowth.
+  struct Slot {
+    std::uint32_t hash;
+    std::uint32_t index; // symbol id + 1, 0 marks an empty slot
+  };
+  std::vector<Slot> table;
+  std::vector<std::string_view> strings;
+  // Character storage, never reallocated so views stay valid
+  std::vector<std::unique_ptr<char[]>> chunks;
+  char *chunk_cursor = nullptr;
+  std::size_t chunk_left = 0;
+};
+
+inline std::string_view Symbol::str() const {
+  return Interner::global().lookup(*this);
+}
+
+// Symbols format as their spelling, so they can be passed to fmt::print
+// wherever a std::string was used before
+template <>
+struct fmt::formatter<Symbol> : fmt::formatter<std::string_view> {
+  template <typename FormatContext>
+  auto format(const Symbol &symbol, FormatContext &ctx) const {
+    return fmt::formatter<std::string_view>::format(symbol.str(), ctx);
+  }
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "token.hpp"
+
+// Compile-time tables for the DFA lexer engine: a 256-entry character class
+// table that replaces the <cctype> calls, and a transition table for the
+// operators and comment openers, generated from their spellings.
+
+// What a byte can start, used to dispatch at the beginning of a token
+enum class CharClass : std::uint8_t {
+  OTHER,
+  SPACE,
+  IDENT_START,
+  DIGIT,
+  SINGLE_QUOTE,
+  DOUBLE_QUOTE,
+  HASH,
+  OPERATOR
+};
+
+// Properties of a byte, same answers as <cctype> in the "C" locale
+enum CharFlag : std::uint8_t {
+  CHAR_SPACE = 1 << 0,
+  CHAR_ALPHA = 1 << 1,
+  CHAR_DIGIT = 1 << 2,
+  CHAR_XDIGIT = 1 << 3,
+};
+
+struct CharInfo {
+  CharClass cls;
+  std::uint8_t flags;
+};
+
+// Spelling of every operator the lexer accepts, and what it turns into.
+// "//" and "/*" are comment openers rather than tokens.
+enum class OpAction : std::uint8_t { NONE, TOKEN, LINE_COMMENT, BLOCK_COMMENT };
+
+struct OpSpelling {
+  std::string_view spelling;
+  OpAction action;
+  TokenKind kind;
+};
+
+inline constexpr std::array<OpSpelling, 32> op_spellings = {{
+    {"~", OpAction::TOKEN, TokenKind::BITWISE_NOT},
+    {"+", OpAction::TOKEN, TokenKind::PLUS},
+    {"-", OpAction::TOKEN, TokenKind::MINUS},
+    {"*", OpAction::TOKEN, TokenKind::MULTIPLY},
+    {"^", OpAction::TOKEN, TokenKind::EXPONENTIAL},
+    {"%", OpAction::TOKEN, TokenKind::MODULUS},
+    {"(", OpAction::TOKEN, TokenKind::LPAREN},
+    {")", OpAction::TOKEN, TokenKind::RPAREN},
+    {"[", OpAction::TOKEN, TokenKind::LBRACKET},
+    {"]", OpAction::TOKEN, TokenKind::RBRACKET},
+    {"{", OpAction::TOKEN, TokenKind::LBRACE},
+    {"}", OpAction::TOKEN, TokenKind::RBRACE},
+    {";", OpAction::TOKEN, TokenKind::SEMICOLON},
+    {",", OpAction::TOKEN, TokenKind::COMMA},
+    {".", OpAction::TOKEN, TokenKind::PERIOD},
+    {"!", OpAction::TOKEN, TokenKind::NOT},
+    {"!=", OpAction::TOKEN, TokenKind::NOT_EQUAL},
+    {"/", OpAction::TOKEN, TokenKind::DIVIDE},
+    {"//", OpAction::LINE_COMMENT, TokenKind::BAD},
+    {"/*", OpAction::BLOCK_COMMENT, TokenKind::BAD},
+    {"<", OpAction::TOKEN, TokenKind::LESS_THAN},
+    {"<<", OpAction::TOKEN, TokenKind::SHIFT_LEFT},
+    {"<=", OpAction::TOKEN, TokenKind::LESS_EQUAL},
+    {">", OpAction::TOKEN, TokenKind::LARGER_THAN},
+    {">>", OpAction::TOKEN, TokenKind::SHIFT_RIGHT},
+    {">=", OpAction::TOKEN, TokenKind::LARGER_EQUAL},
+    {"=", OpAction::TOKEN, TokenKind::ASSIGN},
+    {"==", OpAction::TOKEN, TokenKind::EQUAL},
+    {"|", OpAction::TOKEN, TokenKind::BITWISE_OR},
+    {"||", OpAction::TOKEN, TokenKind::LOGICAL_OR},
+    {"&", OpAction::TOKEN, TokenKind::BITWISE_AND},
+    {"&&", OpAction::TOKEN, TokenKind::LOGICAL_AND},
+}};
+
+// One DFA state per operator prefix, plus START and DEAD
+struct OpDfa {
+  static constexpr std::uint8_t START = 0;
+  static constexpr std::uint8_t DEAD = 1;
+  static constexpr std::size_t max_states = 2 + op_spellings.size();
+
+  std::array<std::array<std::uint8_t, 256>, max_states> next{};
+  std::array<OpSpelling, max_states> accept{};
+};
+
+constexpr OpDfa build_op_dfa() {
+  OpDfa dfa{};
+  for (auto &row : dfa.next)
+    for (auto &target : row)
+      target = OpDfa::DEAD;
+  for (auto &accept : dfa.accept)
+    accept = {"", OpAction::NONE, TokenKind::BAD};
+
+  std::uint8_t states = 2;
+  auto add = [&](const OpSpelling &op) {
+    std::uint8_t state = OpDfa::START;
+    for (char c : op.spelling) {
+      auto &target = dfa.next[state][static_cast<unsigned char>(c)];
+      if (target == OpDfa::DEAD)
+        target = states++;
+      state = target;
+    }
+    dfa.accept[state] = op;
+  };
+  for (const auto &op : op_spellings)
+    add(op);
+  return dfa;
+}
+
+inline constexpr OpDfa op_dfa = build_op_dfa();
+
+inline constexpr std::array<CharInfo, 256> char_table = [] {
+  std::array<CharInfo, 256> table{};
+  for (int c = 0; c < 256; ++c) {
+    CharInfo info{CharClass::OTHER, 0};
+    if (c == ' ' || (c >= '\t' && c <= '\r')) {
+      info = {CharClass::SPACE, CHAR_SPACE};
+    } else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+      bool hex = (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+      info = {CharClass::IDENT_START,
+              static_cast<std::uint8_t>(CHAR_ALPHA | (hex ? CHAR_XDIGIT : 0))};
+    } else if (c >= '0' && c <= '9') {
+      info = {CharClass::DIGIT,
+              static_cast<std::uint8_t>(CHAR_DIGIT | CHAR_XDIGIT)};
+    } else if (c == '_') {
+      info = {CharClass::IDENT_START, 0};
+    } else if (c == '\'') {
+      info = {CharClass::SINGLE_QUOTE, 0};
+    } else if (c == '"') {
+      info = {CharClass::DOUBLE_QUOTE, 0};
+    } else if (c == '#') {
+      info = {CharClass::HASH, 0};
+    } else if (op_dfa.next[OpDfa::START][c] != OpDfa::DEAD) {
+      info = {CharClass::OPERATOR, 0};
+    }
+    table[c] = info;
+  }
+  return table;
+}();
+
+constexpr const CharInfo &char_info(char c) {
+  return char_table[static_cast<unsigned char>(c)];
+}
+constexpr bool is_space(char c) { return char_info(c).flags & CHAR_SPACE; }
+constexpr bool is_alpha(char c) { return char_info(c).flags & CHAR_ALPHA; }
+constexpr bool is_digit(char c) { return char_info(c).flags & CHAR_DIGIT; }
+constexpr bool is_xdigit(char c) { return char_info(c).flags & CHAR_XDIGIT; }
+
+static_assert(char_info('<').cls == CharClass::OPERATOR);
+static_assert(char_info('@').cls == CharClass::OTHER);
+static_assert(is_xdigit('F') && !is_xdigit('g') && is_space('\v'));
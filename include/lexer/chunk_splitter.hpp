@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+#include "scan.hpp"
+
+// Follows the lexical state of the input just closely enough to tell which
+// newlines the lexer reaches outside of any token, literal or comment. The
+// input can be cut just past those newlines and the pieces lexed on their
+// own. Bytes may be fed in pieces of any size, as they arrive.
+class ChunkSplitter {
+public:
+  // Consumes bytes starting at p and returns the first cut (the byte after a
+  // safe newline) at or after `want`. Returns nullptr once all of [p, end)
+  // is consumed without finding one; the next call continues at end.
+  const char *scan(const char *p, const char *end, const char *want);
+
+  // After a lexical error no more cuts are found, since the lexer stops
+  bool stopped() const { return state == State::STOPPED; }
+  // The bytes consumed so far end inside a comment or literal, after a '/'
+  // the next bytes could turn into one, or after a lexical error
+  bool inside() const { return state != State::NORMAL; }
+
+private:
+  enum class State : std::uint8_t {
+    NORMAL,
+    SLASH,
+    LINE_COMMENT,
+    BLOCK_COMMENT,
+    BLOCK_COMMENT_STAR,
+    STRING,
+    STRING_ESCAPE,
+    CHAR_FIRST,
+    CHAR_ESCAPE,
+    CHAR_CLOSE,
+    STOPPED
+  };
+
+  State state = State::NORMAL;
+  const ScanFunctions &scanner = active_scan_functions();
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <string_view>
+
+#include "token.hpp"
+
+// Keyword recognition with a perfect hash generated at compile time. The
+// hash only looks at the length and the first and last byte of a word, so
+// classifying an identifier costs one table load and one short compare.
+
+struct KeywordEntry {
+  std::string_view spelling;
+  TokenKind kind;
+};
+
+inline constexpr std::array<KeywordEntry, 13> keyword_list = {{
+    {"break", TokenKind::BREAK},   {"char", TokenKind::CHAR},
+    {"delete", TokenKind::DELETE}, {"else", TokenKind::ELSE},
+    {"extern", TokenKind::EXTERN}, {"for", TokenKind::FOR},
+    {"if", TokenKind::IF},         {"int", TokenKind::INT},
+    {"new", TokenKind::NEW},       {"return", TokenKind::RETURN},
+    {"struct", TokenKind::STRUCT}, {"void", TokenKind::VOID},
+    {"while", TokenKind::WHILE},
+}};
+
+struct KeywordHash {
+  static constexpr std::size_t table_size = 32; // power of two
+  unsigned first;
+  unsigned last;
+
+  constexpr std::size_t operator()(std::string_view word) const {
+    return (word.size() + static_cast<unsigned char>(word.front()) * first +
+            static_cast<unsigned char>(word.back()) * last) &
+           (table_size - 1);
+  }
+};
+
+// Search for multipliers that make the hash collision-free over the keyword
+// list. Fails to compile if the keyword set ever outgrows the table.
+constexpr KeywordHash find_keyword_hash() {
+  for (unsigned first = 0; first < 16; ++first) {
+    for (unsigned last = 0; last < 16; ++last) {
+      KeywordHash hash{first, last};
+      std::array<bool, KeywordHash::table_size> used{};
+      bool perfect = true;
+      for (const auto &entry : keyword_list) {
+        auto slot = hash(entry.spelling);
+        perfect = perfect && !used[slot];
+        used[slot] = true;
+      }
+      if (perfect)
+        return hash;
+    }
+  }
+  throw "no perfect hash for the keyword set";
+}
+
+inline constexpr KeywordHash keyword_hash = find_keyword_hash();
+
+inline constexpr std::size_t keyword_max_length = [] {
+  std::size_t max_length = 0;
+  for (const auto &entry : keyword_list)
+    max_length = std::max(max_length, entry.spelling.size());
+  return max_length;
+}();
+
+inline constexpr auto keyword_table = [] {
+  std::array<KeywordEntry, KeywordHash::table_size> table{};
+  for (auto &slot : table)
+    slot = {"", TokenKind::IDENTIFIER};
+  for (const auto &entry : keyword_list)
+    table[keyword_hash(entry.spelling)] = entry;
+  return table;
+}();
+
+// Kind of the keyword spelled `word`, or IDENTIFIER if it is none
+constexpr TokenKind keyword_kind(std::string_view word) {
+  if (word.empty() || word.size() > keyword_max_length)
+    return TokenKind::IDENTIFIER;
+  const KeywordEntry &slot = keyword_table[keyword_hash(word)];
+  return slot.spelling == word ? slot.kind : TokenKind::IDENTIFIER;
+}
+
+static_assert(keyword_kind("while") == TokenKind::WHILE);
+static_assert(keyword_kind("int") == TokenKind::INT);
+static_assert(keyword_kind("whilst") == TokenKind::IDENTIFIER);
+static_assert(keyword_kind("x") == TokenKind::IDENTIFIER);
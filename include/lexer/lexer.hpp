@@ -1,49 +1,83 @@
 #pragma once
 
+#include <cstdint>
 #include <optional>
+#include <string>
 #include <string_view>
-#include <unordered_map>
 #include <vector>
 
+#include "common.hpp"
 #include "diagnostics/diagnostics.hpp"
+#include "interner/interner.hpp"
+#include "source/source_manager.hpp"
+#include "char_table.hpp"
+#include "keywords.hpp"
+#include "scan.hpp"
 #include "token.hpp"
 
+// SWITCH is the hand-written if/switch recognizer, DFA dispatches through the
+// tables in char_table.hpp. Both produce the same tokens and diagnostics.
+enum class LexerEngine { SWITCH, DFA };
+
+// What a BAD token carrying `error` prints as
+std::string_view lex_error_message(LexError error);
+
 class Lexer {
   bool at_eof = false;
+  const SourceManager &sources;
+  FileId file;
+  // Bytes being lexed, the whole file or a window of it: source[0] is at
+  // offset `base` of the file. Token offsets are file offsets.
   std::string_view source;
+  std::uint32_t base;
   int size = source.size();
   int current_pos = 0;
   char current_char = 0;
-  int current_line = 1;
-  int current_column = 1;
-  int start_line = 1;
-  int start_column = 1;
+  // Offset of the first character of the lexeme being read
+  std::uint32_t start_offset = 0;
   std::vector<Token> token_list;
+  // Unescaped text of the string literal being read, reused between literals
+  std::string string_text;
   Diagnostics &diag;
+  const ScanFunctions &scan = active_scan_functions();
+  LexerEngine engine;
+  Interner &interner;
 
 public:
-  explicit Lexer(std::string_view source, Diagnostics &diag);
+  explicit Lexer(const SourceManager &sources, FileId file, Diagnostics &diag,
+                 LexerEngine engine = LexerEngine::SWITCH,
+                 Interner &interner = Interner::global());
+  // Lexes only `window`, the bytes at [base, base + window.size()) of the
+  // file, which must start and end outside of any token, literal or comment.
+  // The window need not come from sources.buffer(file).
+  Lexer(const SourceManager &sources, FileId file, std::string_view window,
+        std::uint32_t base, Diagnostics &diag, LexerEngine engine,
+        Interner &interner);
   std::vector<Token> gen_token();
   std::optional<Token> next_token();
   void print_token_list();
 
+  // Spelling of a token as written in the source, which must be in the window
+  std::string_view lexeme(const Token &token) const;
+  // Location of an offset into this file
+  SourceLoc loc(std::uint32_t offset) const { return sources.loc(file, offset); }
+
 private:
   void next_char();
+  // Move so that current_char is source[target], target >= current_pos - 1
+  void advance_to(int target);
+  Token make_token(TokenKind kind, std::uint32_t payload = 0) const;
+  Token make_eof() const;
+  Token make_bad(LexError error) const;
+  std::optional<Token> next_token_switch();
+  std::optional<Token> next_token_dfa();
   std::optional<Token> read_char();
   std::optional<Token> read_ident_or_keyword();
   std::optional<Token> read_num();
   std::optional<Token> read_string();
   std::optional<Token> read_symbol();
+  // Skips a comment whose "/*" starts at start_offset, false if unterminated
+  bool skip_block_comment();
   void skip_line();
   void skip_space();
-
-private:
-  static const inline std::unordered_map<std::string, TokenKind> keyword_map = {
-      {"break", TokenKind::BREAK},   {"char", TokenKind::CHAR},
-      {"delete", TokenKind::DELETE}, {"else", TokenKind::ELSE},
-      {"extern", TokenKind::EXTERN}, {"for", TokenKind::FOR},
-      {"if", TokenKind::IF},         {"int", TokenKind::INT},
-      {"new", TokenKind::NEW},       {"return", TokenKind::RETURN},
-      {"struct", TokenKind::STRUCT}, {"void", TokenKind::VOID},
-      {"while", TokenKind::WHILE}};
-};
\ No newline at end of file
+};
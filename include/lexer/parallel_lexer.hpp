@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "diagnostics/diagnostics.hpp"
+#include "interner/interner.hpp"
+#include "lexer.hpp"
+#include "source/source_manager.hpp"
+#include "support/thread_pool.hpp"
+#include "token.hpp"
+
+// Offsets where the source can be cut into about `chunks` pieces that lex
+// independently: each one is just past a newline that the sequential lexer
+// reaches outside of any literal or comment. Sorted, excluding 0 and the end
+// of the source; may return fewer cuts than asked for.
+std::vector<std::uint32_t> find_chunk_boundaries(std::string_view source,
+                                                 std::size_t chunks);
+
+// Same tokens, Symbol ids and diagnostics as Lexer::gen_token, produced by
+// lexing the chunks of the file on the pool. Each chunk interns into its own
+// table; the tables are merged into `interner` in source order, so ids are
+// handed out in the same order as sequential lexing would.
+std::vector<Token> lex_parallel(const SourceManager &sources, FileId file,
+                                Diagnostics &diag, ThreadPool &pool,
+                                LexerEngine engine = LexerEngine::SWITCH,
+                                Interner &interner = Interner::global());
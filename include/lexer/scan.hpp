@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+// Bulk scanners used by the lexer to skip over runs of bytes without going
+// through Lexer::next_char for each of them. Every function scans
+// [begin, end) and returns a pointer to the first byte that stops the scan,
+// or `end` if there is none.
+//
+// The vector versions process 16 (SSE2) or 32 (AVX2) bytes per step. AVX2 is
+// picked at runtime when the CPU supports it; the scalar versions are the
+// reference the others are tested against.
+
+enum class ScanIsa : std::uint8_t { SCALAR, SSE2, AVX2 };
+
+struct ScanFunctions {
+  ScanIsa isa;
+  // First byte that is not a C whitespace character (" \t\n\v\f\r")
+  const char *(*skip_whitespace)(const char *begin, const char *end);
+  // First '\n'
+  const char *(*find_newline)(const char *begin, const char *end);
+  // First '*' that is directly followed by '/' inside the range
+  const char *(*find_comment_end)(const char *begin, const char *end);
+  // First byte that cannot continue an identifier ([A-Za-z0-9_])
+  const char *(*ident_end)(const char *begin, const char *end);
+};
+
+bool scan_isa_supported(ScanIsa isa);
+// Scanners for `isa`, which must be supported by the running CPU
+const ScanFunctions &scan_functions(ScanIsa isa);
+// Scanners new lexers use: the best supported ISA unless set_scan_isa was
+// called
+const ScanFunctions &active_scan_functions();
+void set_scan_isa(ScanIsa isa);
+const char *to_string(ScanIsa isa);
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "chunk_splitter.hpp"
+#include "diagnostics/diagnostics.hpp"
+#include "interner/interner.hpp"
+#include "lexer.hpp"
+#include "source/source_manager.hpp"
+#include "token.hpp"
+
+// Lexes input that arrives through a pipe without holding all of it. Bytes
+// are read into a buffer; whenever the buffer holds complete chunks (up to a
+// newline that ChunkSplitter proves safe) they are lexed while the rest of
+// the input is still being produced. Tokens, literals and comments that
+// straddle a refill simply stay in the buffer until their chunk is complete,
+// so the buffer only has to grow to the longest stretch without a safe
+// newline. The tokens are the ones Lexer::gen_token gives for the whole
+// input, up to and including the first bad token.
+class StreamLexer {
+public:
+  // Reads at most `capacity` bytes into `buffer` and returns how many, 0 at
+  // the end of the input. Returning fewer than asked for is fine.
+  using ReadFn = std::function<std::size_t(char *buffer, std::size_t capacity)>;
+
+  static constexpr std::size_t default_capacity = 64 * 1024;
+
+  // `file` must come from sources.add_stream()
+  StreamLexer(SourceManager &sources, FileId file, ReadFn read,
+              Diagnostics &diag, LexerEngine engine = LexerEngine::SWITCH,
+              Interner &interner = Interner::global(),
+              std::size_t capacity = default_capacity);
+
+  Token next_token();
+  // Only for the last two tokens returned, which covers the current and the
+  // peeked token of the parser
+  std::string_view lexeme(const Token &token) const;
+  std::size_t capacity() const { return buffer.size(); }
+
+private:
+  bool next_chunk();
+  void refill();
+
+  SourceManager &sources;
+  FileId file;
+  ReadFn read;
+  Diagnostics &diag;
+  LexerEngine engine;
+  Interner &interner;
+
+  // Holds the bytes at [buffer_base, buffer_base + filled) of the input
+  std::vector<char> buffer;
+  std::uint32_t buffer_base = 0;
+  std::size_t filled = 0;
+  // Indices into buffer: bytes before lexed have been handed to a chunk
+  // lexer, bytes before scanned have been seen by the splitter
+  std::size_t lexed = 0;
+  std::size_t scanned = 0;
+  ChunkSplitter splitter;
+  // Offsets of the last two tokens returned, oldest first
+  std::uint32_t recent[2] = {0, 0};
+  std::optional<Lexer> lexer;
+  bool last_chunk = false;
+  bool input_done = false;
+  // After the first bad token, or once the end has been returned
+  bool stopped = false;
+};
@@ -1,11 +1,12 @@
 #pragma once
 
-#include <string>
-#include <variant>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <type_traits>
 
-#include "common.hpp"
-
-enum class TokenKind {
+enum class TokenKind : std::uint8_t {
   // --- Operators ---
   NOT,
   BITWISE_NOT,
@@ -66,9 +67,53 @@ enum class TokenKind {
   BAD
 };
 
+inline constexpr std::size_t token_kind_count =
+    static_cast<std::size_t>(TokenKind::BAD) + 1;
+
+// Dense lookup table indexed by TokenKind, meant to be built at compile time
+// with make_token_table. Kinds without an entry hold a value-initialized T.
+template <typename T> struct TokenTable {
+  std::array<T, token_kind_count> values{};
+
+  constexpr const T &operator[](TokenKind kind) const {
+    return values[static_cast<std::size_t>(kind)];
+  }
+};
+
+template <typename T, std::size_t N>
+constexpr TokenTable<T>
+make_token_table(const std::pair<TokenKind, T> (&entries)[N]) {
+  TokenTable<T> table{};
+  for (const auto &[kind, value] : entries)
+    table.values[static_cast<std::size_t>(kind)] = value;
+  return table;
+}
+
+// Lexing errors carried in the payload of a BAD token
+enum class LexError : std::uint32_t {
+  UNDEFINED_SYMBOL,
+  UNTERMINATED_COMMENT,
+  MISSING_SINGLE_QUOTE,
+  MISSING_DOUBLE_QUOTE
+};
+
+// A token is a plain 16-byte value. It does not own its lexeme: the spelling
+// is the [offset, offset + length) slice of the source buffer, see
+// Lexer::lexeme(). Its line and column come from SourceManager::position()
+// on Lexer::loc(offset).
 struct Token {
   TokenKind kind;
-  std::string lexeme;
-  Position pos;
-  std::variant<std::monostate, int, char, std::string> value;
-};
\ No newline at end of file
+  std::uint32_t offset;
+  std::uint32_t length;
+  // INT_LITERAL and CHAR_LITERAL: the value
+  // IDENTIFIER: the interned Symbol id of the name
+  // STRING_LITERAL: the interned Symbol id of the unescaped text
+  // BAD: the LexError
+  std::uint32_t payload;
+
+  int int_value() const { return static_cast<int>(payload); }
+  char char_value() const { return static_cast<char>(payload); }
+};
+
+static_assert(sizeof(Token) == 16);
+static_assert(std::is_trivial_v<Token> && std::is_standard_layout_v<Token>);
\ No newline at end of file
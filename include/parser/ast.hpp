@@ -1,16 +1,30 @@
 #pragma once
 
-#include <memory>
 #include <optional>
-#include <string>
+#include <span>
+#include <type_traits>
 #include <variant>
-#include <vector>
 
 #include "common.hpp"
+#include "interner/interner.hpp"
+#include "support/arena.hpp"
 
 // Forward
 class ASTPrinter;
 
+// Index of a declaration in the table built by name analysis. Nodes that
+// declare or use a name carry one, so later phases keep what they know
+// about a declaration in vectors indexed by it and never look names up.
+using DeclId = std::uint32_t;
+// Until names are resolved, and for names that resolve to nothing
+inline constexpr DeclId no_decl = UINT32_MAX;
+
+// Canonical type from the TypeContext of type checking, written onto every
+// expression; equal types have equal ids
+using TypeId = std::uint32_t;
+// Until types are checked
+inline constexpr TypeId no_type = UINT32_MAX;
+
 enum class Bop {
   NOT,
   BITWISE_NOT,
@@ -47,25 +61,26 @@ struct TPoint;
 using TypeNode = std::variant<TVoid, TInt, TChar, TIdent, TPoint>;
 
 struct TVoid {
-  Position pos;
+  SourceLoc loc;
   void print(ASTPrinter &P) const;
 };
 struct TInt {
-  Position pos;
+  SourceLoc loc;
   void print(ASTPrinter &P) const;
 };
 struct TChar {
-  Position pos;
+  SourceLoc loc;
   void print(ASTPrinter &P) const;
 };
 struct TIdent {
-  Position pos;
-  std::string name;
+  SourceLoc loc;
+  Symbol name;
+  DeclId decl = no_decl;
   void print(ASTPrinter &P) const;
 };
 struct TPoint {
-  Position pos;
-  std::unique_ptr<TypeNode> point_type;
+  SourceLoc loc;
+  TypeNode *point_type;
   void print(ASTPrinter &P) const;
 };
 
@@ -85,54 +100,66 @@ struct EArrayAccess;
 using ExprNode = std::variant<EVar, EInt, EChar, EString, EBinOp, EUnOp, ECall,
                               ENew, EArrayAccess>;
 struct EVar {
-  Position pos;
-  std::string name;
+  SourceLoc loc;
+  Symbol name;
+  DeclId decl = no_decl;
+  TypeId type_id = no_type;
   void print(ASTPrinter &P) const;
 };
 struct EInt {
-  Position pos;
+  SourceLoc loc;
   int value;
+  TypeId type_id = no_type;
   void print(ASTPrinter &P) const;
 };
 struct EChar {
-  Position pos;
+  SourceLoc loc;
   char value;
+  TypeId type_id = no_type;
   void print(ASTPrinter &P) const;
 };
 struct EString {
-  Position pos;
-  std::string value;
+  SourceLoc loc;
+  Symbol value;
+  TypeId type_id = no_type;
   void print(ASTPrinter &P) const;
 };
 struct EBinOp {
-  Position pos;
+  SourceLoc loc;
   Bop op;
-  std::unique_ptr<ExprNode> lhs, rhs;
+  ExprNode *lhs, *rhs;
+  TypeId type_id = no_type;
   void print(ASTPrinter &P) const;
 };
 struct EUnOp {
-  Position pos;
+  SourceLoc loc;
   Uop op;
-  std::unique_ptr<ExprNode> rhs;
+  ExprNode *rhs;
+  TypeId type_id = no_type;
   void print(ASTPrinter &P) const;
 };
 struct ECall {
-  Position pos;
-  std::string name;
-  std::vector<std::unique_ptr<ExprNode>> args;
+  SourceLoc loc;
+  Symbol name;
+  std::span<ExprNode *> args;
+  DeclId decl = no_decl;
+  TypeId type_id = no_type;
   void print(ASTPrinter &P) const;
 };
 struct ENew {
-  Position pos;
-  std::unique_ptr<TypeNode> type;
-  std::unique_ptr<ExprNode> expr;
+  SourceLoc loc;
+  TypeNode *type;
+  ExprNode *expr;
+  TypeId type_id = no_type;
   void print(ASTPrinter &P) const;
 };
 struct EArrayAccess {
-  Position pos;
-  std::string name;
-  std::unique_ptr<ExprNode> index;
-  std::optional<std::string> label;
+  SourceLoc loc;
+  Symbol name;
+  ExprNode *index;
+  std::optional<Symbol> label;
+  DeclId decl = no_decl;
+  TypeId type_id = no_type;
   void print(ASTPrinter &P) const;
 };
 
@@ -156,77 +183,83 @@ using StmtNode = std::variant<SExpr, SVarDef, SVarAssign, SArrayAssign,
                               SArrayPlusAssign, SArrayMinusAssign, SScope, SIf,
                               SWhile, SBreak, SReturn, SDelete>;
 struct SExpr {
-  Position pos;
-  std::unique_ptr<ExprNode> expr;
+  SourceLoc loc;
+  ExprNode *expr;
   void print(ASTPrinter &P) const;
 };
 struct SVarDef {
-  Position pos;
-  std::unique_ptr<TypeNode> type;
-  std::string name;
-  std::unique_ptr<ExprNode> value;
+  SourceLoc loc;
+  TypeNode *type;
+  Symbol name;
+  ExprNode *value;
+  DeclId decl = no_decl;
   void print(ASTPrinter &P) const;
 };
 struct SVarAssign {
-  Position pos;
-  std::string name;
-  std::unique_ptr<ExprNode> value;
+  SourceLoc loc;
+  Symbol name;
+  ExprNode *value;
+  DeclId decl = no_decl;
   void print(ASTPrinter &P) const;
 };
 struct SArrayAssign {
-  Position pos;
-  std::string name;
-  std::unique_ptr<ExprNode> index;
-  std::optional<std::string> label;
-  std::unique_ptr<ExprNode> value;
+  SourceLoc loc;
+  Symbol name;
+  ExprNode *index;
+  std::optional<Symbol> label;
+  ExprNode *value;
+  DeclId decl = no_decl;
   void print(ASTPrinter &P) const;
 };
 struct SArrayPlusAssign {
-  Position pos;
-  std::string name;
-  std::unique_ptr<ExprNode> index;
-  std::optional<std::string> label;
-  std::unique_ptr<ExprNode> value;
+  SourceLoc loc;
+  Symbol name;
+  ExprNode *index;
+  std::optional<Symbol> label;
+  ExprNode *value;
+  DeclId decl = no_decl;
   void print(ASTPrinter &P) const;
 };
 struct SArrayMinusAssign {
-  Position pos;
-  std::string name;
-  std::unique_ptr<ExprNode> index;
-  std::optional<std::string> label;
-  std::unique_ptr<ExprNode> value;
+  SourceLoc loc;
+  Symbol name;
+  ExprNode *index;
+  std::optional<Symbol> label;
+  ExprNode *value;
+  DeclId decl = no_decl;
   void print(ASTPrinter &P) const;
 };
 struct SScope {
-  Position pos;
-  std::vector<std::unique_ptr<StmtNode>> stmts;
+  SourceLoc loc;
+  std::span<StmtNode *> stmts;
   void print(ASTPrinter &P) const;
 };
 struct SIf {
-  Position pos;
-  std::unique_ptr<ExprNode> cond;
-  std::unique_ptr<StmtNode> then_branch;
-  std::unique_ptr<StmtNode> else_branch;
+  SourceLoc loc;
+  ExprNode *cond;
+  StmtNode *then_branch;
+  StmtNode *else_branch;
   void print(ASTPrinter &P) const;
 };
 struct SWhile {
-  Position pos;
-  std::unique_ptr<ExprNode> cond;
-  std::unique_ptr<StmtNode> stmt;
+  SourceLoc loc;
+  ExprNode *cond;
+  StmtNode *stmt;
   void print(ASTPrinter &P) const;
 };
 struct SBreak {
-  Position pos;
+  SourceLoc loc;
   void print(ASTPrinter &P) const;
 };
 struct SReturn {
-  Position pos;
-  std::unique_ptr<ExprNode> expr;
+  SourceLoc loc;
+  ExprNode *expr;
   void print(ASTPrinter &P) const;
 };
 struct SDelete {
-  Position pos;
-  std::string name;
+  SourceLoc loc;
+  Symbol name;
+  DeclId decl = no_decl;
   void print(ASTPrinter &P) const;
 };
 
@@ -242,50 +275,64 @@ using GlobalNode =
     std::variant<GFuncDef, GFuncDecl, GVarDef, GVarDecl, GStruct>;
 
 struct Parameter {
-  std::unique_ptr<TypeNode> type;
-  std::string name;
+  TypeNode *type;
+  Symbol name;
+  DeclId decl = no_decl;
   void print(ASTPrinter &P) const;
 };
 
 struct GFuncDef {
-  Position pos;
-  std::unique_ptr<TypeNode> return_type;
-  std::string name;
-  std::vector<Parameter> params;
-  std::unique_ptr<StmtNode> stmt;
+  SourceLoc loc;
+  TypeNode *return_type;
+  Symbol name;
+  std::span<Parameter> params;
+  StmtNode *stmt;
+  DeclId decl = no_decl;
   void print(ASTPrinter &P) const;
 };
 struct GFuncDecl {
-  Position pos;
-  std::unique_ptr<TypeNode> return_type;
-  std::string name;
-  std::vector<Parameter> params;
+  SourceLoc loc;
+  TypeNode *return_type;
+  Symbol name;
+  std::span<Parameter> params;
+  DeclId decl = no_decl;
   void print(ASTPrinter &P) const;
 };
 struct GVarDef {
-  Position pos;
-  std::unique_ptr<TypeNode> type;
-  std::string name;
-  std::unique_ptr<ExprNode> value;
+  SourceLoc loc;
+  TypeNode *type;
+  Symbol name;
+  ExprNode *value;
+  DeclId decl = no_decl;
   void print(ASTPrinter &P) const;
 };
 struct GVarDecl {
-  Position pos;
-  std::unique_ptr<TypeNode> type;
-  std::string name;
+  SourceLoc loc;
+  TypeNode *type;
+  Symbol name;
+  DeclId decl = no_decl;
   void print(ASTPrinter &P) const;
 };
 struct GStruct {
-  Position pos;
-  std::string name;
-  std::vector<Parameter> fields;
+  SourceLoc loc;
+  Symbol name;
+  std::span<Parameter> fields;
+  DeclId decl = no_decl;
   void print(ASTPrinter &P) const;
 };
 
+// Nodes live in the Prog's arena and are never destroyed one by one
+static_assert(std::is_trivially_destructible_v<TypeNode> &&
+              std::is_trivially_destructible_v<ExprNode> &&
+              std::is_trivially_destructible_v<StmtNode> &&
+              std::is_trivially_destructible_v<GlobalNode>);
+
 // --- Root of the AST（p） ---
 struct Prog {
+  // Owns every node below, freeing the whole tree is a walk over its chunks
+  Arena arena;
   // TODO: in future extension, there might be other things in program
   // other than only globals
-  std::vector<std::unique_ptr<GlobalNode>> globals;
+  std::span<GlobalNode *> globals;
   void print(ASTPrinter &P) const;
 };
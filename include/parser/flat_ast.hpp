@@ -0,0 +1,272 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "common.hpp"
+#include "interner/interner.hpp"
+#include "parser/ast.hpp"
+
+// Index-based AST. Each node category has its own table with one array per
+// field, and a node is a 32-bit index into that table. Operands are child
+// ids, Symbol ids, enum values or the index of a list in FlatAst::lists.
+// Children are always added before their parent.
+//
+//   Types    TIdent: name | TPoint: pointee
+//   Exprs    EVar: name | EInt: value | EChar: value | EString: value
+//            EBinOp: op, lhs, rhs | EUnOp: op, rhs | ECall: name, args
+//            ENew: type, expr | EArrayAccess: name, index, label
+//   Stmts    SExpr: expr | SVarDef: type, name, value | SVarAssign: name, value
+//            SArray{,Plus,Minus}Assign: name, index, label, value
+//            SScope: stmts | SIf: cond, then, else | SWhile: cond, stmt
+//            SReturn: expr | SDelete: name
+//   Globals  GFuncDef: return type, name, params, stmt
+//            GFuncDecl: return type, name, params | GVarDef: type, name,
+//            value | GVarDecl: type, name | GStruct: name, fields
+//
+// Missing optional operands (label, else branch, returned value) are
+// no_node. Parameter and field lists hold (type, name) pairs.
+using NodeId = std::uint32_t;
+inline constexpr NodeId no_node = ~NodeId{0};
+
+enum class TypeKind : std::uint8_t { VOID, INT, CHAR, IDENT, POINT };
+enum class ExprKind : std::uint8_t {
+  VAR,
+  INT,
+  CHAR,
+  STRING,
+  BIN_OP,
+  UN_OP,
+  CALL,
+  NEW,
+  ARRAY_ACCESS
+};
+enum class StmtKind : std::uint8_t {
+  EXPR,
+  VAR_DEF,
+  VAR_ASSIGN,
+  ARRAY_ASSIGN,
+  ARRAY_PLUS_ASSIGN,
+  ARRAY_MINUS_ASSIGN,
+  SCOPE,
+  IF,
+  WHILE,
+  BREAK,
+  RETURN,
+  DELETE
+};
+enum class GlobalKind : std::uint8_t {
+  FUNC_DEF,
+  FUNC_DECL,
+  VAR_DEF,
+  VAR_DECL,
+  STRUCT
+};
+
+template <typename Kind, std::size_t Operands> struct NodeTable {
+  std::vector<Kind> kind;
+  std::vector<SourceLoc> loc;
+  std::array<std::vector<std::uint32_t>, Operands> operands;
+
+  std::size_t size() const { return kind.size(); }
+  std::uint32_t operand(NodeId id, std::size_t index) const {
+    return operands[index][id];
+  }
+  NodeId add(Kind node_kind, SourceLoc node_loc,
+             std::array<std::uint32_t, Operands> node_operands = {}) {
+    kind.push_back(node_kind);
+    loc.push_back(node_loc);
+    for (std::size_t i = 0; i < Operands; ++i)
+      operands[i].push_back(node_operands[i]);
+    return static_cast<NodeId>(kind.size() - 1);
+  }
+};
+
+struct FlatAst {
+  NodeTable<TypeKind, 1> types;
+  NodeTable<ExprKind, 3> exprs;
+  NodeTable<StmtKind, 4> stmts;
+  NodeTable<GlobalKind, 4> globals;
+  // Lists stored back to back, each as its length followed by the items
+  std::vector<std::uint32_t> lists;
+  // List of the program's globals
+  std::uint32_t prog = 0;
+
+  std::span<const std::uint32_t> list(std::uint32_t index) const {
+    return {lists.data() + index + 1, lists[index]};
+  }
+  std::uint32_t add_list(std::span<const std::uint32_t> items) {
+    auto index = static_cast<std::uint32_t>(lists.size());
+    lists.push_back(static_cast<std::uint32_t>(items.size()));
+    lists.insert(lists.end(), items.begin(), items.end());
+    return index;
+  }
+  // Appends the nodes and lists of `part`, renumbered to follow the ones
+  // already here; its global g becomes global g + globals.size() from before
+  void append(const FlatAst &part);
+};
+
+// Rebuilds the pointer tree, e.g. to print a FlatAst with ASTPrinter
+std::unique_ptr<Prog> to_tree(const FlatAst &ast);
+
+// Node builder for BasicParser that fills a FlatAst
+class FlatBuilder {
+public:
+  using Type = NodeId;
+  using Expr = NodeId;
+  using Stmt = NodeId;
+  using Global = NodeId;
+  struct Param {
+    NodeId type;
+    Symbol name;
+  };
+  using Result = std::unique_ptr<FlatAst>;
+  static constexpr NodeId none = no_node;
+
+  void begin() { ast = std::make_unique<FlatAst>(); }
+  Result finish(std::span<const Global> globals) {
+    ast->prog = ast->add_list(globals);
+    return std::move(ast);
+  }
+  // Joins the tables built from consecutive parts of one file
+  Result merge(std::span<Result> parts) {
+    begin();
+    std::vector<Global> globals;
+    for (auto &part : parts) {
+      auto base = static_cast<NodeId>(ast->globals.size());
+      ast->append(*part);
+      for (auto global : part->list(part->prog))
+        globals.push_back(base + global);
+    }
+    return finish(globals);
+  }
+
+  Type type_void(SourceLoc loc) { return ast->types.add(TypeKind::VOID, loc); }
+  Type type_int(SourceLoc loc) { return ast->types.add(TypeKind::INT, loc); }
+  Type type_char(SourceLoc loc) { return ast->types.add(TypeKind::CHAR, loc); }
+  Type type_ident(SourceLoc loc, Symbol name) {
+    return ast->types.add(TypeKind::IDENT, loc, {name.id});
+  }
+  Type type_point(SourceLoc loc, Type pointee) {
+    return ast->types.add(TypeKind::POINT, loc, {pointee});
+  }
+
+  Expr expr_var(SourceLoc loc, Symbol name) {
+    return ast->exprs.add(ExprKind::VAR, loc, {name.id});
+  }
+  Expr expr_int(SourceLoc loc, int value) {
+    return ast->exprs.add(ExprKind::INT, loc,
+                          {static_cast<std::uint32_t>(value)});
+  }
+  Expr expr_char(SourceLoc loc, char value) {
+    return ast->exprs.add(ExprKind::CHAR, loc,
+                          {static_cast<unsigned char>(value)});
+  }
+  Expr expr_string(SourceLoc loc, Symbol value) {
+    return ast->exprs.add(ExprKind::STRING, loc, {value.id});
+  }
+  Expr expr_bin_op(SourceLoc loc, Bop op, Expr lhs, Expr rhs) {
+    return ast->exprs.add(ExprKind::BIN_OP, loc,
+                          {static_cast<std::uint32_t>(op), lhs, rhs});
+  }
+  Expr expr_un_op(SourceLoc loc, Uop op, Expr rhs) {
+    return ast->exprs.add(ExprKind::UN_OP, loc,
+                          {static_cast<std::uint32_t>(op), rhs});
+  }
+  Expr expr_call(SourceLoc loc, Symbol name, std::span<const Expr> args) {
+    return ast->exprs.add(ExprKind::CALL, loc, {name.id, ast->add_list(args)});
+  }
+  Expr expr_new(SourceLoc loc, Type type, Expr expr) {
+    return ast->exprs.add(ExprKind::NEW, loc, {type, expr});
+  }
+  Expr expr_array_access(SourceLoc loc, Symbol name, Expr index,
+                         std::optional<Symbol> label) {
+    return ast->exprs.add(ExprKind::ARRAY_ACCESS, loc,
+                          {name.id, index, label ? label->id : no_node});
+  }
+
+  Stmt stmt_expr(SourceLoc loc, Expr expr) {
+    return ast->stmts.add(StmtKind::EXPR, loc, {expr});
+  }
+  Stmt stmt_var_def(SourceLoc loc, Type type, Symbol name, Expr value) {
+    return ast->stmts.add(StmtKind::VAR_DEF, loc, {type, name.id, value});
+  }
+  Stmt stmt_var_assign(SourceLoc loc, Symbol name, Expr value) {
+    return ast->stmts.add(StmtKind::VAR_ASSIGN, loc, {name.id, value});
+  }
+  Stmt stmt_array_assign(SourceLoc loc, Symbol name, Expr index,
+                         std::optional<Symbol> label, Expr value) {
+    return array_assign(StmtKind::ARRAY_ASSIGN, loc, name, index, label,
+                        value);
+  }
+  Stmt stmt_array_plus_assign(SourceLoc loc, Symbol name, Expr index,
+                              std::optional<Symbol> label, Expr value) {
+    return array_assign(StmtKind::ARRAY_PLUS_ASSIGN, loc, name, index, label,
+                        value);
+  }
+  Stmt stmt_array_minus_assign(SourceLoc loc, Symbol name, Expr index,
+                               std::optional<Symbol> label, Expr value) {
+    return array_assign(StmtKind::ARRAY_MINUS_ASSIGN, loc, name, index, label,
+                        value);
+  }
+  Stmt stmt_scope(SourceLoc loc, std::span<const Stmt> stmts) {
+    return ast->stmts.add(StmtKind::SCOPE, loc, {ast->add_list(stmts)});
+  }
+  Stmt stmt_if(SourceLoc loc, Expr cond, Stmt then_branch, Stmt else_branch) {
+    return ast->stmts.add(StmtKind::IF, loc, {cond, then_branch, else_branch});
+  }
+  Stmt stmt_while(SourceLoc loc, Expr cond, Stmt stmt) {
+    return ast->stmts.add(StmtKind::WHILE, loc, {cond, stmt});
+  }
+  Stmt stmt_break(SourceLoc loc) { return ast->stmts.add(StmtKind::BREAK, loc); }
+  Stmt stmt_return(SourceLoc loc, Expr expr) {
+    return ast->stmts.add(StmtKind::RETURN, loc, {expr});
+  }
+  Stmt stmt_delete(SourceLoc loc, Symbol name) {
+    return ast->stmts.add(StmtKind::DELETE, loc, {name.id});
+  }
+
+  Global global_func_def(SourceLoc loc, Type return_type, Symbol name,
+                         std::span<const Param> params, Stmt stmt) {
+    return ast->globals.add(GlobalKind::FUNC_DEF, loc,
+                            {return_type, name.id, add_params(params), stmt});
+  }
+  Global global_func_decl(SourceLoc loc, Type return_type, Symbol name,
+                          std::span<const Param> params) {
+    return ast->globals.add(GlobalKind::FUNC_DECL, loc,
+                            {return_type, name.id, add_params(params)});
+  }
+  Global global_var_def(SourceLoc loc, Type type, Symbol name, Expr value) {
+    return ast->globals.add(GlobalKind::VAR_DEF, loc, {type, name.id, value});
+  }
+  Global global_var_decl(SourceLoc loc, Type type, Symbol name) {
+    return ast->globals.add(GlobalKind::VAR_DECL, loc, {type, name.id});
+  }
+  Global global_struct(SourceLoc loc, Symbol name,
+                       std::span<const Param> fields) {
+    return ast->globals.add(GlobalKind::STRUCT, loc,
+                            {name.id, add_params(fields)});
+  }
+
+private:
+  Stmt array_assign(StmtKind kind, SourceLoc loc, Symbol name, Expr index,
+                    std::optional<Symbol> label, Expr value) {
+    return ast->stmts.add(kind, loc,
+                          {name.id, index, label ? label->id : no_node, value});
+  }
+  std::uint32_t add_params(std::span<const Param> params) {
+    auto index = static_cast<std::uint32_t>(ast->lists.size());
+    ast->lists.push_back(static_cast<std::uint32_t>(params.size() * 2));
+    for (const auto &param : params) {
+      ast->lists.push_back(param.type);
+      ast->lists.push_back(param.name.id);
+    }
+    return index;
+  }
+
+  std::unique_ptr<FlatAst> ast;
+};
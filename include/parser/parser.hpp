@@ -1,82 +1,228 @@
 #pragma once
 
+#include <memory>
 #include <optional>
+#include <span>
 #include <string>
-#include <unordered_map>
+#include <vector>
 
 #include "ast.hpp"
 #include "common.hpp"
 #include "diagnostics/diagnostics.hpp"
+#include "flat_ast.hpp"
 #include "lexer/lexer.hpp"
+#include "lexer/stream_lexer.hpp"
 #include "lexer/token.hpp"
+#include "source/source_manager.hpp"
+#include "support/thread_pool.hpp"
+#include "tree_builder.hpp"
 
-class Parser {
-  CigridFlags &flags;
+// Items of a list being parsed, kept on top of a scratch stack shared by all
+// lists of that kind. A nested list pushes above its parent's items and pops
+// them when it goes out of scope, so once the stack has grown to the deepest
+// nesting, parsing a list allocates nothing.
+template <typename T> class ScratchList {
+  std::vector<T> &stack;
+  std::size_t mark;
+
+public:
+  explicit ScratchList(std::vector<T> &stack)
+      : stack(stack), mark(stack.size()) {}
+  ~ScratchList() { stack.erase(stack.begin() + mark, stack.end()); }
+  ScratchList(const ScratchList &) = delete;
+  ScratchList &operator=(const ScratchList &) = delete;
+
+  void push_back(T item) { stack.push_back(item); }
+  // Valid until the next push on the stack
+  operator std::span<const T>() const {
+    return std::span<const T>(stack).subspan(mark);
+  }
+};
+
+// Token indices where the top-level globals start, found by brace matching
+// alone: a global ends at a ';' outside braces, or at the '}' closing a
+// function body. `tokens` excludes the final END_OF_FILE. On malformed
+// input the split may be wrong, which parsing the parts then reports.
+std::vector<std::size_t> find_global_boundaries(std::span<const Token> tokens);
+
+// Where and why parsing stopped
+struct ParseError {
+  SourceLoc loc;
+  std::string message;
+};
+
+// Recursive descent parser for Cigrid. Nodes are made through Builder, so
+// the same grammar code can produce the pointer tree (TreeBuilder) or the
+// flat tables (FlatBuilder) directly. Expressions and statements, which
+// generated code nests arbitrarily deep, do not recurse: the constructs left
+// open are kept on explicit stacks, so the native stack stays flat however
+// deep the input nests.
+template <typename Builder> class BasicParser {
+  using Type = typename Builder::Type;
+  using Expr = typename Builder::Expr;
+  using Stmt = typename Builder::Stmt;
+  using Global = typename Builder::Global;
+  using Param = typename Builder::Param;
+  using Result = typename Builder::Result;
+
+  const CigridFlags &flags;
   Diagnostics &diag;
-  std::string source;
+  const SourceManager &sources;
   Lexer lexer;
-  Token current_token;
-  Token peek_token;
+  FileId file;
+  // Shared by parallel lexing and parsing, sized for the larger of the two;
+  // null when both are off
+  std::unique_ptr<ThreadPool> pool;
+  // Token stream when lexed up front, for parallel lexing or parsing
+  std::vector<Token> pre_lexed;
+  // Set when the tokens come from pre_lexed or from a part of it. Once they
+  // run out, end_token keeps coming back.
+  bool from_tokens = false;
+  std::span<const Token> tokens;
+  std::size_t next_index = 0;
+  Token end_token{};
+  // Set when parsing input that is still arriving
+  std::unique_ptr<StreamLexer> stream;
+  Builder builder;
+  // Backing stacks of the ScratchLists, also holding the arguments of the
+  // calls in expr_frames and the statements of the scopes in stmt_frames
+  std::vector<Expr> expr_scratch;
+  std::vector<Stmt> stmt_scratch;
+  std::vector<Param> param_scratch;
+  std::vector<Global> global_scratch;
+  // Constructs an expression being parsed is nested in, see parse_expr()
+  enum class ExprFrameKind { PAREN, UNARY, BINARY, CALL, INDEX, NEW };
+  struct ExprFrame {
+    ExprFrameKind kind;
+    // Where the construct starts; for BINARY, where its left operand starts
+    SourceLoc loc;
+    Uop uop = Uop::NEG;
+    Bop bop = Bop::PLUS;
+    // Lowest precedence the right operand of BINARY takes in
+    int precedence = 0;
+    Expr lhs = Builder::none;
+    // Callee of CALL, array of INDEX
+    Symbol name{0};
+    // Element type of NEW
+    Type type = Builder::none;
+    // First argument of CALL in expr_scratch
+    std::size_t mark = 0;
+  };
+  std::vector<ExprFrame> expr_frames;
+  // Compound statements a statement being parsed is nested in, see
+  // parse_stmt(). THEN and ELSE are the two branches of an if.
+  enum class StmtFrameKind { SCOPE, THEN, ELSE, WHILE, FOR };
+  struct StmtFrame {
+    StmtFrameKind kind;
+    SourceLoc loc;
+    Expr cond = Builder::none;
+    // Then branch of ELSE, initialization of FOR
+    Stmt stmt = Builder::none;
+    // Update of FOR
+    Stmt assign = Builder::none;
+    // First statement of SCOPE in stmt_scratch
+    std::size_t mark = 0;
+  };
+  std::vector<StmtFrame> stmt_frames;
+  Token current_token{};
+  Token peek_token{};
   bool has_peeked = false;
+  // Set by the first syntax error, after which parsing winds down
+  bool failed = false;
+  std::optional<ParseError> first_error;
 
 public:
-  explicit Parser(std::istream &file, Diagnostics &diag, CigridFlags &flags);
-  std::unique_ptr<Prog> parse();
+  explicit BasicParser(const SourceManager &sources, FileId file,
+                       Diagnostics &diag, const CigridFlags &flags);
+  // Parses `file` from sources.add_stream() while its bytes are still being
+  // read, see StreamLexer
+  BasicParser(SourceManager &sources, FileId file, StreamLexer::ReadFn read,
+              Diagnostics &diag, const CigridFlags &flags);
+  // Null after a syntax error, which is then in parse_error() and diag
+  Result parse();
+  const std::optional<ParseError> &parse_error() const { return first_error; }
 
 private:
-  static std::string read_stream(std::istream &file);
-
+  // Parses the globals in `tokens`, a part of a file lexed up front
+  BasicParser(const SourceManager &sources, FileId file, Diagnostics &diag,
+              const CigridFlags &flags, std::span<const Token> tokens,
+              Token end_token);
+  // Parses runs of globals on the pool and merges them. Null if any run
+  // failed or there is only one; the caller then parses sequentially, which
+  // also reports the error.
+  Result parse_parallel();
+  void start();
+  Token next_token();
+  std::string_view lexeme(const Token &token) const;
   void advance();
   void expect(TokenKind kind);
-  void error(Position pos, std::string message);
+  void error(SourceLoc loc, std::string message);
   const Token &peek(int num = 1);
+  // Location of the current token
+  SourceLoc location() const { return lexer.loc(current_token.offset); }
 
-  // Return string since other others will need the name to construct
-  std::string parse_ident();
-  std::unique_ptr<TypeNode> parse_ty();
+  // Return the interned name, other parsers need it to construct nodes
+  Symbol parse_ident();
+  Type parse_ty();
   bool is_type_token() const; // no arguments, just check the current token
   bool is_type_token(const Token &token) const;
 
   // --- Expression parsers ---
+  // A finished operand and where its text starts, which is also where a
+  // binary operation with it on the left starts
+  struct Operand {
+    Expr expr = Builder::none;
+    SourceLoc loc{};
+  };
   bool is_binop() const; // no arguments, just check the current token
   bool is_binop(const TokenKind &kind) const;
   Bop parse_bop();
   Uop parse_uop();
-  std::unique_ptr<ExprNode> parse_atom();
-  std::unique_ptr<ExprNode> parse_expr_array_access();
-  std::unique_ptr<ExprNode> parse_expr_function_call();
-  std::unique_ptr<ExprNode> parse_expr_var();
-  std::unique_ptr<ExprNode> parse_expr_constant();
-  std::unique_ptr<ExprNode> parse_expr_unop();
-  std::unique_ptr<ExprNode> parse_expr_in_paren();
-  std::unique_ptr<ExprNode> parse_expr_new();
-  std::unique_ptr<ExprNode> parse_expr(int min_precedence = 1);
+  Expr parse_expr_var();
+  Expr parse_expr_constant();
+  // Pushes a frame for every construct opened before the next operand
+  // without nested expressions, and parses that operand
+  void parse_operand(Operand &operand);
+  // Folds `operand` into the frames above `base` it completes. True when
+  // another operand follows, e.g. after a binary operator or a ','.
+  bool reduce_operand(Operand &operand, std::size_t base);
+  // Drops the frames above `base` after a syntax error
+  void unwind_expr(std::size_t base);
+  Expr parse_expr();
 
   // --- Statement parsers ---
-  std::unique_ptr<StmtNode> parse_stmt();
-  std::unique_ptr<StmtNode> parse_stmt_scope();
-  std::unique_ptr<StmtNode> parse_stmt_if();
-  std::unique_ptr<StmtNode> parse_stmt_while();
-  std::unique_ptr<StmtNode> parse_stmt_break();
-  std::unique_ptr<StmtNode> parse_stmt_return();
-  std::unique_ptr<StmtNode> parse_stmt_delete();
-  std::unique_ptr<StmtNode> parse_stmt_for();
+  Stmt parse_stmt();
+  // The heads of compound statements push a frame, parse_stmt() parses
+  // the statements nested in them
+  void parse_stmt_scope();
+  void parse_stmt_if();
+  void parse_stmt_while();
+  void parse_stmt_for();
+  // Pops the SCOPE frame on top once its '}' is reached
+  Stmt finish_stmt_scope();
+  Stmt parse_stmt_break();
+  Stmt parse_stmt_return();
+  Stmt parse_stmt_delete();
+  // Drops the frames above `base` after a syntax error
+  void unwind_stmt(std::size_t base);
 
   // --- Assign parsers ---
-  std::unique_ptr<StmtNode> parse_assign(); // need peek
-  std::unique_ptr<StmtNode> parse_lvalue(); // need peek
-  std::unique_ptr<StmtNode> parse_varassign();
+  Stmt parse_assign(); // need peek
+  Stmt parse_lvalue(); // need peek
+  Stmt parse_varassign();
 
   // --- Global parsers ---
-  std::vector<Parameter> parse_params();
-  std::unique_ptr<GlobalNode> parse_global();
-  std::unique_ptr<GlobalNode> parse_global_extern();
-  std::unique_ptr<GlobalNode> parse_global_def();
-  std::unique_ptr<GlobalNode> parse_global_struct();
-  std::unique_ptr<Prog> parse_prog();
+  void parse_params(ScratchList<Param> &params);
+  Global parse_global();
+  Global parse_global_extern();
+  Global parse_global_def();
+  Global parse_global_struct();
+  Result parse_prog();
 
 private:
-  static const inline std::unordered_map<TokenKind, int> precedence = {
+  // Operator tables indexed by TokenKind, all built at compile time.
+  // A precedence of 0 means the token is not a binary operator.
+  static constexpr auto precedence = make_token_table<int>({
       {TokenKind::LOGICAL_OR, 1}, {TokenKind::LOGICAL_AND, 2},
       {TokenKind::BITWISE_OR, 3}, {TokenKind::BITWISE_AND, 4},
       {TokenKind::EQUAL, 5},      {TokenKind::NOT_EQUAL, 5},
@@ -91,8 +237,8 @@ private:
       // {NOT, ?},
       // {NEG, ?},
       // {EXPONENTIAL, ?},
-  };
-  static const inline std::unordered_map<TokenKind, int> associativity = {
+  });
+  static constexpr auto associativity = make_token_table<int>({
       {TokenKind::LOGICAL_OR, 1}, {TokenKind::LOGICAL_AND, 1},
       {TokenKind::BITWISE_OR, 1}, {TokenKind::BITWISE_AND, 1},
       {TokenKind::EQUAL, 1},      {TokenKind::NOT_EQUAL, 1},
@@ -107,9 +253,9 @@ private:
       // {NOT, ?},
       // {NEG, ?},
       // {EXPONENTIAL, ?},
-  };
+  });
 
-  static const inline std::unordered_map<TokenKind, Bop> bop_map = {
+  static constexpr auto bop_map = make_token_table<std::optional<Bop>>({
       {TokenKind::NOT, Bop::NOT},
       {TokenKind::BITWISE_NOT, Bop::BITWISE_NOT},
       {TokenKind::PLUS, Bop::PLUS},
@@ -131,11 +277,18 @@ private:
       {TokenKind::LOGICAL_OR, Bop::LOGICAL_OR},
       {TokenKind::SHIFT_LEFT, Bop::SHIFT_LEFT},
       {TokenKind::SHIFT_RIGHT, Bop::SHIFT_RIGHT},
-  };
+  });
 
-  static const inline std::unordered_map<TokenKind, Uop> uop_map = {
+  static constexpr auto uop_map = make_token_table<std::optional<Uop>>({
       {TokenKind::NOT, Uop::NOT},
       {TokenKind::BITWISE_NOT, Uop::BITWISE_NOT},
       {TokenKind::MINUS, Uop::NEG}, // unary minus
-  };
-};
\ No newline at end of file
+  });
+};
+
+// Both instantiations live in parser.cpp
+extern template class BasicParser<TreeBuilder>;
+extern template class BasicParser<FlatBuilder>;
+
+using Parser = BasicParser<TreeBuilder>;
+using FlatParser = BasicParser<FlatBuilder>;
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "common.hpp"
+#include "interner/interner.hpp"
+#include "parser/ast.hpp"
+
+// Node builder for BasicParser that places a pointer tree in a Prog's arena
+class TreeBuilder {
+public:
+  using Type = TypeNode *;
+  using Expr = ExprNode *;
+  using Stmt = StmtNode *;
+  using Global = GlobalNode *;
+  using Param = Parameter;
+  using Result = std::unique_ptr<Prog>;
+  static constexpr std::nullptr_t none = nullptr;
+
+  void begin() {
+    prog = std::make_unique<Prog>();
+    arena = &prog->arena;
+  }
+  Result finish(std::span<const Global> globals) {
+    prog->globals = arena->copy(globals);
+    return std::move(prog);
+  }
+  // Joins programs built from consecutive parts of one file: their arenas
+  // move into the new Prog, so the nodes stay where they are
+  Result merge(std::span<Result> parts) {
+    begin();
+    std::vector<Global> globals;
+    for (auto &part : parts) {
+      arena->adopt(part->arena);
+      globals.insert(globals.end(), part->globals.begin(),
+                     part->globals.end());
+    }
+    return finish(globals);
+  }
+
+  Type type_void(SourceLoc loc) { return arena->make<TypeNode>(TVoid{loc}); }
+  Type type_int(SourceLoc loc) { return arena->make<TypeNode>(TInt{loc}); }
+  Type type_char(SourceLoc loc) { return arena->make<TypeNode>(TChar{loc}); }
+  Type type_ident(SourceLoc loc, Symbol name) {
+    return arena->make<TypeNode>(TIdent{loc, name});
+  }
+  Type type_point(SourceLoc loc, Type pointee) {
+    return arena->make<TypeNode>(TPoint{loc, pointee});
+  }
+
+  Expr expr_var(SourceLoc loc, Symbol name) {
+    return arena->make<ExprNode>(EVar{loc, name});
+  }
+  Expr expr_int(SourceLoc loc, int value) {
+    return arena->make<ExprNode>(EInt{loc, value});
+  }
+  Expr expr_char(SourceLoc loc, char value) {
+    return arena->make<ExprNode>(EChar{loc, value});
+  }
+  Expr expr_string(SourceLoc loc, Symbol value) {
+    return arena->make<ExprNode>(EString{loc, value});
+  }
+  Expr expr_bin_op(SourceLoc loc, Bop op, Expr lhs, Expr rhs) {
+    return arena->make<ExprNode>(EBinOp{loc, op, lhs, rhs});
+  }
+  Expr expr_un_op(SourceLoc loc, Uop op, Expr rhs) {
+    return arena->make<ExprNode>(EUnOp{loc, op, rhs});
+  }
+  Expr expr_call(SourceLoc loc, Symbol name, std::span<const Expr> args) {
+    return arena->make<ExprNode>(ECall{loc, name, arena->copy(args)});
+  }
+  Expr expr_new(SourceLoc loc, Type type, Expr expr) {
+    return arena->make<ExprNode>(ENew{loc, type, expr});
+  }
+  Expr expr_array_access(SourceLoc loc, Symbol name, Expr index,
+                         std::optional<Symbol> label) {
+    return arena->make<ExprNode>(EArrayAccess{loc, name, index, label});
+  }
+
+  Stmt stmt_expr(SourceLoc loc, Expr expr) {
+    return arena->make<StmtNode>(SExpr{loc, expr});
+  }
+  Stmt stmt_var_def(SourceLoc loc, Type type, Symbol name, Expr value) {
+    return arena->make<StmtNode>(SVarDef{loc, type, name, value});
+  }
+  Stmt stmt_var_assign(SourceLoc loc, Symbol name, Expr value) {
+    return arena->make<StmtNode>(SVarAssign{loc, name, value});
+  }
+  Stmt stmt_array_assign(SourceLoc loc, Symbol name, Expr index,
+                         std::optional<Symbol> label, Expr value) {
+    return arena->make<StmtNode>(SArrayAssign{loc, name, index, label, value});
+  }
+  Stmt stmt_array_plus_assign(SourceLoc loc, Symbol name, Expr index,
+                              std::optional<Symbol> label, Expr value) {
+    return arena->make<StmtNode>(
+        SArrayPlusAssign{loc, name, index, label, value});
+  }
+  Stmt stmt_array_minus_assign(SourceLoc loc, Symbol name, Expr index,
+                               std::optional<Symbol> label, Expr value) {
+    return arena->make<StmtNode>(
+        SArrayMinusAssign{loc, name, index, label, value});
+  }
+  Stmt stmt_scope(SourceLoc loc, std::span<const Stmt> stmts) {
+    return arena->make<StmtNode>(SScope{loc, arena->copy(stmts)});
+  }
+  Stmt stmt_if(SourceLoc loc, Expr cond, Stmt then_branch, Stmt else_branch) {
+    return arena->make<StmtNode>(SIf{loc, cond, then_branch, else_branch});
+  }
+  Stmt stmt_while(SourceLoc loc, Expr cond, Stmt stmt) {
+    return arena->make<StmtNode>(SWhile{loc, cond, stmt});
+  }
+  Stmt stmt_break(SourceLoc loc) { return arena->make<StmtNode>(SBreak{loc}); }
+  Stmt stmt_return(SourceLoc loc, Expr expr) {
+    return arena->make<StmtNode>(SReturn{loc, expr});
+  }
+  Stmt stmt_delete(SourceLoc loc, Symbol name) {
+    return arena->make<StmtNode>(SDelete{loc, name});
+  }
+
+  Global global_func_def(SourceLoc loc, Type return_type, Symbol name,
+                         std::span<const Param> params, Stmt stmt) {
+    return arena->make<GlobalNode>(
+        GFuncDef{loc, return_type, name, arena->copy(params), stmt});
+  }
+  Global global_func_decl(SourceLoc loc, Type return_type, Symbol name,
+                          std::span<const Param> params) {
+    return arena->make<GlobalNode>(
+        GFuncDecl{loc, return_type, name, arena->copy(params)});
+  }
+  Global global_var_def(SourceLoc loc, Type type, Symbol name, Expr value) {
+    return arena->make<GlobalNode>(GVarDef{loc, type, name, value});
+  }
+  Global global_var_decl(SourceLoc loc, Type type, Symbol name) {
+    return arena->make<GlobalNode>(GVarDecl{loc, type, name});
+  }
+  Global global_struct(SourceLoc loc, Symbol name,
+                       std::span<const Param> fields) {
+    return arena->make<GlobalNode>(GStruct{loc, name, arena->copy(fields)});
+  }
+
+private:
+  std::unique_ptr<Prog> prog;
+  // Arena of the Prog being built
+  Arena *arena = nullptr;
+};
@@ -1,56 +1,94 @@
 #pragma once
 
-#include <functional>
+#include <initializer_list>
+#include <iterator>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
 
-#include "fmt/core.h"
+#include "fmt/format.h"
 #include "parser/ast.hpp"
+#include "support/thread_pool.hpp"
 
+// Prints the AST in the reference format. The print() of a node does not
+// print its children itself: it hands its output to write() as pieces, text
+// and child nodes alike, which the printer then prints in order from an
+// explicit stack. Trees of any depth print without using native stack.
+//
+// Output is rendered into a memory buffer, either the caller's or one of
+// the printer's own that goes to stdout in large writes.
 class ASTPrinter {
 public:
-  explicit ASTPrinter();
+  // Printed quoted, with special characters escaped
+  struct Quoted {
+    Symbol text;
+  };
+  // Indentation as a piece of output: HERE prints the current indentation,
+  // IN and OUT deepen and restore it
+  enum class Indent { HERE, IN, OUT };
+  using Piece =
+      std::variant<std::string_view, Symbol, Quoted, int, Indent,
+                   const TypeNode *, const ExprNode *, const StmtNode *,
+                   const Parameter *, const GlobalNode *>;
+
+  // Renders into `out`, which the caller writes out
+  explicit ASTPrinter(fmt::memory_buffer &out);
+  // Renders into a buffer of its own, written to stdout by flush()
+  ASTPrinter();
+  ~ASTPrinter() { flush(); }
+  ASTPrinter(const ASTPrinter &) = delete;
+  ASTPrinter &operator=(const ASTPrinter &) = delete;
   // void print(const Prog &prog);
 
   // TODO: 分发叫dispatch吗
-  void print_indent() { fmt::print("{}", std::string(current_indent, ' ')); }
-  void print_ident(const std::string &name);
   void print_type(const TypeNode &ty);
   void print_expr(const ExprNode &expr);
   void print_stmt(const StmtNode &stmt);
-  void print_params(const std::vector<Parameter> &params);
   void print_global(const GlobalNode &global);
+  // Prints the globals of `prog` as Prog::print() does, rendering runs of
+  // them into buffers of their own on `pool` and appending those in order
+  void print_parallel(const Prog &prog, ThreadPool &pool);
+  // Writes the printer's own buffer to stdout; nothing to do for a caller's
+  void flush();
 
-
-  // TODO: Too complicated
-  void print_list(const char *kind,
-                  std::initializer_list<std::function<void()>> fields) {
-    print_indent();
-    fmt::print("{}(", kind);
-
-    bool first = true;
-    for (auto &f : fields) {
-      if (!first) fmt::print(", ");
-      first = false;
-      f();            // TODO: 调用你传进来的打印 lambda
-    }
-
-    fmt::print(")\n");
+  // For the print() of nodes: the pieces are printed once it returns, and
+  // before anything that was still to be printed
+  void write(std::initializer_list<Piece> pieces) {
+    written.insert(written.end(), pieces);
   }
-  
-  // RAII Indent control
-  struct Indent {
-    ASTPrinter &printer;
-    Indent(ASTPrinter &p) : printer(p) { printer.increase_indent(); }
-    ~Indent() { printer.decrease_indent(); }
-  };
 
 private:
+  void walk(Piece root);
+  void print_piece(std::string_view text) {
+    out.append(text.data(), text.data() + text.size());
+  }
+  void print_piece(Symbol symbol) { print_piece(symbol.str()); }
+  void print_piece(Quoted quoted) {
+    fmt::format_to(std::back_inserter(out), "{:?}", quoted.text);
+  }
+  void print_piece(int value) {
+    fmt::format_int text(value);
+    out.append(text.data(), text.data() + text.size());
+  }
+  void print_piece(Indent indent);
+  template <typename Node> void print_piece(const Node *node) {
+    if constexpr (std::is_same_v<Node, Parameter>)
+      node->print(*this);
+    else
+      std::visit([this](const auto &alternative) { alternative.print(*this); },
+                 *node);
+  }
 
-  void increase_indent() { current_indent += indent_step; };
-  void decrease_indent() { current_indent -= indent_step; };
-
-
-
+  fmt::memory_buffer own;
+  fmt::memory_buffer &out;
   int current_indent = 0;
   int indent_step = 2;
-};
\ No newline at end of file
+  // Spaces for the deepest indentation so far, printed by slicing
+  std::string spaces;
+  // Pieces still to print, the next one on top
+  std::vector<Piece> stack;
+  // Pieces written by the node being printed
+  std::vector<Piece> written;
+};
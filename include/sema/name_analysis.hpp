@@ -0,0 +1,65 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+#include "diagnostics/diagnostics.hpp"
+#include "parser/ast.hpp"
+#include "support/thread_pool.hpp"
+
+enum class DeclKind { FUNCTION, GLOBAL_VAR, PARAM, LOCAL, STRUCT };
+
+// What is known about a declaration; Names::decls is indexed by DeclId
+struct Decl {
+  DeclKind kind;
+  Symbol name;
+  SourceLoc loc;
+  // Type of a variable, return type of a function, null for a struct
+  const TypeNode *type;
+  // The global of a function, global variable or struct: its definition
+  // once one is seen, a declaration before that. Null otherwise. The
+  // definition also replaces the location and type of a declaration.
+  const GlobalNode *global;
+  // The function a parameter or local belongs to
+  DeclId function;
+};
+
+// Where and why name analysis failed
+struct NameError {
+  SourceLoc loc;
+  std::string message;
+};
+
+struct Names {
+  // The globals first, then the parameters and locals of each function in
+  // program order
+  std::vector<Decl> decls;
+  // The parameters and locals of the function defined by global i are
+  // [locals[i], locals[i + 1]); other globals have none. locals[0] is the
+  // number of global declarations.
+  std::vector<DeclId> locals;
+  // The first error in source order, every error is also in the diagnostics
+  std::optional<NameError> error;
+
+  bool ok() const { return !error; }
+};
+
+// Binds every name in `prog` to its declaration, writing the DeclId onto
+// the nodes that declare or use it. Names are visible from their
+// declaration to the end of the enclosing scope; a function's parameters
+// and its outermost block share a scope. Structs have a namespace of their
+// own. A global may be declared again, with extern, as long as it is
+// defined once.
+//
+// Runs in two phases. The first declares the globals in order and resolves
+// all but the function bodies. The second resolves the bodies, which only
+// read the global scope, on `pool`; each body sees the globals declared
+// before it, as it would in one pass. Names, DeclIds and diagnostics do not
+// depend on the number of threads.
+//
+// Walks the tree with an explicit stack, so any depth of nesting is fine.
+Names resolve_names(Prog &prog, Diagnostics &diag, ThreadPool &pool);
+// On the calling thread alone
+Names resolve_names(Prog &prog, Diagnostics &diag);
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "interner/interner.hpp"
+#include "parser/ast.hpp"
+#include "sema/type_context.hpp"
+
+// Size, alignment and field offsets of a struct, in bytes
+struct StructLayout {
+  std::uint32_t size = 0;
+  std::uint32_t align = 1;
+  // Size with the fields in declaration order; `size` is smaller only when
+  // the fields are packed
+  std::uint32_t declared_size = 0;
+  // Size with the fields packed, whether or not they are
+  std::uint32_t packed_size = 0;
+  bool complete = false;
+};
+
+// Lays out every struct once, when the type checker meets it, and keeps the
+// result for member access and code generation. Fields are looked up by
+// name in one hash table for all structs.
+//
+// Types have their x86-64 sizes: char is 1 byte, int 4 and a pointer 8, each
+// aligned to its size. A struct is aligned to its most aligned field and
+// padded to a multiple of that. With `pack`, fields are placed from the most
+// to the least aligned instead of in declaration order. Every size is then a
+// multiple of the alignment after it, so only the tail is padded.
+class StructLayouts {
+public:
+  explicit StructLayouts(bool pack = false) : pack(pack) {}
+
+  // Lays out the struct `decl` with fields `fields` of types `types`.
+  // Structs held by value must be laid out before; an incomplete one takes
+  // no space.
+  void add(DeclId decl, std::span<const Parameter> fields,
+           std::span<const TypeId> types, const TypeContext &context);
+
+  // Default, incomplete, for a struct not laid out
+  const StructLayout &layout(DeclId decl) const {
+    return decl < layouts.size() ? layouts[decl] : missing;
+  }
+  // Index of the field called `name` in declaration order. The first field
+  // wins if the name is repeated.
+  std::optional<std::uint32_t> field(DeclId decl, Symbol name) const;
+  // Offset of field `index`, in declaration order
+  std::uint32_t offset(DeclId decl, std::uint32_t index) const {
+    return offsets[first_offset[decl] + index];
+  }
+  // Place of field `index` in the order the fields are laid out
+  std::uint32_t position(DeclId decl, std::uint32_t index) const {
+    return positions[first_offset[decl] + index];
+  }
+
+  std::uint32_t size_of(TypeId type, const TypeContext &context) const;
+  std::uint32_t align_of(TypeId type, const TypeContext &context) const;
+
+private:
+  static std::uint64_t key(DeclId decl, Symbol name) {
+    return std::uint64_t{decl} << 32 | name.id;
+  }
+
+  static constexpr StructLayout missing{};
+
+  bool pack;
+  std::vector<StructLayout> layouts;
+  // Offsets and positions of the fields of every struct, those of `decl`
+  // from first_offset[decl]
+  std::vector<std::uint32_t> offsets;
+  std::vector<std::uint32_t> positions;
+  std::vector<std::uint32_t> first_offset;
+  // Struct and field name to field index
+  std::unordered_map<std::uint64_t, std::uint32_t> fields;
+};
+
+// A line for every struct of `prog`: its size in declaration order and
+// packed, and how many bytes packing saves
+void print_layout_report(const Prog &prog, const StructLayouts &layouts,
+                         fmt::memory_buffer &out);
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "interner/interner.hpp"
+
+// Binds names to values in nested scopes. A single open-addressing table
+// holds the innermost binding of every name seen so far; declaring logs the
+// binding it hides, and leaving a scope pops the log back to where the
+// scope began. No table is built or destroyed per scope, and leaving one
+// costs one step per name it declared.
+class SymbolTable {
+public:
+  using Value = std::uint32_t;
+  // Lookup of a name that is not bound
+  static constexpr Value none = UINT32_MAX;
+
+  SymbolTable();
+
+  void enter_scope() { scope_starts.push_back(undo.size()); }
+  void exit_scope();
+  // 0 outside of any scope
+  std::size_t depth() const { return scope_starts.size(); }
+
+  // Binds `name` in the innermost scope, hiding any outer binding. Fails,
+  // changing nothing, when that scope already binds it.
+  bool declare(Symbol name, Value value);
+  Value lookup(Symbol name) const { return slots[find(name)].value; }
+
+private:
+  static constexpr std::uint32_t empty = UINT32_MAX;
+  struct Slot {
+    std::uint32_t key = empty;
+    Value value = none;
+    // Scope depth of the binding
+    std::uint32_t depth = 0;
+  };
+  // A binding hidden by a declaration, restored when its scope ends
+  struct Undo {
+    Symbol name;
+    Value value;
+    std::uint32_t depth;
+  };
+
+  // The slot of `name`, or the empty slot where it would go
+  std::size_t find(Symbol name) const;
+  void grow();
+
+  // A name keeps its slot once seen, unbound slots just hold `none`, so
+  // nothing is ever removed and probing needs no tombstones
+  std::vector<Slot> slots;
+  std::size_t used = 0;
+  int shift;
+  std::vector<Undo> undo;
+  std::vector<std::size_t> scope_starts;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+#include "diagnostics/diagnostics.hpp"
+#include "parser/ast.hpp"
+#include "sema/name_analysis.hpp"
+#include "sema/struct_layout.hpp"
+#include "sema/type_context.hpp"
+#include "support/thread_pool.hpp"
+
+// Where and why type checking failed
+struct TypeError {
+  SourceLoc loc;
+  std::string message;
+};
+
+struct Types {
+  TypeContext context;
+  // Type of every declaration, indexed by DeclId: the declared type of a
+  // variable, the return type of a function, the struct type of a struct
+  std::vector<TypeId> decls;
+  // Of every struct, packed if check_types() is asked to
+  StructLayouts layouts;
+  // The error at the lowest location; every error is also in the
+  // diagnostics
+  std::optional<TypeError> error;
+
+  bool ok() const { return !error; }
+};
+
+// Checks the types of `prog`, whose names are resolved into `names`, and
+// writes the type of every expression onto it. Integers (int and char) mix
+// freely, the literal 0 converts to any pointer, and other types only match
+// themselves.
+//
+// The globals are checked first, then the function bodies on `pool`; the
+// error and the diagnostics are the same on any number of threads. Each
+// node is visited once and types compare as TypeIds, so checking is linear
+// in the size of the tree. The walk uses an explicit stack.
+//
+// Structs are laid out as they are checked, with their fields reordered to
+// minimize padding if `pack_structs`.
+Types check_types(Prog &prog, const Names &names, Diagnostics &diag,
+                  ThreadPool &pool, bool pack_structs = false);
+// On the calling thread alone
+Types check_types(Prog &prog, const Names &names, Diagnostics &diag);
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "interner/interner.hpp"
+#include "parser/ast.hpp"
+
+enum class TypeClass : std::uint8_t { VOID, INT, CHAR, STRUCT, POINTER, ERROR };
+
+// Interns types: each distinct type is made once and named by its TypeId,
+// so comparing two types is comparing two integers, however deep their
+// pointers go. A struct type is hash-consed on its struct's DeclId; a type
+// links to the pointer to it once that is made.
+//
+// The error type stands for an expression already reported as ill-typed.
+// Checks accept it anywhere, so one mistake is reported once.
+//
+// Function bodies are checked on several threads at once, so types may be
+// made and read concurrently. Types never move once made, and reading one
+// takes no lock; making one takes a lock only the first time.
+class TypeContext {
+public:
+  static constexpr TypeId void_type = 0;
+  static constexpr TypeId int_type = 1;
+  static constexpr TypeId char_type = 2;
+  static constexpr TypeId error_type = 3;
+
+  TypeContext();
+
+  // The error type points to nothing: a pointer to it is the error type
+  TypeId pointer_to(TypeId pointee);
+  TypeId struct_type(DeclId decl, Symbol name);
+  // The type written as `node`, whose struct names are resolved
+  TypeId of(const TypeNode &node);
+
+  TypeClass kind(TypeId type) const { return at(type).kind; }
+  // What a pointer points to
+  TypeId pointee(TypeId type) const { return at(type).operand; }
+  // The declaration of a struct
+  DeclId struct_decl(TypeId type) const { return at(type).operand; }
+  bool is_integer(TypeId type) const {
+    return type == int_type || type == char_type;
+  }
+  // Integers and pointers, which conditions test against zero
+  bool is_scalar(TypeId type) const {
+    return is_integer(type) || kind(type) == TypeClass::POINTER;
+  }
+
+  // As written in Cigrid, e.g. "Tree*"
+  std::string to_string(TypeId type) const;
+  std::size_t size() const {
+    return state->count.load(std::memory_order_acquire);
+  }
+
+private:
+  struct Type {
+    TypeClass kind;
+    std::uint32_t operand;
+    // Of a struct
+    Symbol name;
+    // The pointer to this type, once made
+    std::atomic<TypeId> pointer{no_type};
+  };
+
+  // Types are kept in chunks doubling in size, so a TypeId finds its type
+  // in two steps and the chunks never move. Chunk k holds 2^(k + 6) types.
+  static constexpr int first_chunk_bits = 6;
+  static constexpr int chunk_count = 33 - first_chunk_bits;
+  struct State {
+    std::array<std::unique_ptr<Type[]>, chunk_count> chunks;
+    std::atomic<std::uint32_t> count{0};
+    // Taken to make a type, and to look up `structs`
+    std::shared_mutex mutex;
+    std::unordered_map<DeclId, TypeId> structs;
+  };
+
+  const Type &at(TypeId type) const {
+    auto index = std::uint64_t{type} + (1u << first_chunk_bits);
+    auto bits = std::bit_width(index) - 1;
+    return state->chunks[bits - first_chunk_bits]
+                        [index - (std::uint64_t{1} << bits)];
+  }
+  Type &at(TypeId type) {
+    return const_cast<Type &>(std::as_const(*this).at(type));
+  }
+  // Appends a type; the mutex is held
+  TypeId add(TypeClass kind, std::uint32_t operand, Symbol name);
+
+  std::unique_ptr<State> state;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Owns the bytes of one input for the whole compilation. Regular files are
+// mapped read-only, anything else (pipes, ttys, std::istream) is read in bulk
+// once. Lexer and Parser only hold views into it, so the buffer must outlive
+// both of them.
+class SourceBuffer {
+public:
+  static std::optional<SourceBuffer> from_file(const std::string &filename);
+  static SourceBuffer from_stream(std::istream &stream,
+                                  std::string name = "<stream>");
+  static SourceBuffer from_string(std::string_view text,
+                                  std::string name = "<string>");
+
+  SourceBuffer(SourceBuffer &&other) noexcept;
+  SourceBuffer &operator=(SourceBuffer &&other) noexcept;
+  SourceBuffer(const SourceBuffer &) = delete;
+  SourceBuffer &operator=(const SourceBuffer &) = delete;
+  ~SourceBuffer();
+
+  std::string_view view() const { return {data, length}; }
+  const char *begin() const { return data; }
+  const char *end() const { return data + length; }
+  std::size_t size() const { return length; }
+  const std::string &name() const { return filename; }
+  bool is_mapped() const { return mapped; }
+
+private:
+  SourceBuffer() = default;
+  void release();
+
+  std::string filename;
+  const char *data = "";
+  std::size_t length = 0;
+  bool mapped = false;
+  // Backing storage when the input could not be mapped
+  std::unique_ptr<char[]> owned;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common.hpp"
+#include "source_buffer.hpp"
+
+using FileId = std::uint32_t;
+
+// Owns every input of a compilation and maps SourceLoc to file, line and
+// column. Each file occupies [base, base + size] of the location space, the
+// extra offset being its end of file. The line table of a file is built on
+// the first position() query, so the lexer never looks at newlines itself.
+//
+// A streamed file has no buffer here: its bytes pass through append() once,
+// which extends its line table as they arrive. No other file may be added
+// while a stream is still growing.
+class SourceManager {
+public:
+  SourceManager() = default;
+  SourceManager(const SourceManager &) = delete;
+  SourceManager &operator=(const SourceManager &) = delete;
+
+  FileId add_file(SourceBuffer buffer);
+  FileId add_stream(std::string name);
+  // Records the next bytes of a streamed file
+  void append(FileId file, std::string_view bytes);
+  std::size_t file_count() const { return files.size(); }
+  // Location space taken by the files so far; the next one starts here
+  std::uint32_t end_offset() const { return next_base; }
+  // Drops every file, after which no earlier location may be used
+  void clear();
+
+  // Empty for a streamed file
+  const SourceBuffer &buffer(FileId file) const { return files[file]->buffer; }
+  SourceLoc loc(FileId file, std::uint32_t offset) const {
+    return SourceLoc{files[file]->base + offset};
+  }
+
+  FileId file_of(SourceLoc loc) const;
+  std::string_view name(SourceLoc loc) const;
+  // Safe to call from several threads
+  Position position(SourceLoc loc) const;
+
+private:
+  struct File {
+    explicit File(SourceBuffer buffer, std::uint32_t base)
+        : buffer(std::move(buffer)), base(base) {}
+
+    SourceBuffer buffer;
+    std::uint32_t base;
+    // Bytes appended so far, for a streamed file
+    std::uint32_t streamed = 0;
+    mutable std::once_flag lines_built;
+    // Offsets where each line begins, relative to the file
+    mutable std::vector<std::uint32_t> line_starts;
+  };
+
+  void build_lines(const File &file) const;
+
+  // unique_ptr keeps File (and its once_flag) in place when the vector grows
+  std::vector<std::unique_ptr<File>> files;
+  std::uint32_t next_base = 0;
+};
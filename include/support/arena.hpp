@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+// Bump-pointer allocator. Memory comes from a list of chunks that grow
+// geometrically and are released all at once when the arena dies; nothing
+// placed in it is ever destroyed, so only trivially destructible types may
+// live here.
+class Arena {
+public:
+  explicit Arena(std::size_t first_chunk = 64 * 1024);
+  ~Arena();
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *allocate(std::size_t size, std::size_t align) {
+    auto address = (reinterpret_cast<std::uintptr_t>(cursor) + align - 1) &
+                   ~(std::uintptr_t{align} - 1);
+    if (address + size > reinterpret_cast<std::uintptr_t>(limit))
+      return allocate_slow(size, align);
+    cursor = reinterpret_cast<char *>(address + size);
+    return reinterpret_cast<char *>(address);
+  }
+
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "arena objects are never destroyed");
+    return new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  // Copies `items` into the arena, e.g. to freeze a list built on the side
+  template <typename T> std::span<T> copy(std::span<const T> items) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (items.empty())
+      return {};
+    auto *first = static_cast<T *>(allocate(items.size_bytes(), alignof(T)));
+    std::uninitialized_copy(items.begin(), items.end(), first);
+    return {first, items.size()};
+  }
+
+  // Takes over the chunks of `other`, leaving it empty, so that everything
+  // placed in it lives as long as this arena does
+  void adopt(Arena &other);
+
+  // Bytes handed out so far, alignment padding included
+  std::size_t bytes_used() const { return used + (cursor - chunk_start); }
+  std::size_t chunk_count() const { return chunks; }
+
+private:
+  struct Chunk {
+    Chunk *next;
+  };
+
+  void *allocate_slow(std::size_t size, std::size_t align);
+
+  Chunk *head = nullptr;
+  char *chunk_start = nullptr;
+  char *cursor = nullptr;
+  char *limit = nullptr;
+  std::size_t next_chunk;
+  std::size_t used = 0;
+  std::size_t chunks = 0;
+};
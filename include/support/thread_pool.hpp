@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops. The thread calling
+// parallel_for() works too, so a pool of size 1 has no workers at all and
+// runs everything inline.
+class ThreadPool {
+public:
+  // 0 picks the number of hardware threads
+  explicit ThreadPool(unsigned threads = 0);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  unsigned size() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+  // Runs body(i) for every i in [0, count) and returns when all are done.
+  // Indices are handed out one at a time, so uneven tasks balance out.
+  // Not reentrant: body must not call parallel_for on the same pool.
+  void parallel_for(std::size_t count,
+                    const std::function<void(std::size_t)> &body);
+
+private:
+  void worker_loop();
+  void run_tasks();
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  // Current job, published under the mutex by bumping generation
+  const std::function<void(std::size_t)> *job = nullptr;
+  std::size_t job_count = 0;
+  std::atomic<std::size_t> next_index{0};
+  std::uint64_t generation = 0;
+  unsigned busy_workers = 0;
+  bool stopping = false;
+};
@@ -0,0 +1,5 @@
+#!/bin/bash
+# 参数：输入文件在内存中重复的次数
+REPEAT=${1:-2000}
+
+../build/lexer_bench ../tests/test.cpp "$REPEAT"
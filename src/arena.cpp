@@ -0,0 +1,61 @@
+#include "support/arena.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+// Chunks stop doubling here, so a huge arena wastes at most this much
+constexpr std::size_t max_chunk = 4 * 1024 * 1024;
+} // namespace
+
+Arena::Arena(std::size_t first_chunk)
+    : next_chunk(std::max(first_chunk, sizeof(Chunk))) {}
+
+Arena::~Arena() {
+  while (head) {
+    auto *next = head->next;
+    ::operator delete(head);
+    head = next;
+  }
+}
+
+void *Arena::allocate_slow(std::size_t size, std::size_t align) {
+  // Oversized requests get a chunk of their own
+  auto bytes = std::max(next_chunk, sizeof(Chunk) + size + align);
+  next_chunk = std::min(next_chunk * 2, max_chunk);
+
+  auto *chunk = static_cast<Chunk *>(::operator new(bytes));
+  chunk->next = head;
+  head = chunk;
+  ++chunks;
+  used += cursor - chunk_start;
+  chunk_start = reinterpret_cast<char *>(chunk + 1);
+  cursor = chunk_start;
+  limit = reinterpret_cast<char *>(chunk) + bytes;
+  return allocate(size, align);
+}
+
+void Arena::adopt(Arena &other) {
+  if (!other.head)
+    return;
+  auto *tail = other.head;
+  while (tail->next)
+    tail = tail->next;
+  if (head) {
+    // Keep allocating from the current chunk; the adopted ones go behind it
+    tail->next = head->next;
+    head->next = other.head;
+    used += other.bytes_used();
+  } else {
+    head = other.head;
+    chunk_start = other.chunk_start;
+    cursor = other.cursor;
+    limit = other.limit;
+    used = other.used;
+  }
+  chunks += other.chunks;
+  other.head = nullptr;
+  other.chunk_start = other.cursor = other.limit = nullptr;
+  other.used = 0;
+  other.chunks = 0;
+}
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cstdio>
 #include <string>
 #include <variant>  
 #include <vector>
@@ -7,7 +9,17 @@
 #include "parser/ast.hpp"
 #include "printer/ast_printer.hpp"
 
-ASTPrinter::ASTPrinter() : current_indent(0), indent_step(2) {}
+namespace {
+// The printer's own buffer goes to stdout once it holds this much
+constexpr std::size_t flush_size = 1 << 20;
+// Globals printed by one task of print_parallel()
+constexpr std::size_t globals_per_run = 64;
+} // namespace
+
+ASTPrinter::ASTPrinter(fmt::memory_buffer &out)
+    : out(out), current_indent(0), indent_step(2) {}
+
+ASTPrinter::ASTPrinter() : ASTPrinter(own) {}
 
 // auto ASTPrinter::print(const Prog &prog) -> void {
 //   for (const auto &global : prog.globals) {
@@ -15,385 +27,347 @@ ASTPrinter::ASTPrinter() : current_indent(0), indent_step(2) {}
 //   }
 // } 
 
-auto ASTPrinter::print_type(const TypeNode &type) -> void {
-  std::visit([this](auto &node) {
-      node.print(*this);
-    }, type);
-}
+namespace {
 
-auto ASTPrinter::print_expr(const ExprNode &expr) -> void {
-  std::visit([this](auto &node) {
-      node.print(*this);
-    }, expr);
+// TODO: to be furthre simplified using map
+std::string_view bop_text(Bop op) {
+  switch (op) {
+    case Bop::PLUS:
+      return "+";
+    case Bop::MINUS:
+      return "-";
+    case Bop::MULTIPLY:
+      return "*";
+    case Bop::DIVIDE:
+      return "/";
+    case Bop::MODULUS:
+      return "%";
+    case Bop::LESS_THAN:
+      return "<";
+    case Bop::LARGER_THAN:
+      return ">";
+    case Bop::LESS_EQUAL:
+      return "<=";
+    case Bop::LARGER_EQUAL:
+      return ">=";
+    case Bop::EQUAL:
+      return "==";
+    case Bop::NOT_EQUAL:
+      return "!=";
+    case Bop::BITWISE_AND:
+      return "&";
+    case Bop::BITWISE_OR:
+      return "|";
+    case Bop::LOGICAL_AND:
+      return "&&";
+    case Bop::LOGICAL_OR:
+      return "||";
+    case Bop::SHIFT_LEFT:
+      return "<<";
+    case Bop::SHIFT_RIGHT:
+      return ">>";
+  }
+  return "";
 }
 
-auto ASTPrinter::print_stmt(const StmtNode &stmt) -> void {
-  std::visit([this](auto &node) {
-      node.print(*this);
-    }, stmt);
+std::string_view uop_text(Uop op) {
+  switch (op) {
+    case Uop::NEG:
+      return "-";
+    case Uop::NOT:
+      return "!";
+    case Uop::BITWISE_NOT:
+      return "~";
+  }
+  return "";
 }
 
-auto ASTPrinter::print_params(const std::vector<Parameter> &params) -> void {
-  fmt::print("{{");
+void write_params(ASTPrinter &p, std::span<const Parameter> params) {
+  p.write({"{"});
   for (const auto &param : params) {
-    param.print(*this);
+    p.write({&param});
   }
-  fmt::print("}}");
+  p.write({"}"});
 }
 
+} // namespace
+
+auto ASTPrinter::print_type(const TypeNode &type) -> void { walk(&type); }
+
+auto ASTPrinter::print_expr(const ExprNode &expr) -> void { walk(&expr); }
+
+auto ASTPrinter::print_stmt(const StmtNode &stmt) -> void { walk(&stmt); }
+
 auto ASTPrinter::print_global(const GlobalNode &global) -> void {
-  std::visit([this](auto &node) {
-      node.print(*this);
-    }, global);
-  fmt::print("\n\n");
+  walk(&global);
+  print_piece(std::string_view("\n\n"));
+  if (&out == &own && out.size() >= flush_size)
+    flush();
+}
+
+auto ASTPrinter::print_parallel(const Prog &prog, ThreadPool &pool) -> void {
+  // Runs are printed a wave at a time, so only one wave of output is held
+  // in the buffers
+  std::vector<fmt::memory_buffer> buffers(pool.size() * 4);
+  auto wave_size = buffers.size() * globals_per_run;
+  for (std::size_t first = 0; first < prog.globals.size(); first += wave_size) {
+    auto wave = prog.globals.subspan(
+        first, std::min(wave_size, prog.globals.size() - first));
+    auto runs = (wave.size() + globals_per_run - 1) / globals_per_run;
+    pool.parallel_for(runs, [&](std::size_t i) {
+      auto run = wave.subspan(i * globals_per_run);
+      buffers[i].clear();
+      ASTPrinter printer(buffers[i]);
+      for (auto *global : run.first(std::min(globals_per_run, run.size())))
+        printer.print_global(*global);
+    });
+    for (std::size_t i = 0; i < runs; ++i) {
+      out.append(buffers[i].data(), buffers[i].data() + buffers[i].size());
+      if (&out == &own && out.size() >= flush_size)
+        flush();
+    }
+  }
+}
+
+auto ASTPrinter::flush() -> void {
+  if (&out != &own)
+    return;
+  std::fwrite(out.data(), 1, out.size(), stdout);
+  out.clear();
+}
+
+auto ASTPrinter::walk(Piece root) -> void {
+  stack.push_back(root);
+  while (!stack.empty()) {
+    auto piece = stack.back();
+    stack.pop_back();
+    std::visit([this](auto piece) { print_piece(piece); }, piece);
+    // What a node wrote comes next, its first piece on top
+    stack.insert(stack.end(), written.rbegin(), written.rend());
+    written.clear();
+  }
+}
+
+auto ASTPrinter::print_piece(Indent indent) -> void {
+  switch (indent) {
+  case Indent::HERE:
+    print_piece(std::string_view(spaces).substr(0, current_indent));
+    break;
+  case Indent::IN:
+    current_indent += indent_step;
+    if (spaces.size() < static_cast<std::size_t>(current_indent))
+      spaces.resize(2 * current_indent, ' ');
+    break;
+  case Indent::OUT:
+    current_indent -= indent_step;
+    break;
+  }
 }
 
 auto TVoid::print(ASTPrinter &p) const -> void {
-  fmt::print("TVoid");
+  p.write({"TVoid"});
 }
 
 auto TInt::print(ASTPrinter &p) const -> void {
-  fmt::print("TInt");
+  p.write({"TInt"});
 }
 
 auto TChar::print(ASTPrinter &p) const -> void {
-  fmt::print("TChar");
+  p.write({"TChar"});
 }
 
 auto TIdent::print(ASTPrinter &p) const -> void {
-  fmt::print("TIdent(\"{}\")", name);
+  p.write({"TIdent(\"", name, "\")"});
 }
 
 auto TPoint::print(ASTPrinter &p) const -> void {
-  fmt::print("TPoint(");
-  p.print_type(*point_type);
-  fmt::print(")");
+  p.write({"TPoint(", point_type, ")"});
 }
 
 auto EVar::print(ASTPrinter &p) const -> void {
-  fmt::print("EVar(\"{}\")", name);
+  p.write({"EVar(\"", name, "\")"});
 }
 
 auto EInt::print(ASTPrinter &p) const -> void {
-  fmt::print("EInt({})", value);
+  p.write({"EInt(", value, ")"});
 }
 
 auto EChar::print(ASTPrinter &p) const -> void {
-  fmt::print("EChar(");
+  p.write({"EChar("});
   // TODO: to be furthre simplified using map
   switch (value) {
     case '\\':
-      fmt::print("'\\\\'");
+      p.write({"'\\\\'"});
       break;
     case '\n':
-      fmt::print("'\\n'");
+      p.write({"'\\n'"});
       break;
     case '\t':
-      fmt::print("'\\t'");
+      p.write({"'\\t'"});
       break;
     case '\'':
-      fmt::print("'\\''");
+      p.write({"'\\''"});
       break;
     case '\"':
-      fmt::print("'\\\"'");
+      p.write({"'\\\"'"});
       break;
     default:
-      fmt::print("'{}'", value);
+      // The character itself, which stays in the node while it prints
+      p.write({"'", std::string_view(&value, 1), "'"});
       break;
   }
 }
 
 auto EString::print(ASTPrinter &p) const -> void {
-  // The question mark quoted the string with special characters escaped
-  fmt::print("EString({:?})", value);
+  // Quoted prints the string with special characters escaped
+  p.write({"EString(", ASTPrinter::Quoted{value}, ")"});
 }
 
 auto EBinOp::print(ASTPrinter &p) const -> void {
-  fmt::print("EBinOp(");
-  // TODO: to be furthre simplified using map
-  switch (op) {
-    case Bop::PLUS:
-      fmt::print("+");
-      break;
-    case Bop::MINUS:
-      fmt::print("-");
-      break;
-    case Bop::MULTIPLY:
-      fmt::print("*");
-      break;
-    case Bop::DIVIDE:
-      fmt::print("/");
-      break;
-    case Bop::MODULUS:
-      fmt::print("%");
-      break;
-    case Bop::LESS_THAN:
-      fmt::print("<");
-      break;
-    case Bop::LARGER_THAN:
-      fmt::print(">");
-      break;
-    case Bop::LESS_EQUAL:
-      fmt::print("<=");
-      break;
-    case Bop::LARGER_EQUAL:
-      fmt::print(">=");
-      break;
-    case Bop::EQUAL:
-      fmt::print("==");
-      break;
-    case Bop::NOT_EQUAL:
-      fmt::print("!=");
-      break;
-    case Bop::BITWISE_AND:
-      fmt::print("&");
-      break;
-    case Bop::BITWISE_OR:
-      fmt::print("|");
-      break;
-    case Bop::LOGICAL_AND:
-      fmt::print("&&");
-      break;
-    case Bop::LOGICAL_OR:
-      fmt::print("||");
-      break;
-    case Bop::SHIFT_LEFT:
-      fmt::print("<<");
-      break;
-    case Bop::SHIFT_RIGHT:
-      fmt::print(">>");
-      break;
-  }
-  fmt::print(", ");
-  p.print_expr(*lhs);
-  fmt::print(", ");
-  p.print_expr(*rhs);
-  fmt::print(")");
+  p.write({"EBinOp(", bop_text(op), ", ", lhs, ", ", rhs, ")"});
 }
 
 auto EUnOp::print(ASTPrinter &p) const -> void {
-  fmt::print("EUnOp(");
-  switch (op) {
-    case Uop::NEG:
-      fmt::print("-");
-      break;
-    case Uop::NOT:
-      fmt::print("!");
-      break;
-    case Uop::BITWISE_NOT:
-      fmt::print("~");
-      break;
-  }
-  fmt::print(", ");
-  p.print_expr(*rhs);
-  fmt::print(")");
+  p.write({"EUnOp(", uop_text(op), ", ", rhs, ")"});
 }
 
 auto ECall::print(ASTPrinter &p) const -> void {
-  fmt::print("ECall(");
-  fmt::print("\"{}\", ", name);
-  fmt::print("{{");
+  p.write({"ECall(\"", name, "\", {"});
   for (const auto &arg : args) {
-    p.print_expr(*arg);
+    p.write({arg});
   }
-  fmt::print("}}");
-  fmt::print(")");
+  p.write({"})"});
 }
 
 auto ENew::print(ASTPrinter &p) const -> void {
-  fmt::print("ENew(");
-  p.print_type(*type);
-  fmt::print(", ");
-  p.print_expr(*expr);
-  fmt::print(")");
+  p.write({"ENew(", type, ", ", expr, ")"});
 }
 
 auto EArrayAccess::print(ASTPrinter &p) const -> void {
-  fmt::print("EArrayAccess(");
-  fmt::print("\"{}\", ", name);
-  p.print_expr(*index);
+  p.write({"EArrayAccess(\"", name, "\", ", index});
   if (label) {
-    fmt::print(", \"{}\"", *label);
+    p.write({", \"", *label, "\""});
   }
-  fmt::print(")");
+  p.write({")"});
 }
 
 auto SExpr::print(ASTPrinter &p) const -> void {
-  p.print_indent();
-  fmt::print("SExpr(");
-  p.print_expr(*expr);
-  fmt::print(")");
+  p.write({ASTPrinter::Indent::HERE, "SExpr(", expr, ")"});
 }
 
 auto SVarDef::print(ASTPrinter &p) const -> void {
-  p.print_indent();
-  fmt::print("SVarDef(");
-  p.print_type(*type);
-  fmt::print(", \"{}\", ", name);
-  p.print_expr(*value);
-  fmt::print(")");
+  p.write({ASTPrinter::Indent::HERE, "SVarDef(", type, ", \"", name, "\", ",
+           value, ")"});
 }
 
 auto SVarAssign::print(ASTPrinter &p) const -> void {
-  p.print_indent();
-  fmt::print("SVarAssign(");
-  fmt::print("\"{}\", ", name);
-  p.print_expr(*value);
-  fmt::print(")");
+  p.write({ASTPrinter::Indent::HERE, "SVarAssign(\"", name, "\", ", value,
+           ")"});
 }
 
 auto SArrayAssign::print(ASTPrinter &p) const -> void {
-  p.print_indent();
-  fmt::print("SArrayAssign(");
-  fmt::print("\"{}\", ", name);
-  p.print_expr(*index);
-  fmt::print(", ");
+  p.write({ASTPrinter::Indent::HERE, "SArrayAssign(\"", name, "\", ", index,
+           ", "});
   if (label) {
-    fmt::print("\"{}\", ", *label);
+    p.write({"\"", *label, "\", "});
   }
-  p.print_expr(*value);
-  fmt::print(")");
+  p.write({value, ")"});
 }
 
 auto SArrayPlusAssign::print(ASTPrinter &p) const -> void {
-  p.print_indent();
-  fmt::print("SArrayAssign(");
-  fmt::print("\"{}\", ", name);
-  p.print_expr(*index);
-  fmt::print(", ");
+  p.write({ASTPrinter::Indent::HERE, "SArrayAssign(\"", name, "\", ", index,
+           ", "});
   if (label) {
-    fmt::print("\"{}\", ", *label);
+    p.write({"\"", *label, "\", "});
   }
   // The expression here will be EInt(1). Here we need to print it with EBinOp and EAarryAccess
-  fmt::print("EBinOp(+, EArrayAccess(\"{}\", ", name);
-  p.print_expr(*index);  
-  fmt::print(", EInt(1))");
-  fmt::print(")");
+  p.write({"EBinOp(+, EArrayAccess(\"", name, "\", ", index, ", EInt(1))",
+           ")"});
 }
 
 auto SArrayMinusAssign::print(ASTPrinter &p) const -> void {
-  p.print_indent();
-  fmt::print("SArrayAssign(");
-  fmt::print("\"{}\", ", name);
-  p.print_expr(*index);
-  fmt::print(", ");
+  p.write({ASTPrinter::Indent::HERE, "SArrayAssign(\"", name, "\", ", index,
+           ", "});
   if (label) {
-    fmt::print("\"{}\", ", *label);
+    p.write({"\"", *label, "\", "});
   }
   // The expression here will be EInt(1). Here we need to print it with EBinOp and EAarryAccess
-  fmt::print("EBinOp(-, EArrayAccess(\"{}\", ", name);
-  p.print_expr(*index);  
-  fmt::print(", EInt(1))");
-  fmt::print(")");
+  p.write({"EBinOp(-, EArrayAccess(\"", name, "\", ", index, ", EInt(1))",
+           ")"});
 }
 
 auto SScope::print(ASTPrinter &p) const -> void {
-  p.print_indent();
-  fmt::print("SScope({{");
-  {
-    ASTPrinter::Indent indent(p);
-    for (const auto &stmt : stmts) {
-      fmt::print("\n");
-      p.print_stmt(*stmt);
-    }
+  p.write({ASTPrinter::Indent::HERE, "SScope({", ASTPrinter::Indent::IN});
+  for (const auto &stmt : stmts) {
+    p.write({"\n", stmt});
   }
-  fmt::print("\n");
-  p.print_indent();
-  fmt::print("}})");
+  p.write({ASTPrinter::Indent::OUT, "\n", ASTPrinter::Indent::HERE, "})"});
 }
 
 auto SIf::print(ASTPrinter &p) const -> void {
-  p.print_indent();
-  fmt::print("SIf(");
-  p.print_expr(*cond);
-  fmt::print(", ");
-  p.print_stmt(*then_branch);
+  p.write({ASTPrinter::Indent::HERE, "SIf(", cond, ", ", then_branch});
   if (else_branch) {
-    fmt::print(", ");
-    p.print_stmt(*else_branch);
+    p.write({", ", else_branch});
   }
-  fmt::print(")");
+  p.write({")"});
 }
 
 auto SWhile::print(ASTPrinter &p) const -> void {
-  p.print_indent();
-  fmt::print("SWhile(");
-  p.print_expr(*cond);
-  fmt::print(", ");
-  p.print_stmt(*stmt);
-  fmt::print(")");
+  p.write({ASTPrinter::Indent::HERE, "SWhile(", cond, ", ", stmt, ")"});
 }
 
 auto SBreak::print(ASTPrinter &p) const -> void {
-  p.print_indent();
-  fmt::print("SBreak");
+  p.write({ASTPrinter::Indent::HERE, "SBreak"});
 }
 
 auto SReturn::print(ASTPrinter &p) const -> void {
-  p.print_indent();
-  fmt::print("SReturn(");
+  p.write({ASTPrinter::Indent::HERE, "SReturn("});
   if (expr) {
-    p.print_expr(*expr);
+    p.write({expr});
   }
-  fmt::print(")");
+  p.write({")"});
 }
 
 auto SDelete::print(ASTPrinter &p) const -> void {
-  p.print_indent();
-  fmt::print("SDelete({})", name);
+  p.write({ASTPrinter::Indent::HERE, "SDelete(", name, ")"});
 }
 
 auto Parameter::print(ASTPrinter &p) const -> void {
-  fmt::print("(");
-  p.print_type(*type);
-  fmt::print(", {})", name);
+  p.write({"(", type, ", ", name, ")"});
 }
 
 auto GFuncDef::print(ASTPrinter &p) const -> void {
-  p.print_list("GFuncDef", {
-    [&]{p.print_type(*return_type);},
-    [&]{fmt::print("{}", name);},
-    [&]{p.print_params(params);},
-    [&]{
-      fmt::print("\n");
-      ASTPrinter::Indent indent(p);
-      p.print_stmt(*stmt);
-     },
-  });
+  p.write({ASTPrinter::Indent::HERE, "GFuncDef(", return_type, ", ", name,
+           ", "});
+  write_params(p, params);
+  p.write({", \n", ASTPrinter::Indent::IN, stmt, ASTPrinter::Indent::OUT,
+           ")\n"});
 }
 
 auto GFuncDecl::print(ASTPrinter &p) const -> void {
-  p.print_list("GFuncDecl", {
-    [&]{p.print_type(*return_type);},
-    [&]{fmt::print("{}", name);},
-    [&]{p.print_params(params);},
-  });
+  p.write({ASTPrinter::Indent::HERE, "GFuncDecl(", return_type, ", ", name,
+           ", "});
+  write_params(p, params);
+  p.write({")\n"});
 }
 
 auto GVarDef::print(ASTPrinter &p) const -> void {
-  p.print_list("GVarDef", {
-    [&]{p.print_type(*type);},
-    [&]{fmt::print("{}", name);},
-    [&]{p.print_expr(*value);},
-  });
+  p.write({ASTPrinter::Indent::HERE, "GVarDef(", type, ", ", name, ", ",
+           value, ")\n"});
 }
 
 auto GVarDecl::print(ASTPrinter &p) const -> void {
-  p.print_list("GVarDecl", {
-    [&]{p.print_type(*type);},
-    [&]{fmt::print("{}", name);}
-  });
+  p.write({ASTPrinter::Indent::HERE, "GVarDecl(", type, ", ", name, ")\n"});
 }
 
 auto GStruct::print(ASTPrinter &p) const -> void {
-  p.print_list("GStruct", {
-    [&]{ fmt::print("{}", name); },
-    [&]{ p.print_params(fields); },
-  });
+  p.write({ASTPrinter::Indent::HERE, "GStruct(", name, ", "});
+  write_params(p, fields);
+  p.write({")\n"});
 }
 
 auto Prog::print(ASTPrinter &p) const -> void {
   for (const auto &global : globals) {
     p.print_global(*global);
   }
-}
\ No newline at end of file
+}
@@ -0,0 +1,124 @@
+#include "lexer/chunk_splitter.hpp"
+
+const char *ChunkSplitter::scan(const char *p, const char *end,
+                                const char *want) {
+  // Mirrors what the lexer skips over as a unit
+  while (p < end) {
+    switch (state) {
+    case State::NORMAL:
+      switch (*p++) {
+      case '\n':
+        if (p >= want)
+          return p;
+        break;
+      case '#':
+        state = State::LINE_COMMENT;
+        break;
+      case '/':
+        state = State::SLASH;
+        break;
+      case '"':
+        state = State::STRING;
+        break;
+      case '\'':
+        state = State::CHAR_FIRST;
+        break;
+      default:
+        break;
+      }
+      break;
+
+    case State::SLASH:
+      if (*p == '/') {
+        state = State::LINE_COMMENT;
+        ++p;
+      } else if (*p == '*') {
+        // The '*' of the opener may already close the comment: "/*/"
+        state = State::BLOCK_COMMENT_STAR;
+        ++p;
+      } else {
+        state = State::NORMAL;
+      }
+      break;
+
+    case State::LINE_COMMENT:
+      // The newline itself is left to NORMAL, it is a place to cut
+      p = scanner.find_newline(p, end);
+      if (p != end)
+        state = State::NORMAL;
+      break;
+
+    case State::BLOCK_COMMENT: {
+      const char *star = scanner.find_comment_end(p, end);
+      if (star != end) {
+        p = star + 2;
+        state = State::NORMAL;
+      } else {
+        // "*/" may straddle this piece and the next
+        if (end[-1] == '*')
+          state = State::BLOCK_COMMENT_STAR;
+        p = end;
+      }
+      break;
+    }
+
+    case State::BLOCK_COMMENT_STAR:
+      if (*p == '/') {
+        ++p;
+        state = State::NORMAL;
+      } else {
+        state = State::BLOCK_COMMENT;
+      }
+      break;
+
+    case State::STRING:
+      while (p < end) {
+        char c = *p++;
+        if (c == '"') {
+          state = State::NORMAL;
+          break;
+        }
+        if (c == '\n') {
+          state = State::STOPPED;
+          return nullptr;
+        }
+        // An escape consumes the next byte, whatever it is
+        if (c == '\\') {
+          if (p == end) {
+            state = State::STRING_ESCAPE;
+            break;
+          }
+          ++p;
+        }
+      }
+      break;
+
+    case State::STRING_ESCAPE:
+      ++p;
+      state = State::STRING;
+      break;
+
+    // One character, or a backslash and one character, then the quote
+    case State::CHAR_FIRST:
+      state = *p++ == '\\' ? State::CHAR_ESCAPE : State::CHAR_CLOSE;
+      break;
+
+    case State::CHAR_ESCAPE:
+      ++p;
+      state = State::CHAR_CLOSE;
+      break;
+
+    case State::CHAR_CLOSE:
+      if (*p++ != '\'') {
+        state = State::STOPPED;
+        return nullptr;
+      }
+      state = State::NORMAL;
+      break;
+
+    case State::STOPPED:
+      return nullptr;
+    }
+  }
+  return nullptr;
+}
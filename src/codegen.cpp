@@ -0,0 +1,719 @@
+#include "codegen/codegen.hpp"
+
+#include <optional>
+#include <span>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <fmt/format.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/CodeGen.h>
+#include <llvm/Support/ErrorHandling.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetOptions.h>
+
+namespace {
+
+// Work on the generator's stack besides nodes. Operands are generated
+// before the node using them, which finds their values on the value stack.
+struct ExprDone {
+  const ExprNode *expr;
+};
+// The left operand of && or || is generated; the right one only runs if
+// the left does not decide
+struct LogicalRhs {
+  const EBinOp *op;
+};
+struct LogicalDone {
+  const EBinOp *op;
+  llvm::BasicBlock *test;
+  llvm::BasicBlock *end;
+};
+struct StmtDone {
+  const StmtNode *stmt;
+};
+// The condition of an if is generated, then its then branch, then its else
+// branch
+struct IfCond {
+  const SIf *stmt;
+};
+struct IfElse {
+  const SIf *stmt;
+  llvm::BasicBlock *otherwise;
+  llvm::BasicBlock *end;
+};
+struct IfEnd {
+  llvm::BasicBlock *end;
+};
+// The condition of a loop is generated, then its body
+struct WhileCond {
+  const SWhile *stmt;
+  llvm::BasicBlock *cond;
+};
+struct WhileEnd {
+  llvm::BasicBlock *cond;
+  llvm::BasicBlock *end;
+};
+using Work =
+    std::variant<const ExprNode *, ExprDone, LogicalRhs, LogicalDone,
+                 const StmtNode *, StmtDone, IfCond, IfElse, IfEnd, WhileCond,
+                 WhileEnd, const GVarDef *>;
+
+llvm::StringRef text(Symbol symbol) {
+  auto view = symbol.str();
+  return {view.data(), view.size()};
+}
+
+std::span<const Parameter> params_of(const GlobalNode &global) {
+  if (const auto *func = std::get_if<GFuncDef>(&global))
+    return func->params;
+  if (const auto *func = std::get_if<GFuncDecl>(&global))
+    return func->params;
+  return std::get<GStruct>(global).fields;
+}
+
+class Generator {
+public:
+  Generator(const Names &names, Types &types, llvm::Module &module)
+      : names(names), types(types), context(types.context),
+        llvm_context(module.getContext()), module(module),
+        builder(llvm_context), storage(names.decls.size()),
+        structs(names.decls.size()) {
+    init = llvm::Function::Create(
+        llvm::FunctionType::get(builder.getVoidTy(), false),
+        llvm::Function::InternalLinkage, "__cigrid_init", module);
+    init_block = llvm::BasicBlock::Create(llvm_context, "entry", init);
+  }
+
+  // Struct types, functions and global variables, made before any body
+  // refers to them
+  void declare(const GlobalNode &global) {
+    std::visit([this](const auto &node) { declare_global(node); }, global);
+  }
+
+  // Function bodies and global initializers
+  void define(const GlobalNode &global) {
+    std::visit([this](const auto &node) { define_global(node); }, global);
+  }
+
+  // Has the module constructor run the initializers that did not fold to
+  // constants, or drops it if they all did
+  void finish() {
+    if (&init->getEntryBlock() == init_block && init_block->empty()) {
+      init->eraseFromParent();
+      return;
+    }
+    builder.SetInsertPoint(init_block);
+    builder.CreateRetVoid();
+    auto *ctor = llvm::StructType::get(builder.getInt32Ty(), init->getType(),
+                                       builder.getInt8PtrTy());
+    auto *ctors = llvm::ArrayType::get(ctor, 1);
+    new llvm::GlobalVariable(
+        module, ctors, false, llvm::GlobalValue::AppendingLinkage,
+        llvm::ConstantArray::get(
+            ctors, {llvm::ConstantStruct::get(
+                       ctor, {builder.getInt32(65535), init,
+                              llvm::ConstantPointerNull::get(
+                                  builder.getInt8PtrTy())})}),
+        "llvm.global_ctors");
+  }
+
+private:
+  void declare_global(const GFuncDef &func) { function(func.decl); }
+  void declare_global(const GFuncDecl &func) { function(func.decl); }
+  void declare_global(const GVarDef &var) { variable(var.decl); }
+  void declare_global(const GVarDecl &var) { variable(var.decl); }
+  // Structs held by value come before, so their bodies are set
+  void declare_global(const GStruct &record) {
+    auto *type = llvm::StructType::create(
+        llvm_context, fmt::format("struct.{}", record.name));
+    structs[record.decl] = type;
+    std::vector<llvm::Type *> fields(record.fields.size());
+    for (std::uint32_t i = 0; i < fields.size(); ++i)
+      fields[types.layouts.position(record.decl, i)] =
+          lower(context.of(*record.fields[i].type));
+    type->setBody(fields);
+  }
+
+  // The function of `decl`, made at its first declaration with the
+  // signature of its definition
+  llvm::Function *function(DeclId decl) {
+    if (storage[decl])
+      return llvm::cast<llvm::Function>(storage[decl]);
+    const auto &info = names.decls[decl];
+    std::vector<llvm::Type *> params;
+    for (const auto &param : params_of(*info.global))
+      params.push_back(lower(context.of(*param.type)));
+    auto *function = llvm::Function::Create(
+        llvm::FunctionType::get(lower(types.decls[decl]), params, false),
+        llvm::Function::ExternalLinkage, text(info.name), module);
+    storage[decl] = function;
+    return function;
+  }
+
+  llvm::GlobalVariable *variable(DeclId decl) {
+    if (storage[decl])
+      return llvm::cast<llvm::GlobalVariable>(storage[decl]);
+    auto *variable = new llvm::GlobalVariable(
+        module, lower(types.decls[decl]), false,
+        llvm::GlobalValue::ExternalLinkage, nullptr,
+        text(names.decls[decl].name));
+    storage[decl] = variable;
+    return variable;
+  }
+
+  void define_global(const GFuncDef &func) {
+    auto *function = llvm::cast<llvm::Function>(storage[func.decl]);
+    builder.SetInsertPoint(
+        llvm::BasicBlock::Create(llvm_context, "entry", function));
+    auto *arg = function->arg_begin();
+    for (const auto &param : func.params) {
+      auto *slot = stack_slot(types.decls[param.decl], param.name);
+      builder.CreateStore(arg++, slot);
+      storage[param.decl] = slot;
+    }
+    work.push_back(func.stmt);
+    run();
+    // Falling off the end returns zero
+    if (!builder.GetInsertBlock()->getTerminator()) {
+      auto *type = function->getReturnType();
+      if (type->isVoidTy())
+        builder.CreateRetVoid();
+      else
+        builder.CreateRet(llvm::Constant::getNullValue(type));
+    }
+  }
+  void define_global(const GVarDef &var) {
+    builder.SetInsertPoint(init_block);
+    work.push_back(&var);
+    work.push_back(var.value);
+    run();
+    init_block = builder.GetInsertBlock();
+  }
+  void define_global(const GFuncDecl &) {}
+  void define_global(const GVarDecl &) {}
+  void define_global(const GStruct &) {}
+
+  // Generates everything on the work stack
+  void run() {
+    while (!work.empty()) {
+      auto item = work.back();
+      work.pop_back();
+      std::visit(
+          overload{
+              [this](const ExprNode *expr) { enter(*expr); },
+              [this](ExprDone done) { finish(*done.expr); },
+              [this](LogicalRhs item) { logical_rhs(*item.op); },
+              [this](LogicalDone item) { logical_done(item); },
+              [this](const StmtNode *stmt) { enter(*stmt); },
+              [this](StmtDone done) { finish(*done.stmt); },
+              [this](IfCond item) { if_cond(*item.stmt); },
+              [this](IfElse item) { if_else(item); },
+              [this](IfEnd item) {
+                builder.CreateBr(item.end);
+                builder.SetInsertPoint(item.end);
+              },
+              [this](WhileCond item) { while_cond(item); },
+              [this](WhileEnd item) {
+                builder.CreateBr(item.cond);
+                loops.pop_back();
+                builder.SetInsertPoint(item.end);
+              },
+              [this](const GVarDef *var) { initialize(*var); },
+          },
+          item);
+    }
+  }
+
+  // Leaves are generated at once, other expressions once their operands
+  // are. Operands are pushed last first, to go in source order.
+  void enter(const ExprNode &expr) {
+    std::visit(
+        overload{
+            [this](const EVar &var) { push(load(var.decl)); },
+            [this](const EInt &value) {
+              push(builder.getInt32(static_cast<std::uint32_t>(value.value)));
+            },
+            [this](const EChar &value) {
+              push(builder.getInt8(static_cast<std::uint8_t>(value.value)));
+            },
+            [this](const EString &value) {
+              push(builder.CreateGlobalStringPtr(text(value.value)));
+            },
+            [this, &expr](const EBinOp &op) {
+              if (op.op == Bop::LOGICAL_AND || op.op == Bop::LOGICAL_OR) {
+                work.push_back(LogicalRhs{&op});
+              } else {
+                work.push_back(ExprDone{&expr});
+                work.push_back(op.rhs);
+              }
+              work.push_back(op.lhs);
+            },
+            [this, &expr](const EUnOp &op) {
+              work.push_back(ExprDone{&expr});
+              work.push_back(op.rhs);
+            },
+            [this, &expr](const ECall &call) {
+              work.push_back(ExprDone{&expr});
+              for (auto arg = call.args.rbegin(); arg != call.args.rend();
+                   ++arg)
+                work.push_back(*arg);
+            },
+            [this, &expr](const ENew &alloc) {
+              work.push_back(ExprDone{&expr});
+              work.push_back(alloc.expr);
+            },
+            [this, &expr](const EArrayAccess &access) {
+              work.push_back(ExprDone{&expr});
+              work.push_back(access.index);
+            },
+        },
+        expr);
+  }
+
+  void finish(const ExprNode &expr) {
+    std::visit(
+        overload{
+            [this](const EBinOp &op) {
+              auto *rhs = pop();
+              auto *lhs = pop();
+              push(binary(op.op, lhs, rhs));
+            },
+            [this](const EUnOp &op) { push(unary(op.op, pop())); },
+            [this](const ECall &call) {
+              auto *callee = llvm::cast<llvm::Function>(storage[call.decl]);
+              std::vector<llvm::Value *> args(call.args.size());
+              for (auto i = args.size(); i-- > 0;)
+                args[i] = convert(pop(), callee->getArg(i)->getType());
+              push(builder.CreateCall(callee, args));
+            },
+            [this](const ENew &alloc) { push(allocate(alloc, pop())); },
+            [this](const EArrayAccess &access) {
+              auto [address, type] =
+                  element(access.decl, pop(), access.label);
+              push(builder.CreateLoad(lower(type), address));
+            },
+            [](const auto &) {},
+        },
+        expr);
+  }
+
+  llvm::Value *binary(Bop op, llvm::Value *lhs, llvm::Value *rhs) {
+    // Pointers are only compared, maybe with the literal 0
+    if (lhs->getType()->isPointerTy() || rhs->getType()->isPointerTy()) {
+      if (lhs->getType()->isPointerTy())
+        rhs = convert(rhs, lhs->getType());
+      else
+        lhs = convert(lhs, rhs->getType());
+      return truth(op == Bop::EQUAL ? builder.CreateICmpEQ(lhs, rhs)
+                                    : builder.CreateICmpNE(lhs, rhs));
+    }
+    lhs = widen(lhs);
+    rhs = widen(rhs);
+    switch (op) {
+    case Bop::PLUS:
+      return builder.CreateAdd(lhs, rhs);
+    case Bop::MINUS:
+      return builder.CreateSub(lhs, rhs);
+    case Bop::MULTIPLY:
+      return builder.CreateMul(lhs, rhs);
+    case Bop::DIVIDE:
+      return builder.CreateSDiv(lhs, rhs);
+    case Bop::MODULUS:
+      return builder.CreateSRem(lhs, rhs);
+    case Bop::LESS_THAN:
+      return truth(builder.CreateICmpSLT(lhs, rhs));
+    case Bop::LARGER_THAN:
+      return truth(builder.CreateICmpSGT(lhs, rhs));
+    case Bop::LESS_EQUAL:
+      return truth(builder.CreateICmpSLE(lhs, rhs));
+    case Bop::LARGER_EQUAL:
+      return truth(builder.CreateICmpSGE(lhs, rhs));
+    case Bop::EQUAL:
+      return truth(builder.CreateICmpEQ(lhs, rhs));
+    case Bop::NOT_EQUAL:
+      return truth(builder.CreateICmpNE(lhs, rhs));
+    case Bop::BITWISE_AND:
+      return builder.CreateAnd(lhs, rhs);
+    case Bop::BITWISE_OR:
+      return builder.CreateOr(lhs, rhs);
+    case Bop::SHIFT_LEFT:
+      return builder.CreateShl(lhs, rhs);
+    case Bop::SHIFT_RIGHT:
+      return builder.CreateAShr(lhs, rhs);
+    default:
+      llvm_unreachable("operator rejected by the type checker");
+    }
+  }
+
+  llvm::Value *unary(Uop op, llvm::Value *operand) {
+    switch (op) {
+    case Uop::NEG:
+      return builder.CreateNeg(widen(operand));
+    case Uop::BITWISE_NOT:
+      return builder.CreateNot(widen(operand));
+    case Uop::NOT:
+      return truth(builder.CreateIsNull(operand));
+    }
+    llvm_unreachable("unknown unary operator");
+  }
+
+  void logical_rhs(const EBinOp &op) {
+    auto *test = builder.GetInsertBlock();
+    auto *rhs = block("rhs");
+    auto *end = block("end");
+    auto *lhs = builder.CreateIsNotNull(pop());
+    if (op.op == Bop::LOGICAL_AND)
+      builder.CreateCondBr(lhs, rhs, end);
+    else
+      builder.CreateCondBr(lhs, end, rhs);
+    builder.SetInsertPoint(rhs);
+    work.push_back(LogicalDone{&op, test, end});
+    work.push_back(op.rhs);
+  }
+
+  void logical_done(LogicalDone item) {
+    auto *rhs = builder.CreateIsNotNull(pop());
+    auto *from = builder.GetInsertBlock();
+    builder.CreateBr(item.end);
+    builder.SetInsertPoint(item.end);
+    auto *value = builder.CreatePHI(builder.getInt1Ty(), 2);
+    value->addIncoming(builder.getInt1(item.op->op == Bop::LOGICAL_OR),
+                       item.test);
+    value->addIncoming(rhs, from);
+    push(truth(value));
+  }
+
+  // The element count of new is an int, its size in bytes an i64
+  llvm::Value *allocate(const ENew &alloc, llvm::Value *count) {
+    auto element = context.pointee(alloc.type_id);
+    auto *bytes = builder.CreateMul(
+        builder.CreateSExt(count, builder.getInt64Ty()),
+        builder.getInt64(types.layouts.size_of(element, context)));
+    auto malloc = module.getOrInsertFunction(
+        "malloc", builder.getInt8PtrTy(), builder.getInt64Ty());
+    return builder.CreateBitCast(builder.CreateCall(malloc, {bytes}),
+                                 lower(alloc.type_id));
+  }
+
+  // Address and type of `name[index]`, or of `name[index].label`
+  std::pair<llvm::Value *, TypeId> element(DeclId decl, llvm::Value *index,
+                                           std::optional<Symbol> label) {
+    auto type = context.pointee(types.decls[decl]);
+    auto *address = builder.CreateGEP(
+        type == TypeContext::void_type ? builder.getInt8Ty() : lower(type),
+        load(decl), builder.CreateSExt(index, builder.getInt64Ty()));
+    if (!label)
+      return {address, type};
+    auto record = context.struct_decl(type);
+    auto field = *types.layouts.field(record, *label);
+    address = builder.CreateStructGEP(structs[record], address,
+                                      types.layouts.position(record, field));
+    const auto &fields = std::get<GStruct>(*names.decls[record].global).fields;
+    return {address, context.of(*fields[field].type)};
+  }
+
+  // Statements whose expressions are generated first are finished by a
+  // StmtDone. Index expressions go before the value assigned.
+  void enter(const StmtNode &stmt) {
+    auto push_done = [this, &stmt](const ExprNode *expr) {
+      work.push_back(StmtDone{&stmt});
+      work.push_back(expr);
+    };
+    std::visit(
+        overload{
+            [&](const SExpr &node) { push_done(node.expr); },
+            [&](const SVarDef &def) { push_done(def.value); },
+            [&](const SVarAssign &assign) { push_done(assign.value); },
+            [&](const SArrayAssign &assign) {
+              push_done(assign.value);
+              work.push_back(assign.index);
+            },
+            [&](const SArrayPlusAssign &assign) {
+              push_done(assign.value);
+              work.push_back(assign.index);
+            },
+            [&](const SArrayMinusAssign &assign) {
+              push_done(assign.value);
+              work.push_back(assign.index);
+            },
+            [this](const SScope &scope) {
+              for (auto it = scope.stmts.rbegin(); it != scope.stmts.rend();
+                   ++it)
+                work.push_back(*it);
+            },
+            [this](const SIf &node) {
+              work.push_back(IfCond{&node});
+              work.push_back(node.cond);
+            },
+            [this](const SWhile &node) {
+              auto *cond = block("while");
+              builder.CreateBr(cond);
+              builder.SetInsertPoint(cond);
+              work.push_back(WhileCond{&node, cond});
+              work.push_back(node.cond);
+            },
+            [this](const SBreak &) {
+              builder.CreateBr(loops.back());
+              start_dead_block();
+            },
+            [&](const SReturn &node) {
+              if (node.expr) {
+                push_done(node.expr);
+                return;
+              }
+              builder.CreateRetVoid();
+              start_dead_block();
+            },
+            [this](const SDelete &node) {
+              auto free = module.getOrInsertFunction(
+                  "free", builder.getVoidTy(), builder.getInt8PtrTy());
+              builder.CreateCall(free,
+                                 {builder.CreateBitCast(
+                                     load(node.decl), builder.getInt8PtrTy())});
+            },
+        },
+        stmt);
+  }
+
+  void finish(const StmtNode &stmt) {
+    std::visit(
+        overload{
+            [this](const SExpr &) { pop(); },
+            [this](const SVarDef &def) {
+              auto *slot = stack_slot(types.decls[def.decl], def.name);
+              storage[def.decl] = slot;
+              builder.CreateStore(convert(pop(), slot->getAllocatedType()),
+                                  slot);
+            },
+            [this](const SVarAssign &assign) {
+              builder.CreateStore(
+                  convert(pop(), lower(types.decls[assign.decl])),
+                  storage[assign.decl]);
+            },
+            [this](const SArrayAssign &assign) {
+              auto *value = pop();
+              auto [address, type] =
+                  element(assign.decl, pop(), assign.label);
+              builder.CreateStore(convert(value, lower(type)), address);
+            },
+            [this](const SArrayPlusAssign &step) { finish_step(step, 1); },
+            [this](const SArrayMinusAssign &step) { finish_step(step, -1); },
+            [this](const SReturn &) {
+              auto *function = builder.GetInsertBlock()->getParent();
+              builder.CreateRet(convert(pop(), function->getReturnType()));
+              start_dead_block();
+            },
+            [](const auto &) {},
+        },
+        stmt);
+  }
+
+  // a[i]++ adds, a[i]-- subtracts, the value
+  template <typename Step> void finish_step(const Step &step, int sign) {
+    auto *value = widen(pop());
+    auto [address, type] = element(step.decl, pop(), step.label);
+    auto *element_type = lower(type);
+    auto *old = widen(builder.CreateLoad(element_type, address));
+    auto *result = sign > 0 ? builder.CreateAdd(old, value)
+                            : builder.CreateSub(old, value);
+    builder.CreateStore(convert(result, element_type), address);
+  }
+
+  void if_cond(const SIf &stmt) {
+    auto *cond = builder.CreateIsNotNull(pop());
+    auto *then = block("then");
+    auto *otherwise = stmt.else_branch ? block("else") : nullptr;
+    auto *end = block("endif");
+    builder.CreateCondBr(cond, then, otherwise ? otherwise : end);
+    builder.SetInsertPoint(then);
+    work.push_back(IfElse{&stmt, otherwise, end});
+    work.push_back(stmt.then_branch);
+  }
+
+  void if_else(IfElse item) {
+    builder.CreateBr(item.end);
+    if (!item.otherwise) {
+      builder.SetInsertPoint(item.end);
+      return;
+    }
+    builder.SetInsertPoint(item.otherwise);
+    work.push_back(IfEnd{item.end});
+    work.push_back(item.stmt->else_branch);
+  }
+
+  void while_cond(WhileCond item) {
+    auto *cond = builder.CreateIsNotNull(pop());
+    auto *body = block("body");
+    auto *end = block("endwhile");
+    builder.CreateCondBr(cond, body, end);
+    builder.SetInsertPoint(body);
+    loops.push_back(end);
+    work.push_back(WhileEnd{item.cond, end});
+    work.push_back(item.stmt->stmt);
+  }
+
+  // A constant initializer is the global's; any other is stored by the
+  // module constructor
+  void initialize(const GVarDef &var) {
+    auto *global = llvm::cast<llvm::GlobalVariable>(storage[var.decl]);
+    auto *value = convert(pop(), global->getValueType());
+    if (auto *constant = llvm::dyn_cast<llvm::Constant>(value)) {
+      global->setInitializer(constant);
+      return;
+    }
+    global->setInitializer(llvm::Constant::getNullValue(value->getType()));
+    builder.CreateStore(value, global);
+  }
+
+  llvm::Type *lower(TypeId type) {
+    int pointers = 0;
+    for (; context.kind(type) == TypeClass::POINTER;
+         type = context.pointee(type))
+      ++pointers;
+    llvm::Type *lowered;
+    switch (context.kind(type)) {
+    case TypeClass::VOID:
+      lowered = pointers > 0 ? builder.getInt8Ty() : builder.getVoidTy();
+      break;
+    case TypeClass::CHAR:
+      lowered = builder.getInt8Ty();
+      break;
+    case TypeClass::STRUCT:
+      lowered = structs[context.struct_decl(type)];
+      break;
+    default:
+      lowered = builder.getInt32Ty();
+      break;
+    }
+    for (; pointers > 0; --pointers)
+      lowered = lowered->getPointerTo();
+    return lowered;
+  }
+
+  llvm::Value *load(DeclId decl) {
+    return builder.CreateLoad(lower(types.decls[decl]), storage[decl]);
+  }
+
+  // Locals live in the entry block, so each is allocated once
+  llvm::AllocaInst *stack_slot(TypeId type, Symbol name) {
+    auto &entry = builder.GetInsertBlock()->getParent()->getEntryBlock();
+    llvm::IRBuilder<> at_entry(&entry, entry.begin());
+    return at_entry.CreateAlloca(lower(type), nullptr, text(name));
+  }
+
+  // `value` as a `type`: integers are sign extended or truncated, and the
+  // literal 0 becomes a null pointer
+  llvm::Value *convert(llvm::Value *value, llvm::Type *type) {
+    if (value->getType() == type)
+      return value;
+    if (auto *pointer = llvm::dyn_cast<llvm::PointerType>(type))
+      return llvm::ConstantPointerNull::get(pointer);
+    return builder.CreateSExtOrTrunc(value, type);
+  }
+  // Integers are computed on as ints
+  llvm::Value *widen(llvm::Value *value) {
+    return builder.CreateSExtOrTrunc(value, builder.getInt32Ty());
+  }
+  llvm::Value *truth(llvm::Value *test) {
+    return builder.CreateZExt(test, builder.getInt32Ty());
+  }
+
+  llvm::BasicBlock *block(const char *name) {
+    return llvm::BasicBlock::Create(llvm_context, name,
+                                    builder.GetInsertBlock()->getParent());
+  }
+  // Code after a return or break goes to a block nothing jumps to
+  void start_dead_block() { builder.SetInsertPoint(block("dead")); }
+
+  void push(llvm::Value *value) { values.push_back(value); }
+  llvm::Value *pop() {
+    auto *value = values.back();
+    values.pop_back();
+    return value;
+  }
+
+  const Names &names;
+  Types &types;
+  TypeContext &context;
+  llvm::LLVMContext &llvm_context;
+  llvm::Module &module;
+  llvm::IRBuilder<> builder;
+  // Function, global variable or stack slot of every declaration
+  std::vector<llvm::Value *> storage;
+  std::vector<llvm::StructType *> structs;
+  // The module constructor, and where its code goes on
+  llvm::Function *init;
+  llvm::BasicBlock *init_block;
+  // Where break jumps in each enclosing loop
+  std::vector<llvm::BasicBlock *> loops;
+  std::vector<Work> work;
+  std::vector<llvm::Value *> values;
+};
+
+} // namespace
+
+std::unique_ptr<llvm::TargetMachine> x86_64_target(Diagnostics &diag) {
+  LLVMInitializeX86TargetInfo();
+  LLVMInitializeX86Target();
+  LLVMInitializeX86TargetMC();
+  LLVMInitializeX86AsmPrinter();
+  llvm::Triple triple(llvm::sys::getDefaultTargetTriple());
+  if (triple.getArch() != llvm::Triple::x86_64)
+    triple = llvm::Triple("x86_64-unknown-linux-gnu");
+  std::string error;
+  const auto *target = llvm::TargetRegistry::lookupTarget(triple.str(), error);
+  if (!target) {
+    diag.fatal(error);
+    return nullptr;
+  }
+  return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+      triple.str(), "x86-64", "", llvm::TargetOptions(), llvm::Reloc::PIC_));
+}
+
+std::unique_ptr<llvm::Module>
+generate_module(const Prog &prog, const Names &names, Types &types,
+                llvm::LLVMContext &context, const llvm::TargetMachine &target,
+                std::string_view name) {
+  auto module = std::make_unique<llvm::Module>(
+      llvm::StringRef(name.data(), name.size()), context);
+  module->setTargetTriple(target.getTargetTriple().str());
+  module->setDataLayout(target.createDataLayout());
+  Generator generator(names, types, *module);
+  for (const auto *global : prog.globals)
+    generator.declare(*global);
+  for (const auto *global : prog.globals)
+    generator.define(*global);
+  generator.finish();
+  return module;
+}
+
+bool emit_object(llvm::Module &module, llvm::TargetMachine &target,
+                 const std::string &path, Diagnostics &diag) {
+  std::error_code error;
+  llvm::raw_fd_ostream out(path, error, llvm::sys::fs::OF_None);
+  if (error) {
+    diag.fatal(fmt::format("{}: {}", path, error.message()));
+    return false;
+  }
+  llvm::legacy::PassManager passes;
+  if (target.addPassesToEmitFile(passes, out, nullptr,
+                                 llvm::CGFT_ObjectFile)) {
+    diag.fatal("The target cannot emit object files");
+    return false;
+  }
+  passes.run(module);
+  out.flush();
+  return true;
+}
@@ -1,24 +1,114 @@
 #include "diagnostics/diagnostics.hpp"
+#include "source/source_manager.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <utility>
 using enum Severity;
 
-void Diagnostics::error(Position pos, std::string message) {
-  messages.push_back(DiagMessage(Error, std::move(message), pos));
-  error_count++;
+namespace {
+
+std::atomic<std::uint64_t> next_id{1};
+
+} // namespace
+
+Diagnostics::Diagnostics() : state(std::make_unique<State>()) {
+  state->id = next_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+// A moved-from sink stays usable, with a fresh state of its own
+Diagnostics::Diagnostics(Diagnostics &&other) noexcept
+    : state(std::exchange(other.state, Diagnostics().state)) {}
+
+Diagnostics &Diagnostics::operator=(Diagnostics &&other) noexcept {
+  state = std::exchange(other.state, Diagnostics().state);
+  return *this;
 }
 
-bool Diagnostics::has_errors() const { return error_count > 0; }
+Diagnostics::~Diagnostics() = default;
+
+void Diagnostics::error(Phase phase, SourceLoc loc, std::string message) {
+  report(DiagMessage(Error, phase, std::move(message), loc));
+}
 
 void Diagnostics::fatal(std::string message) {
-  messages.push_back(DiagMessage(Fatal, std::move(message)));
-  fatal_count++;
+  report(DiagMessage(Fatal, Phase::Driver, std::move(message), std::nullopt));
+}
+
+bool Diagnostics::has_errors() const { return error_count() > 0; }
+
+int Diagnostics::error_count() const {
+  return state->counts[static_cast<int>(Error)].load(
+      std::memory_order_relaxed);
+}
+
+void Diagnostics::report(DiagMessage message) {
+  state->counts[static_cast<int>(message.level)].fetch_add(
+      1, std::memory_order_relaxed);
+  local_buffer().messages.push_back(std::move(message));
 }
 
-void Diagnostics::print_all() {
-  for (const auto &msg : messages) {
+auto Diagnostics::local_buffer() -> Buffer & {
+  // The sink and buffer this thread reported to last
+  thread_local std::uint64_t cached_id = 0;
+  thread_local Buffer *cached = nullptr;
+  if (cached_id == state->id)
+    return *cached;
+
+  auto self = std::this_thread::get_id();
+  std::lock_guard lock(state->mutex);
+  auto found = std::find_if(
+      state->buffers.begin(), state->buffers.end(),
+      [&](const auto &buffer) { return buffer->thread == self; });
+  if (found == state->buffers.end()) {
+    state->buffers.push_back(std::make_unique<Buffer>());
+    state->buffers.back()->thread = self;
+    found = std::prev(state->buffers.end());
+  }
+  cached_id = state->id;
+  cached = found->get();
+  return *cached;
+}
+
+void Diagnostics::merge(Diagnostics &&other) {
+  auto &buffer = local_buffer();
+  for (auto &theirs : other.state->buffers) {
+    buffer.messages.insert(buffer.messages.end(),
+                           std::make_move_iterator(theirs->messages.begin()),
+                           std::make_move_iterator(theirs->messages.end()));
+  }
+  for (int level = 0; level < 4; ++level) {
+    state->counts[level].fetch_add(
+        other.state->counts[level].load(std::memory_order_relaxed),
+        std::memory_order_relaxed);
+  }
+  other = Diagnostics();
+}
+
+void Diagnostics::print_all(const SourceManager &sources,
+                            fmt::memory_buffer &out) const {
+  // Messages without a location come from the driver and go first, the
+  // others in source order
+  std::vector<const DiagMessage *> sorted;
+  for (const auto &buffer : state->buffers) {
+    for (const auto &msg : buffer->messages)
+      sorted.push_back(&msg);
+  }
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const DiagMessage *a, const DiagMessage *b) {
+                     if (a->loc.has_value() != b->loc.has_value())
+                       return !a->loc.has_value();
+                     if (a->loc && a->loc->offset != b->loc->offset)
+                       return a->loc->offset < b->loc->offset;
+                     return a->phase < b->phase;
+                   });
+
+  for (const auto *msg : sorted) {
     std::string level_string;
     fmt::terminal_color color;
 
-    switch (msg.level) {
+    switch (msg->level) {
     case Note:
       level_string = "note:";
       color = fmt::terminal_color::blue;
@@ -41,20 +131,27 @@ void Diagnostics::print_all() {
       break;
     }
     std::string location = "zzc_cigrid"; // Default location
-    // pos is std::optional
-    if (msg.pos) {
-      int line = msg.pos.value().line;
-      int column = msg.pos.value().column;
-      // Only accept single file here, so named as input_file
-      auto location = fmt::format("{}:{}:{}", "input_file", line, column);
+    // loc is std::optional
+    if (msg->loc) {
+      auto pos = sources.position(msg->loc.value());
+      location = fmt::format("{}:{}:{}", sources.name(msg->loc.value()),
+                             pos.line, pos.column);
     }
-    fmt::print(stderr, "{}: {} {}\n",
-               fmt::styled(location, fmt::emphasis::bold),
-               fmt::styled(level_string, fmt::fg(color) | fmt::emphasis::bold),
-               msg.message);
+    fmt::format_to(
+        std::back_inserter(out), "{}: {} {}\n",
+        fmt::styled(location, fmt::emphasis::bold),
+        fmt::styled(level_string, fmt::fg(color) | fmt::emphasis::bold),
+        msg->message);
   }
 
-  if (fatal_count > 0) {
-    fmt::print(stderr, "Compileation terminated.\n");
+  if (state->counts[static_cast<int>(Fatal)].load(std::memory_order_relaxed) >
+      0) {
+    fmt::format_to(std::back_inserter(out), "Compileation terminated.\n");
   }
-}
\ No newline at end of file
+}
+
+void Diagnostics::print_all(const SourceManager &sources) const {
+  fmt::memory_buffer out;
+  print_all(sources, out);
+  std::fwrite(out.data(), 1, out.size(), stderr);
+}
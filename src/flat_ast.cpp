@@ -0,0 +1,313 @@
+#include "parser/flat_ast.hpp"
+
+#include <vector>
+
+#include "parser/tree_builder.hpp"
+
+namespace {
+
+std::optional<Symbol> optional_symbol(std::uint32_t id) {
+  if (id == no_node)
+    return std::nullopt;
+  return Symbol{id};
+}
+
+// Node ids of one table in a part moved behind the nodes already there
+struct Shift {
+  std::uint32_t base;
+  std::uint32_t operator()(std::uint32_t id) const {
+    return id == no_node ? no_node : id + base;
+  }
+};
+
+template <typename Table> std::uint32_t table_size(const Table &table) {
+  return static_cast<std::uint32_t>(table.size());
+}
+
+} // namespace
+
+void FlatAst::append(const FlatAst &part) {
+  Shift type{table_size(types)};
+  Shift expr{table_size(exprs)};
+  Shift stmt{table_size(stmts)};
+  Shift list_index{static_cast<std::uint32_t>(lists.size())};
+  // Lists are copied as they are; the ids in them are fixed up through the
+  // one node that refers to each list
+  lists.insert(lists.end(), part.lists.begin(), part.lists.end());
+  auto shift_list = [&](std::uint32_t index, Shift shift,
+                        std::size_t stride = 1) {
+    for (std::size_t i = index + 1; i <= index + lists[index]; i += stride)
+      lists[i] = shift(lists[i]);
+    return index;
+  };
+
+  for (NodeId id = 0; id < part.types.size(); ++id) {
+    auto a = part.types.operand(id, 0);
+    if (part.types.kind[id] == TypeKind::POINT)
+      a = type(a);
+    types.add(part.types.kind[id], part.types.loc[id], {a});
+  }
+
+  for (NodeId id = 0; id < part.exprs.size(); ++id) {
+    auto a = part.exprs.operand(id, 0);
+    auto b = part.exprs.operand(id, 1);
+    auto c = part.exprs.operand(id, 2);
+    switch (part.exprs.kind[id]) {
+    case ExprKind::BIN_OP:
+      c = expr(c);
+      [[fallthrough]];
+    case ExprKind::UN_OP:
+    case ExprKind::ARRAY_ACCESS:
+      b = expr(b);
+      break;
+    case ExprKind::CALL:
+      b = shift_list(list_index(b), expr);
+      break;
+    case ExprKind::NEW:
+      a = type(a);
+      b = expr(b);
+      break;
+    default:
+      break;
+    }
+    exprs.add(part.exprs.kind[id], part.exprs.loc[id], {a, b, c});
+  }
+
+  for (NodeId id = 0; id < part.stmts.size(); ++id) {
+    auto a = part.stmts.operand(id, 0);
+    auto b = part.stmts.operand(id, 1);
+    auto c = part.stmts.operand(id, 2);
+    auto d = part.stmts.operand(id, 3);
+    switch (part.stmts.kind[id]) {
+    case StmtKind::EXPR:
+    case StmtKind::RETURN:
+      a = expr(a);
+      break;
+    case StmtKind::VAR_DEF:
+      a = type(a);
+      c = expr(c);
+      break;
+    case StmtKind::VAR_ASSIGN:
+      b = expr(b);
+      break;
+    case StmtKind::ARRAY_ASSIGN:
+    case StmtKind::ARRAY_PLUS_ASSIGN:
+    case StmtKind::ARRAY_MINUS_ASSIGN:
+      b = expr(b);
+      d = expr(d);
+      break;
+    case StmtKind::SCOPE:
+      a = shift_list(list_index(a), stmt);
+      break;
+    case StmtKind::IF:
+      c = stmt(c);
+      [[fallthrough]];
+    case StmtKind::WHILE:
+      a = expr(a);
+      b = stmt(b);
+      break;
+    default:
+      break;
+    }
+    stmts.add(part.stmts.kind[id], part.stmts.loc[id], {a, b, c, d});
+  }
+
+  // Parameter lists hold (type, name) pairs, only the types move
+  for (NodeId id = 0; id < part.globals.size(); ++id) {
+    auto a = part.globals.operand(id, 0);
+    auto b = part.globals.operand(id, 1);
+    auto c = part.globals.operand(id, 2);
+    auto d = part.globals.operand(id, 3);
+    switch (part.globals.kind[id]) {
+    case GlobalKind::FUNC_DEF:
+      d = stmt(d);
+      [[fallthrough]];
+    case GlobalKind::FUNC_DECL:
+      a = type(a);
+      c = shift_list(list_index(c), type, 2);
+      break;
+    case GlobalKind::VAR_DEF:
+      a = type(a);
+      c = expr(c);
+      break;
+    case GlobalKind::VAR_DECL:
+      a = type(a);
+      break;
+    case GlobalKind::STRUCT:
+      b = shift_list(list_index(b), type, 2);
+      break;
+    }
+    globals.add(part.globals.kind[id], part.globals.loc[id], {a, b, c, d});
+  }
+}
+
+// Children always have smaller ids than their parents and the categories
+// only refer to earlier ones (types, exprs, stmts, globals), so each table
+// is converted in a single forward pass.
+std::unique_ptr<Prog> to_tree(const FlatAst &ast) {
+  TreeBuilder builder;
+  builder.begin();
+
+  std::vector<TypeNode *> types(ast.types.size());
+  for (NodeId id = 0; id < ast.types.size(); ++id) {
+    auto loc = ast.types.loc[id];
+    auto a = ast.types.operand(id, 0);
+    switch (ast.types.kind[id]) {
+    case TypeKind::VOID:
+      types[id] = builder.type_void(loc);
+      break;
+    case TypeKind::INT:
+      types[id] = builder.type_int(loc);
+      break;
+    case TypeKind::CHAR:
+      types[id] = builder.type_char(loc);
+      break;
+    case TypeKind::IDENT:
+      types[id] = builder.type_ident(loc, Symbol{a});
+      break;
+    case TypeKind::POINT:
+      types[id] = builder.type_point(loc, types[a]);
+      break;
+    }
+  }
+
+  std::vector<ExprNode *> exprs(ast.exprs.size());
+  std::vector<ExprNode *> args;
+  for (NodeId id = 0; id < ast.exprs.size(); ++id) {
+    auto loc = ast.exprs.loc[id];
+    auto a = ast.exprs.operand(id, 0);
+    auto b = ast.exprs.operand(id, 1);
+    auto c = ast.exprs.operand(id, 2);
+    switch (ast.exprs.kind[id]) {
+    case ExprKind::VAR:
+      exprs[id] = builder.expr_var(loc, Symbol{a});
+      break;
+    case ExprKind::INT:
+      exprs[id] = builder.expr_int(loc, static_cast<int>(a));
+      break;
+    case ExprKind::CHAR:
+      exprs[id] = builder.expr_char(loc, static_cast<char>(a));
+      break;
+    case ExprKind::STRING:
+      exprs[id] = builder.expr_string(loc, Symbol{a});
+      break;
+    case ExprKind::BIN_OP:
+      exprs[id] =
+          builder.expr_bin_op(loc, static_cast<Bop>(a), exprs[b], exprs[c]);
+      break;
+    case ExprKind::UN_OP:
+      exprs[id] = builder.expr_un_op(loc, static_cast<Uop>(a), exprs[b]);
+      break;
+    case ExprKind::CALL:
+      args.clear();
+      for (auto arg : ast.list(b))
+        args.push_back(exprs[arg]);
+      exprs[id] = builder.expr_call(loc, Symbol{a}, args);
+      break;
+    case ExprKind::NEW:
+      exprs[id] = builder.expr_new(loc, types[a], exprs[b]);
+      break;
+    case ExprKind::ARRAY_ACCESS:
+      exprs[id] = builder.expr_array_access(loc, Symbol{a}, exprs[b],
+                                            optional_symbol(c));
+      break;
+    }
+  }
+
+  std::vector<StmtNode *> stmts(ast.stmts.size());
+  std::vector<StmtNode *> children;
+  for (NodeId id = 0; id < ast.stmts.size(); ++id) {
+    auto loc = ast.stmts.loc[id];
+    auto a = ast.stmts.operand(id, 0);
+    auto b = ast.stmts.operand(id, 1);
+    auto c = ast.stmts.operand(id, 2);
+    auto d = ast.stmts.operand(id, 3);
+    switch (ast.stmts.kind[id]) {
+    case StmtKind::EXPR:
+      stmts[id] = builder.stmt_expr(loc, exprs[a]);
+      break;
+    case StmtKind::VAR_DEF:
+      stmts[id] = builder.stmt_var_def(loc, types[a], Symbol{b}, exprs[c]);
+      break;
+    case StmtKind::VAR_ASSIGN:
+      stmts[id] = builder.stmt_var_assign(loc, Symbol{a}, exprs[b]);
+      break;
+    case StmtKind::ARRAY_ASSIGN:
+      stmts[id] = builder.stmt_array_assign(loc, Symbol{a}, exprs[b],
+                                            optional_symbol(c), exprs[d]);
+      break;
+    case StmtKind::ARRAY_PLUS_ASSIGN:
+      stmts[id] = builder.stmt_array_plus_assign(loc, Symbol{a}, exprs[b],
+                                                 optional_symbol(c), exprs[d]);
+      break;
+    case StmtKind::ARRAY_MINUS_ASSIGN:
+      stmts[id] = builder.stmt_array_minus_assign(
+          loc, Symbol{a}, exprs[b], optional_symbol(c), exprs[d]);
+      break;
+    case StmtKind::SCOPE:
+      children.clear();
+      for (auto stmt : ast.list(a))
+        children.push_back(stmts[stmt]);
+      stmts[id] = builder.stmt_scope(loc, children);
+      break;
+    case StmtKind::IF:
+      stmts[id] = builder.stmt_if(loc, exprs[a], stmts[b],
+                                  c == no_node ? nullptr : stmts[c]);
+      break;
+    case StmtKind::WHILE:
+      stmts[id] = builder.stmt_while(loc, exprs[a], stmts[b]);
+      break;
+    case StmtKind::BREAK:
+      stmts[id] = builder.stmt_break(loc);
+      break;
+    case StmtKind::RETURN:
+      stmts[id] = builder.stmt_return(loc, a == no_node ? nullptr : exprs[a]);
+      break;
+    case StmtKind::DELETE:
+      stmts[id] = builder.stmt_delete(loc, Symbol{a});
+      break;
+    }
+  }
+
+  std::vector<Parameter> params;
+  auto collect_params = [&](std::uint32_t list) {
+    params.clear();
+    auto items = ast.list(list);
+    for (std::size_t i = 0; i < items.size(); i += 2)
+      params.push_back(Parameter{types[items[i]], Symbol{items[i + 1]}});
+  };
+  std::vector<GlobalNode *> globals(ast.globals.size());
+  for (NodeId id = 0; id < ast.globals.size(); ++id) {
+    auto loc = ast.globals.loc[id];
+    auto a = ast.globals.operand(id, 0);
+    auto b = ast.globals.operand(id, 1);
+    auto c = ast.globals.operand(id, 2);
+    auto d = ast.globals.operand(id, 3);
+    switch (ast.globals.kind[id]) {
+    case GlobalKind::FUNC_DEF:
+      collect_params(c);
+      globals[id] =
+          builder.global_func_def(loc, types[a], Symbol{b}, params, stmts[d]);
+      break;
+    case GlobalKind::FUNC_DECL:
+      collect_params(c);
+      globals[id] = builder.global_func_decl(loc, types[a], Symbol{b}, params);
+      break;
+    case GlobalKind::VAR_DEF:
+      globals[id] = builder.global_var_def(loc, types[a], Symbol{b}, exprs[c]);
+      break;
+    case GlobalKind::VAR_DECL:
+      globals[id] = builder.global_var_decl(loc, types[a], Symbol{b});
+      break;
+    case GlobalKind::STRUCT:
+      collect_params(b);
+      globals[id] = builder.global_struct(loc, Symbol{a}, params);
+      break;
+    }
+  }
+
+  std::vector<GlobalNode *> prog;
+  for (auto global : ast.list(ast.prog))
+    prog.push_back(globals[global]);
+  return builder.finish(prog);
+}
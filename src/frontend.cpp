@@ -0,0 +1,37 @@
+#include "frontend/frontend.hpp"
+
+#include <utility>
+
+#include "parser/flat_ast.hpp"
+
+namespace {
+
+template <typename... Args>
+ParseResult parse_with(const CigridFlags &flags, Args &&...args) {
+  ParseResult result;
+  auto run = [&](auto parser) {
+    auto ast = parser.parse();
+    result.error = parser.parse_error();
+    return ast;
+  };
+  if (flags.flat_ast) {
+    auto flat = run(FlatParser(std::forward<Args>(args)..., result.diag, flags));
+    if (flat)
+      result.prog = to_tree(*flat);
+  } else {
+    result.prog = run(Parser(std::forward<Args>(args)..., result.diag, flags));
+  }
+  return result;
+}
+
+} // namespace
+
+ParseResult parse_unit(const SourceManager &sources, FileId file,
+                       const CigridFlags &flags) {
+  return parse_with(flags, sources, file);
+}
+
+ParseResult parse_stream(SourceManager &sources, FileId file,
+                         StreamLexer::ReadFn read, const CigridFlags &flags) {
+  return parse_with(flags, sources, file, std::move(read));
+}
@@ -0,0 +1,73 @@
+#include "interner/interner.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+constexpr std::size_t initial_capacity = 1024;
+constexpr std::size_t chunk_size = 64 * 1024;
+} // namespace
+
+Interner::Interner() : table(initial_capacity, Slot{0, 0}) {
+  strings.reserve(initial_capacity / 2);
+}
+
+auto Interner::global() -> Interner & {
+  static Interner interner;
+  return interner;
+}
+
+auto Interner::hash(std::string_view text) -> std::uint64_t {
+  std::uint64_t h = hash_seed;
+  for (char c : text)
+    h = hash_step(h, c);
+  return h;
+}
+
+auto Interner::intern(std::string_view text, std::uint64_t hash) -> Symbol {
+  auto short_hash = static_cast<std::uint32_t>(hash);
+  std::size_t mask = table.size() - 1;
+  for (std::size_t i = short_hash & mask;; i = (i + 1) & mask) {
+    Slot &slot = table[i];
+    if (slot.index == 0) {
+      auto id = static_cast<std::uint32_t>(strings.size());
+      strings.emplace_back(store(text), text.size());
+      slot = Slot{short_hash, id + 1};
+      // Keep the load factor at or below one half
+      if (strings.size() * 2 > table.size())
+        grow();
+      return Symbol{id};
+    }
+    if (slot.hash == short_hash && strings[slot.index - 1] == text)
+      return Symbol{slot.index - 1};
+  }
+}
+
+auto Interner::store(std::string_view text) -> const char * {
+  if (text.size() > chunk_left) {
+    std::size_t size = std::max(chunk_size, text.size());
+    chunks.push_back(std::make_unique<char[]>(size));
+    chunk_cursor = chunks.back().get();
+    chunk_left = size;
+  }
+  char *result = chunk_cursor;
+  if (!text.empty())
+    std::memcpy(result, text.data(), text.size());
+  chunk_cursor += text.size();
+  chunk_left -= text.size();
+  return result;
+}
+
+auto Interner::grow() -> void {
+  std::vector<Slot> bigger(table.size() * 2, Slot{0, 0});
+  std::size_t mask = bigger.size() - 1;
+  for (const Slot &slot : table) {
+    if (slot.index == 0)
+      continue;
+    std::size_t i = slot.hash & mask;
+    while (bigger[i].index != 0)
+      i = (i + 1) & mask;
+    bigger[i] = slot;
+  }
+  table = std::move(bigger);
+}
@@ -1,27 +1,38 @@
 #include "lexer/lexer.hpp"
 #include "fmt/core.h"
 
+#include <algorithm>
 #include <cctype>
+#include <iterator>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <vector>
 
-Lexer::Lexer(std::string_view input, Diagnostics &diag)
-    : source(input), diag(diag) {
+Lexer::Lexer(const SourceManager &sources, FileId file, Diagnostics &diag,
+             LexerEngine engine, Interner &interner)
+    : Lexer(sources, file, sources.buffer(file).view(), 0, diag, engine,
+            interner) {}
+
+Lexer::Lexer(const SourceManager &sources, FileId file, std::string_view window,
+             std::uint32_t base, Diagnostics &diag, LexerEngine engine,
+             Interner &interner)
+    : sources(sources), file(file), source(window), base(base), diag(diag),
+      engine(engine), interner(interner) {
   next_char();
 }
 
 std::vector<Token> Lexer::gen_token() {
+  // Roughly one token per four bytes of source, avoids most regrowth
+  token_list.reserve(size / 4 + 1);
   while (auto token_option = next_token()) {
     auto token = token_option.value();
     token_list.push_back(token);
-    // token_list.push_back(std::move(token));
     if (token.kind == TokenKind::END_OF_FILE) {
       break;
     }
     if (token.kind == TokenKind::BAD) {
-      diag.error(token.pos, "bad token encountered");
+      diag.error(Phase::Lex, loc(token.offset), "bad token encountered");
       break;
     }
   }
@@ -31,13 +42,55 @@ std::vector<Token> Lexer::gen_token() {
 void Lexer::print_token_list() {
   for (const auto &token : token_list) {
     // Only suppor single file here
-    fmt::print(
-        "{:<20}{}\n",
-        fmt::format("{}:{}:{}", "input_file", token.pos.line, token.pos.column),
-        token.lexeme);
+    auto pos = sources.position(loc(token.offset));
+    fmt::memory_buffer location;
+    fmt::format_to(std::back_inserter(location), "{}:{}:{}", "input_file",
+                   pos.line, pos.column);
+    fmt::print("{:<20}{}\n", fmt::string_view(location.data(), location.size()),
+               lexeme(token));
   }
 }
 
+std::string_view lex_error_message(LexError error) {
+  switch (error) {
+  case LexError::UNDEFINED_SYMBOL:
+    return "undefined symbol";
+  case LexError::UNTERMINATED_COMMENT:
+    return "unterminated comment";
+  case LexError::MISSING_SINGLE_QUOTE:
+    return "missing terminating \' character";
+  case LexError::MISSING_DOUBLE_QUOTE:
+    return "missing terminating \" character";
+  }
+  return "bad token";
+}
+
+std::string_view Lexer::lexeme(const Token &token) const {
+  switch (token.kind) {
+  case TokenKind::END_OF_FILE:
+    return "EOF";
+  case TokenKind::BAD:
+    return lex_error_message(static_cast<LexError>(token.payload));
+  default:
+    return source.substr(token.offset - base, token.length);
+  }
+}
+
+Token Lexer::make_token(TokenKind kind, std::uint32_t payload) const {
+  // current_char is the first character after the lexeme
+  auto end = static_cast<std::uint32_t>(current_pos - 1);
+  return Token{kind, base + start_offset, end - start_offset, payload};
+}
+
+Token Lexer::make_eof() const {
+  return Token{TokenKind::END_OF_FILE, base + static_cast<std::uint32_t>(size),
+               0, 0};
+}
+
+Token Lexer::make_bad(LexError error) const {
+  return make_token(TokenKind::BAD, static_cast<std::uint32_t>(error));
+}
+
 void Lexer::next_char() {
   if (current_pos >= size) {
     return;
@@ -45,11 +98,6 @@ void Lexer::next_char() {
 
   else {
     current_char = source[current_pos++];
-    current_column++;
-  }
-  if (current_char == '\n') {
-    current_line++;
-    current_column = 1;
   }
 
   if (current_pos >= size) {
@@ -58,16 +106,20 @@ void Lexer::next_char() {
 }
 
 std::optional<Token> Lexer::next_token() {
+  if (engine == LexerEngine::DFA)
+    return next_token_dfa();
+  return next_token_switch();
+}
+
+std::optional<Token> Lexer::next_token_switch() {
   if (isspace(current_char))
     skip_space();
 
   if (at_eof)
-    return Token(TokenKind::END_OF_FILE, "EOF",
-                 Position{current_line, current_column});
+    return make_eof();
 
   // Taking a snapshot of the start of the current lexeme
-  start_line = current_line;
-  start_column = current_column - 1;
+  start_offset = current_pos - 1;
 
   if (current_char == '#') {
     skip_line();
@@ -94,9 +146,67 @@ std::optional<Token> Lexer::next_token() {
     return read_symbol();
 }
 
+std::optional<Token> Lexer::next_token_dfa() {
+  while (true) {
+    if (is_space(current_char))
+      skip_space();
+
+    if (at_eof)
+      return make_eof();
+
+    start_offset = current_pos - 1;
+
+    switch (char_info(current_char).cls) {
+    case CharClass::IDENT_START:
+      return read_ident_or_keyword();
+    case CharClass::DIGIT:
+      return read_num();
+    case CharClass::SINGLE_QUOTE:
+      return read_char();
+    case CharClass::DOUBLE_QUOTE:
+      return read_string();
+    case CharClass::HASH:
+      skip_line();
+      continue;
+    case CharClass::SPACE:
+    case CharClass::OPERATOR:
+    case CharClass::OTHER:
+      break;
+    }
+
+    // Longest match through the operator automaton
+    std::uint8_t state = OpDfa::START;
+    while (true) {
+      auto next = op_dfa.next[state][static_cast<unsigned char>(current_char)];
+      if (next == OpDfa::DEAD)
+        break;
+      state = next;
+      next_char();
+    }
+
+    const auto &accept = op_dfa.accept[state];
+    switch (accept.action) {
+    case OpAction::TOKEN:
+      return make_token(accept.kind);
+    case OpAction::LINE_COMMENT:
+      skip_line();
+      continue;
+    case OpAction::BLOCK_COMMENT:
+      if (!skip_block_comment())
+        return make_bad(LexError::UNTERMINATED_COMMENT);
+      continue;
+    case OpAction::NONE:
+      break;
+    }
+    diag.error(Phase::Lex, loc(base + start_offset), "undefined symbol");
+    next_char();
+    return make_bad(LexError::UNDEFINED_SYMBOL);
+  }
+}
+
 std::optional<Token> Lexer::read_char() {
   next_char();
-  char value;
+  char value = 0;
   if (current_char == '\\') {
     // Escape Character
     next_char();
@@ -120,7 +230,7 @@ std::optional<Token> Lexer::read_char() {
       // Illegal Escape Character, in g++ this is a warning instead of error
       // though
       diag.error(
-          Position{start_line, start_column},
+          Phase::Lex, loc(base + start_offset),
           fmt::format("unknown escape sequence: \'\\{}\'", current_char));
     }
   }
@@ -128,7 +238,8 @@ std::optional<Token> Lexer::read_char() {
   // '' not legal:
   // g++ says the situation above is empty character constant
   else if (current_char == '\"') {
-    diag.error(Position{start_line, start_column}, "empty character constant");
+    diag.error(Phase::Lex, loc(base + start_offset),
+               "empty character constant");
   }
 
   else {
@@ -139,32 +250,30 @@ std::optional<Token> Lexer::read_char() {
 
   if (current_char == '\'') {
     next_char();
-    std::string lexeme = fmt::format("'{}'", value);
-    return Token(TokenKind::CHAR_LITERAL, std::move(lexeme),
-                 Position{start_line, start_column}, value);
+    return make_token(TokenKind::CHAR_LITERAL,
+                      static_cast<unsigned char>(value));
   }
 
   // Default case: the char did not end with ', should throw error
   // g++ says: error: missing terminating ' character
-  return Token{TokenKind::BAD, "missing terminating \' character",
-               Position{start_line, start_column}};
+  return make_bad(LexError::MISSING_SINGLE_QUOTE);
 }
 
 std::optional<Token> Lexer::read_ident_or_keyword() {
-  std::string lexeme;
-  while (
-      (isalpha(current_char) || isdigit(current_char) || current_char == '_') &&
-      !at_eof) {
-    lexeme += current_char;
-    next_char();
-  }
-  if (keyword_map.contains(lexeme)) {
-    return Token{keyword_map.at(lexeme), std::move(lexeme),
-                 Position{start_line, start_column}};
-  } else {
-    return Token{TokenKind::IDENTIFIER, std::string(lexeme),
-                 Position{start_line, start_column}, std::move(lexeme)};
-  }
+  // The run ends at the first non-identifier byte, but never goes past the
+  // last byte of the input (that one is where at_eof is raised)
+  const char *begin = source.data() + start_offset;
+  const char *last = source.data() + size - 1;
+  const char *end = scan.ident_end(begin, last);
+  advance_to(end - source.data());
+  auto token = make_token(TokenKind::IDENTIFIER);
+  auto name = lexeme(token);
+  token.kind = keyword_kind(name);
+  // Only names are hashed, keywords are never interned
+  if (token.kind == TokenKind::IDENTIFIER) {
+    token.payload = interner.intern(name).id;
+  }
+  return token;
 }
 
 std::optional<Token> Lexer::read_num() {
@@ -177,11 +286,10 @@ std::optional<Token> Lexer::read_num() {
     if (current_char == 'x' || current_char == 'X') {
       next_char();
       int k = 0;
-      std::string lexeme;
-      while (isxdigit(current_char)) {
-        lexeme += current_char;
+      // The last byte is never consumed, stop there instead of spinning
+      while (!at_eof && is_xdigit(current_char)) {
         k = k * 16;
-        if (isdigit(current_char)) {
+        if (is_digit(current_char)) {
           k = k + current_char - '0';
         } else {
           switch (current_char) {
@@ -201,134 +309,135 @@ std::optional<Token> Lexer::read_num() {
         }
         next_char();
       }
-      return Token{TokenKind::INT_LITERAL, std::move(lexeme),
-                   Position{start_line, start_column}, k};
+      return make_token(TokenKind::INT_LITERAL, k);
     }
   }
 
   // Regular numbers (decimal point not supported currently)
   int k = 0;
-  std::string lexeme;
-  while (isdigit(current_char)) {
-    k = k * 10 + current_char - '0';
-    lexeme += current_char;
-    next_char();
+  int pos = current_pos - 1;
+  while (pos < size - 1 && is_digit(source[pos])) {
+    k = k * 10 + source[pos] - '0';
+    ++pos;
   }
-  return Token{TokenKind::INT_LITERAL, std::move(lexeme),
-               Position{start_line, start_column}, k};
+  advance_to(pos);
+  return make_token(TokenKind::INT_LITERAL, k);
 }
 
 std::optional<Token> Lexer::read_string() {
-  std::string lexeme;
+  auto &text = string_text;
+  text.clear();
   next_char();
   while (current_char != '\"') {
+    // No closing quote can follow the last byte
+    if (at_eof) {
+      diag.error(Phase::Lex, loc(base + start_offset),
+                 "missing terminating \" character");
+      return make_bad(LexError::MISSING_DOUBLE_QUOTE);
+    }
+
     if (current_char == '\\') {
       // Escape Character
       next_char();
       switch (current_char) {
       case 'n':
-        lexeme += '\n';
+        text += '\n';
         break;
       case 't':
-        lexeme += '\t';
+        text += '\t';
         break;
       case '\\':
-        lexeme += '\\';
+        text += '\\';
         break;
       case '\'':
-        lexeme += '\'';
+        text += '\'';
         break;
       case '\"':
-        lexeme += '\"';
+        text += '\"';
         break;
       default:
         // Illegal Escape Character, in g++ this is a warning instead of error
         // though
         diag.error(
-            Position{start_line, start_column},
+            Phase::Lex, loc(base + start_offset),
             fmt::format("unknown escape sequence: \'\\{}\'", current_char));
       }
     }
 
     else if (current_char == '\n') {
       // According to g++, an newline in double quote is illegal
-      diag.error(Position{start_line, start_column},
+      diag.error(Phase::Lex, loc(base + start_offset),
                  "missing terminating \" character");
-      return Token{TokenKind::BAD, "missing terminating \" character",
-                   Position{start_line, start_column}};
+      return make_bad(LexError::MISSING_DOUBLE_QUOTE);
     }
 
     else {
-      lexeme += current_char;
+      text += current_char;
     }
 
     next_char();
   }
   next_char(); // Consume the terminating quote
-  std::string lexeme_with_quote = fmt::format("\"{}\"", lexeme);
-  return Token(TokenKind::STRING_LITERAL, std::move(lexeme_with_quote),
-               Position(start_line, start_column), std::move(lexeme));
+  return make_token(TokenKind::STRING_LITERAL,
+                    interner.intern(text).id);
 }
 
 std::optional<Token> Lexer::read_symbol() {
   switch (current_char) {
   case '~':
     next_char();
-    return Token(TokenKind::BITWISE_NOT, "~",
-                 Position(start_line, start_column));
+    return make_token(TokenKind::BITWISE_NOT);
   case '+':
     next_char();
-    return Token(TokenKind::PLUS, "+", Position(start_line, start_column));
+    return make_token(TokenKind::PLUS);
   case '-':
     next_char();
-    return Token(TokenKind::MINUS, "-", Position(start_line, start_column));
+    return make_token(TokenKind::MINUS);
   case '*':
     next_char();
-    return Token(TokenKind::MULTIPLY, "*", Position(start_line, start_column));
+    return make_token(TokenKind::MULTIPLY);
   case '^':
     next_char();
-    return Token(TokenKind::EXPONENTIAL, "^",
-                 Position(start_line, start_column));
+    return make_token(TokenKind::EXPONENTIAL);
   case '%':
     next_char();
-    return Token(TokenKind::MODULUS, "%", Position(start_line, start_column));
+    return make_token(TokenKind::MODULUS);
   case '(':
     next_char();
-    return Token(TokenKind::LPAREN, "(", Position(start_line, start_column));
+    return make_token(TokenKind::LPAREN);
   case ')':
     next_char();
-    return Token(TokenKind::RPAREN, ")", Position(start_line, start_column));
+    return make_token(TokenKind::RPAREN);
   case '[':
     next_char();
-    return Token(TokenKind::LBRACKET, "[", Position(start_line, start_column));
+    return make_token(TokenKind::LBRACKET);
   case ']':
     next_char();
-    return Token(TokenKind::RBRACKET, "]", Position(start_line, start_column));
+    return make_token(TokenKind::RBRACKET);
   case '{':
     next_char();
-    return Token(TokenKind::LBRACE, "{", Position(start_line, start_column));
+    return make_token(TokenKind::LBRACE);
   case '}':
     next_char();
-    return Token(TokenKind::RBRACE, "}", Position(start_line, start_column));
+    return make_token(TokenKind::RBRACE);
   case ';':
     next_char();
-    return Token(TokenKind::SEMICOLON, ";", Position(start_line, start_column));
+    return make_token(TokenKind::SEMICOLON);
   case ',':
     next_char();
-    return Token(TokenKind::COMMA, ",", Position(start_line, start_column));
+    return make_token(TokenKind::COMMA);
   case '.':
     next_char();
-    return Token(TokenKind::PERIOD, ".", Position(start_line, start_column));
+    return make_token(TokenKind::PERIOD);
 
   case '!': {
     next_char();
     switch (current_char) {
     case '=':
       next_char();
-      return Token(TokenKind::NOT_EQUAL,
-                   "!=", Position(start_line, start_column));
+      return make_token(TokenKind::NOT_EQUAL);
     default:
-      return Token(TokenKind::NOT, "!", Position(start_line, start_column));
+      return make_token(TokenKind::NOT);
     }
   }
   // Ignore pre-processing, need to be implemented for real c++ code
@@ -345,27 +454,13 @@ std::optional<Token> Lexer::read_symbol() {
     }
 
     else if (current_char == '*') {
-      while (current_pos < size) {
-        if (current_char == '*') {
-          next_char();
-          if (current_char == '/')
-            break;
-        } else {
-          next_char();
-        }
-      }
-      if (current_pos >= size) {
-        diag.error(Position(start_line, start_column), "unterminated comment");
-        return Token(TokenKind::BAD, "unterminated comment",
-                     Position(start_line, start_column));
-      }
-      next_char();
+      if (!skip_block_comment())
+        return make_bad(LexError::UNTERMINATED_COMMENT);
       return next_token();
     }
 
     else {
-      next_char();
-      return Token(TokenKind::DIVIDE, "/", Position(start_line, start_column));
+      return make_token(TokenKind::DIVIDE);
     }
   }
 
@@ -374,15 +469,12 @@ std::optional<Token> Lexer::read_symbol() {
     switch (current_char) {
     case '<':
       next_char();
-      return Token(TokenKind::SHIFT_LEFT, "<<",
-                   Position(start_line, start_column));
+      return make_token(TokenKind::SHIFT_LEFT);
     case '=':
       next_char();
-      return Token(TokenKind::LESS_EQUAL,
-                   "<=", Position(start_line, start_column));
+      return make_token(TokenKind::LESS_EQUAL);
     default:
-      return Token(TokenKind::LESS_THAN, "<",
-                   Position(start_line, start_column));
+      return make_token(TokenKind::LESS_THAN);
     }
   }
 
@@ -391,15 +483,12 @@ std::optional<Token> Lexer::read_symbol() {
     switch (current_char) {
     case '>':
       next_char();
-      return Token(TokenKind::SHIFT_RIGHT, ">>",
-                   Position(start_line, start_column));
+      return make_token(TokenKind::SHIFT_RIGHT);
     case '=':
       next_char();
-      return Token(TokenKind::LARGER_EQUAL,
-                   ">=", Position(start_line, start_column));
+      return make_token(TokenKind::LARGER_EQUAL);
     default:
-      return Token(TokenKind::LARGER_THAN, ">",
-                   Position(start_line, start_column));
+      return make_token(TokenKind::LARGER_THAN);
     }
   }
 
@@ -408,9 +497,9 @@ std::optional<Token> Lexer::read_symbol() {
     switch (current_char) {
     case '=':
       next_char();
-      return Token(TokenKind::EQUAL, "==", Position(start_line, start_column));
+      return make_token(TokenKind::EQUAL);
     default:
-      return Token(TokenKind::ASSIGN, "=", Position(start_line, start_column));
+      return make_token(TokenKind::ASSIGN);
     }
   }
 
@@ -419,11 +508,9 @@ std::optional<Token> Lexer::read_symbol() {
     switch (current_char) {
     case '|':
       next_char();
-      return Token(TokenKind::LOGICAL_OR, "||",
-                   Position(start_line, start_column));
+      return make_token(TokenKind::LOGICAL_OR);
     default:
-      return Token(TokenKind::BITWISE_OR, "|",
-                   Position(start_line, start_column));
+      return make_token(TokenKind::BITWISE_OR);
     }
   }
 
@@ -432,31 +519,54 @@ std::optional<Token> Lexer::read_symbol() {
     switch (current_char) {
     case '&':
       next_char();
-      return Token(TokenKind::LOGICAL_AND, "&&",
-                   Position(start_line, start_column));
+      return make_token(TokenKind::LOGICAL_AND);
     default:
-      return Token(TokenKind::BITWISE_AND, "&",
-                   Position(start_line, start_column));
+      return make_token(TokenKind::BITWISE_AND);
     }
   }
 
   default: {
-    diag.error(Position(start_line, start_column), "undefined symbol");
+    diag.error(Phase::Lex, loc(base + start_offset), "undefined symbol");
     next_char();
-    return Token(TokenKind::BAD, "undefined symbol",
-                 Position(start_line, start_column));
+    return make_bad(LexError::UNDEFINED_SYMBOL);
   }
   }
 }
 
-void Lexer::skip_line() {
-  while (current_pos < size && current_char != '\n') {
-    next_char();
+bool Lexer::skip_block_comment() {
+  // The '*' of the opener may already close the comment: "/*/"
+  const char *begin = source.data() + start_offset + 1;
+  const char *end = source.data() + size;
+  const char *star = scan.find_comment_end(begin, end);
+  // Stop on the '/' of "*/", or on the last byte if there is none
+  advance_to(star == end ? size - 1 : star - source.data() + 1);
+  if (current_pos >= size) {
+    diag.error(Phase::Lex, loc(base + start_offset), "unterminated comment");
+    return false;
   }
+  next_char();
+  return true;
+}
+
+void Lexer::skip_line() {
+  if (current_pos >= size || current_char == '\n')
+    return;
+  const char *end = source.data() + size;
+  const char *newline = scan.find_newline(source.data() + current_pos, end);
+  advance_to(newline == end ? size - 1 : newline - source.data());
 }
 
 void Lexer::skip_space() {
-  while (current_pos < size && isspace(current_char)) {
-    next_char();
-  }
+  if (current_pos >= size || !is_space(current_char))
+    return;
+  const char *end = source.data() + size;
+  const char *stop = scan.skip_whitespace(source.data() + current_pos, end);
+  advance_to(stop == end ? size - 1 : stop - source.data());
+}
+
+void Lexer::advance_to(int target) {
+  // Same effect as calling next_char() until current_char is source[target]
+  current_pos = target + 1;
+  current_char = source[target];
+  at_eof = current_pos >= size;
 }
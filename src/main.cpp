@@ -1,18 +1,74 @@
 // main.cpp
-#include <fstream>
-#include <iostream>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
 #include <string>
 #include <system_error>
 #include <vector>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <fmt/color.h>
 #include <fmt/core.h>
+#include <llvm/Support/raw_ostream.h>
 
+#include "codegen/codegen.hpp"
 #include "common.hpp"
 #include "diagnostics/diagnostics.hpp"
+#include "frontend/frontend.hpp"
 #include "lexer/lexer.hpp"
-#include "parser/parser.hpp"
 #include "printer/ast_printer.hpp"
+#include "sema/name_analysis.hpp"
+#include "sema/type_checker.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "support/thread_pool.hpp"
+
+// The process is about to end: the AST, the sources and the interned strings
+// go back to the OS with it instead of being freed piece by piece
+[[noreturn]] void exit_now(int status) {
+  std::fflush(stdout);
+  std::fflush(stderr);
+  std::_Exit(status);
+}
+
+// Reports the error that stopped the compilation, its line alone with
+// --line-error
+[[noreturn]] void fail(const SourceManager &sources, const CigridFlags &flags,
+                       SourceLoc loc, const std::string &message,
+                       int status) {
+  auto pos = sources.position(loc);
+  if (flags.line_error)
+    fmt::print(stderr, "{}", pos.line);
+  if (flags.debug)
+    fmt::print(stderr, "Error at {}:{}: {}\n", pos.line, pos.column, message);
+  exit_now(status);
+}
+
+// Writes the object file of the checked `prog`, and its IR with --emit-llvm
+bool compile(const Prog &prog, const Names &names, Types &types,
+             const std::string &filename, const CigridFlags &flags,
+             Diagnostics &diag) {
+  auto target = x86_64_target(diag);
+  if (!target)
+    return false;
+  llvm::LLVMContext context;
+  auto module =
+      generate_module(prog, names, types, context, *target, filename);
+  if (flags.emit_llvm) {
+    std::fflush(stdout);
+    module->print(llvm::outs(), nullptr);
+    llvm::outs().flush();
+  }
+  auto output = flags.output;
+  if (output.empty())
+    output =
+        std::filesystem::path(filename).filename().replace_extension(".o");
+  return emit_object(*module, *target, output, diag);
+}
 
 bool handle_flags(int argc, char *argv[], CigridFlags &flags,
                   Diagnostics &diag) {
@@ -39,7 +95,41 @@ bool handle_flags(int argc, char *argv[], CigridFlags &flags,
       flags.asm_gen = true;
     else if (arg == "--liveness")
       flags.liveness = true;
-    else {
+    else if (arg == "--dfa-lexer")
+      flags.dfa_lexer = true;
+    else if (arg == "--pack-structs")
+      flags.pack_structs = true;
+    else if (arg == "--layout-report")
+      flags.layout_report = true;
+    else if (arg == "--stream")
+      flags.stream = true;
+    else if (arg == "--flat-ast")
+      flags.flat_ast = true;
+    else if (arg == "--emit-llvm")
+      flags.emit_llvm = true;
+    else if (arg.starts_with("--output=")) {
+      flags.output = arg.substr(arg.find('=') + 1);
+      if (flags.output.empty()) {
+        diag.fatal("Missing output file name");
+        return false;
+      }
+    } else if (arg.starts_with("--lex-threads=") ||
+             arg.starts_with("--parse-threads=") ||
+             arg.starts_with("--print-threads=") ||
+             arg.starts_with("--sema-threads=")) {
+      auto &threads =
+          arg.starts_with("--lex-threads=")     ? flags.lex_threads
+          : arg.starts_with("--parse-threads=") ? flags.parse_threads
+          : arg.starts_with("--print-threads=") ? flags.print_threads
+                                                : flags.sema_threads;
+      auto value = arg.substr(arg.find('=') + 1);
+      char *end = nullptr;
+      threads = std::strtoul(value.c_str(), &end, 10);
+      if (value.empty() || *end != '\0' || threads == 0) {
+        diag.fatal(fmt::format("Invalid thread count: {}", arg));
+        return false;
+      }
+    } else {
       diag.fatal(fmt::format("Unknown flag: {}", arg));
       return false;
     }
@@ -50,27 +140,83 @@ bool handle_flags(int argc, char *argv[], CigridFlags &flags,
 int main(int argc, char *argv[]) {
   fmt::print("Hello, World!\n");
   CigridFlags flags;
+  SourceManager sources;
   Diagnostics diag;
   if (!handle_flags(argc, argv, flags, diag)) {
-    diag.print_all();
+    diag.print_all(sources);
     return 1;
   }
   std::string filename = argv[argc - 1]; // The last arg should be filename
-  std::ifstream file_stream(filename);
-  if (!file_stream) {
-    diag.fatal(fmt::format("{}: No such file or directory", filename));
-    diag.print_all();
-    return 1;
+  ParseResult result;
+  if (flags.stream) {
+    // Read through the descriptor so that pipes are consumed as they fill
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      diag.fatal(fmt::format("{}: No such file or directory", filename));
+      diag.print_all(sources);
+      return 1;
+    }
+    auto read_some = [fd](char *buffer, std::size_t capacity) -> std::size_t {
+      ssize_t count;
+      do {
+        count = ::read(fd, buffer, capacity);
+      } while (count < 0 && errno == EINTR);
+      return count > 0 ? static_cast<std::size_t>(count) : 0;
+    };
+    auto file = sources.add_stream(filename);
+    result = parse_stream(sources, file, read_some, flags);
+    ::close(fd);
+  } else {
+    // The manager owns the source text until the end of the compilation
+    auto source = SourceBuffer::from_file(filename);
+    if (!source) {
+      diag.fatal(fmt::format("{}: No such file or directory", filename));
+      diag.print_all(sources);
+      return 1;
+    }
+    auto file = sources.add_file(std::move(*source));
+    result = parse_unit(sources, file, flags);
   }
-  Parser parser(file_stream, diag, flags);
-  auto prog = parser.parse();
-  diag.print_all();
+  // Syntax errors exit with 1
+  if (!result.ok())
+    fail(sources, flags, result.error->loc, result.error->message, 1);
+  result.diag.print_all(sources);
 
   // TODO: handle flags
   if (flags.pretty_print) {
     ASTPrinter printer;
-    (*prog).print(printer);
+    if (flags.print_threads > 1) {
+      ThreadPool pool(flags.print_threads);
+      printer.print_parallel(*result.prog, pool);
+    } else {
+      result.prog->print(printer);
+    }
+  }
+
+  // Semantic errors exit with 2. Structs are laid out by the type checker.
+  bool check = flags.type_check || flags.layout_report || flags.compile;
+  if (flags.name_analysis || check) {
+    ThreadPool pool(flags.sema_threads);
+    auto names = resolve_names(*result.prog, result.diag, pool);
+    if (!names.ok())
+      fail(sources, flags, names.error->loc, names.error->message, 2);
+    if (check) {
+      auto types = check_types(*result.prog, names, result.diag, pool,
+                               flags.pack_structs);
+      if (!types.ok())
+        fail(sources, flags, types.error->loc, types.error->message, 2);
+      if (flags.layout_report) {
+        fmt::memory_buffer out;
+        print_layout_report(*result.prog, types.layouts, out);
+        std::fwrite(out.data(), 1, out.size(), stdout);
+      }
+      if (flags.compile && !compile(*result.prog, names, types, filename,
+                                    flags, result.diag)) {
+        result.diag.print_all(sources);
+        exit_now(1);
+      }
+    }
   }
 
-  return 0;
+  exit_now(0);
 }
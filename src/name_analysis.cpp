@@ -0,0 +1,398 @@
+#include "sema/name_analysis.hpp"
+
+#include <algorithm>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "sema/symbol_table.hpp"
+
+// Lookups of unbound names come back as no_decl
+static_assert(SymbolTable::none == no_decl);
+
+namespace {
+
+// Globals whose function bodies one task of the second phase resolves
+constexpr std::size_t globals_per_run = 16;
+
+// Work on the resolver's stack besides nodes: scopes to open and close, and
+// local variables to declare once their initializer is resolved
+struct EnterScope {};
+struct ExitScope {};
+using Work =
+    std::variant<ExprNode *, StmtNode *, SVarDef *, EnterScope, ExitScope>;
+
+// The global scope. The first phase fills it; after that it is only read,
+// by every body at once.
+struct Globals {
+  SymbolTable values;
+  SymbolTable types;
+  // Position in the program of the global first declaring each global
+  // DeclId, so a body can tell the globals declared after it
+  std::vector<std::size_t> declared_at;
+};
+
+// The first error reported, and the position of the global it is in
+struct FirstError {
+  std::optional<NameError> error;
+  std::size_t position = 0;
+};
+
+// What the second phase leaves for one run of globals. Its parameters and
+// locals are numbered from 0 until they are placed after the globals.
+struct Bodies {
+  std::vector<Decl> decls;
+  // Every field holding such a number
+  std::vector<DeclId *> fixups;
+  // Number of parameters and locals before each global of the run
+  std::vector<DeclId> starts;
+  FirstError first;
+};
+
+class Resolver {
+public:
+  // For the first phase, or with `bodies` for the second
+  Resolver(Names &names, Globals &globals, Diagnostics &diag,
+           FirstError &first, Bodies *bodies = nullptr)
+      : names(names), globals(globals), diag(diag), first(first),
+        bodies(bodies) {}
+
+  // Declares the global at `at` and resolves all of it but a function body
+  void resolve(GlobalNode &global, std::size_t at) {
+    current = &global;
+    position = at;
+    std::visit([this](auto &node) { resolve_global(node); }, global);
+    run();
+  }
+
+  // The body of a function the first phase declared, at `at`
+  void resolve_body(GFuncDef &func, std::size_t at) {
+    position = at;
+    function = func.decl;
+    // The parameters and the statements of the body share one scope
+    locals.enter_scope();
+    for (auto &param : func.params)
+      declare(param.decl, DeclKind::PARAM, param.name, func.loc, param.type);
+    work.push_back(ExitScope{});
+    if (auto *body = std::get_if<SScope>(func.stmt))
+      push_stmts(body->stmts);
+    else
+      work.push_back(func.stmt);
+    run();
+  }
+
+private:
+  void resolve_global(GFuncDef &func) {
+    resolve_signature(func.return_type, func.params);
+    func.decl = declare_global(func, DeclKind::FUNCTION, func.return_type);
+  }
+  void resolve_global(GFuncDecl &func) {
+    resolve_signature(func.return_type, func.params);
+    func.decl = declare_global(func, DeclKind::FUNCTION, func.return_type);
+  }
+  void resolve_global(GVarDef &var) {
+    resolve_type(var.type);
+    // The initializer cannot see the variable itself
+    work.push_back(var.value);
+    run();
+    var.decl = declare_global(var, DeclKind::GLOBAL_VAR, var.type);
+  }
+  void resolve_global(GVarDecl &var) {
+    resolve_type(var.type);
+    var.decl = declare_global(var, DeclKind::GLOBAL_VAR, var.type);
+  }
+  void resolve_global(GStruct &record) {
+    // Declared first, so fields can point to the struct itself
+    record.decl = add(DeclKind::STRUCT, record.name, record.loc, nullptr);
+    names.decls[record.decl].global = current;
+    if (!globals.types.declare(record.name, record.decl))
+      error(record.loc, fmt::format("redefinition of '{}'", record.name));
+    for (auto &field : record.fields)
+      resolve_type(field.type);
+  }
+
+  void resolve_signature(TypeNode *return_type,
+                         std::span<Parameter> params) {
+    resolve_type(return_type);
+    for (auto &param : params)
+      resolve_type(param.type);
+  }
+
+  // Struct names in a type, which nests through pointers only
+  void resolve_type(TypeNode *type) {
+    while (auto *pointer = std::get_if<TPoint>(type))
+      type = pointer->point_type;
+    if (auto *ident = std::get_if<TIdent>(type)) {
+      ident->decl = visible(globals.types.lookup(ident->name));
+      if (ident->decl == no_decl)
+        error(ident->loc, fmt::format("unknown type name '{}'", ident->name));
+    }
+  }
+
+  // Resolves everything on the work stack
+  void run() {
+    while (!work.empty()) {
+      auto item = work.back();
+      work.pop_back();
+      std::visit(overload{
+                     [this](ExprNode *expr) {
+                       std::visit([this](auto &node) { visit(node); }, *expr);
+                     },
+                     [this](StmtNode *stmt) {
+                       std::visit([this](auto &node) { visit(node); }, *stmt);
+                     },
+                     [this](SVarDef *def) {
+                       declare(def->decl, DeclKind::LOCAL, def->name,
+                               def->loc, def->type);
+                     },
+                     [this](EnterScope) { locals.enter_scope(); },
+                     [this](ExitScope) { locals.exit_scope(); },
+                 },
+                 item);
+    }
+  }
+
+  // Children are pushed last first, so they are resolved in source order
+  void visit(EVar &var) { use_variable(var.decl, var.name, var.loc); }
+  void visit(EInt &) {}
+  void visit(EChar &) {}
+  void visit(EString &) {}
+  void visit(EBinOp &op) {
+    work.push_back(op.rhs);
+    work.push_back(op.lhs);
+  }
+  void visit(EUnOp &op) { work.push_back(op.rhs); }
+  void visit(ECall &call) {
+    use_function(call.decl, call.name, call.loc);
+    for (auto arg = call.args.rbegin(); arg != call.args.rend(); ++arg)
+      work.push_back(*arg);
+  }
+  void visit(ENew &expr) {
+    resolve_type(expr.type);
+    work.push_back(expr.expr);
+  }
+  void visit(EArrayAccess &access) {
+    use_variable(access.decl, access.name, access.loc);
+    work.push_back(access.index);
+  }
+
+  void visit(SExpr &stmt) { work.push_back(stmt.expr); }
+  void visit(SVarDef &def) {
+    resolve_type(def.type);
+    // The initializer sees the names outside, not the new variable
+    work.push_back(&def);
+    work.push_back(def.value);
+  }
+  void visit(SVarAssign &assign) {
+    use_variable(assign.decl, assign.name, assign.loc);
+    work.push_back(assign.value);
+  }
+  template <typename ArrayAssign> void visit_array(ArrayAssign &assign) {
+    use_variable(assign.decl, assign.name, assign.loc);
+    work.push_back(assign.value);
+    work.push_back(assign.index);
+  }
+  void visit(SArrayAssign &assign) { visit_array(assign); }
+  void visit(SArrayPlusAssign &assign) { visit_array(assign); }
+  void visit(SArrayMinusAssign &assign) { visit_array(assign); }
+  void visit(SScope &scope) {
+    locals.enter_scope();
+    work.push_back(ExitScope{});
+    push_stmts(scope.stmts);
+  }
+  void visit(SIf &stmt) {
+    if (stmt.else_branch)
+      push_scoped(stmt.else_branch);
+    push_scoped(stmt.then_branch);
+    work.push_back(stmt.cond);
+  }
+  void visit(SWhile &stmt) {
+    push_scoped(stmt.stmt);
+    work.push_back(stmt.cond);
+  }
+  void visit(SBreak &) {}
+  void visit(SReturn &stmt) {
+    if (stmt.expr)
+      work.push_back(stmt.expr);
+  }
+  void visit(SDelete &stmt) { use_variable(stmt.decl, stmt.name, stmt.loc); }
+
+  void push_stmts(std::span<StmtNode *> stmts) {
+    for (auto stmt = stmts.rbegin(); stmt != stmts.rend(); ++stmt)
+      work.push_back(*stmt);
+  }
+  // A branch or loop body is a scope of its own even without braces
+  void push_scoped(StmtNode *stmt) {
+    work.push_back(ExitScope{});
+    work.push_back(stmt);
+    work.push_back(EnterScope{});
+  }
+
+  // A global, declared at the current position
+  DeclId add(DeclKind kind, Symbol name, SourceLoc loc,
+             const TypeNode *type) {
+    auto decl = static_cast<DeclId>(names.decls.size());
+    names.decls.push_back(Decl{kind, name, loc, type, nullptr, no_decl});
+    globals.declared_at.push_back(position);
+    return decl;
+  }
+
+  // A parameter or local in the innermost scope of the body, numbered into
+  // `decl`
+  void declare(DeclId &decl, DeclKind kind, Symbol name, SourceLoc loc,
+               const TypeNode *type) {
+    decl = static_cast<DeclId>(bodies->decls.size());
+    bodies->decls.push_back(Decl{kind, name, loc, type, nullptr, function});
+    bodies->fixups.push_back(&decl);
+    if (!locals.declare(name, decl))
+      error(loc, fmt::format("redefinition of '{}'", name));
+  }
+
+  // A function or global variable. Declaring it again refers to the same
+  // declaration, which the definition replaces.
+  template <typename Node>
+  DeclId declare_global(Node &node, DeclKind kind, const TypeNode *type) {
+    constexpr bool defines =
+        std::is_same_v<Node, GFuncDef> || std::is_same_v<Node, GVarDef>;
+    auto previous = globals.values.lookup(node.name);
+    if (previous == no_decl) {
+      auto decl = add(kind, node.name, node.loc, type);
+      names.decls[decl].global = current;
+      globals.values.declare(node.name, decl);
+      return decl;
+    }
+    auto &decl = names.decls[previous];
+    bool defined = std::holds_alternative<GFuncDef>(*decl.global) ||
+                   std::holds_alternative<GVarDef>(*decl.global);
+    if (decl.kind != kind)
+      error(node.loc,
+            fmt::format("redefinition of '{}' as a different kind of symbol",
+                        node.name));
+    else if (defines && defined)
+      error(node.loc, fmt::format("redefinition of '{}'", node.name));
+    else if (defines)
+      decl = Decl{kind, node.name, node.loc, type, current, no_decl};
+    return previous;
+  }
+
+  // A global declared after the current position is not in scope yet
+  DeclId visible(DeclId decl) const {
+    if (decl != no_decl && globals.declared_at[decl] > position)
+      return no_decl;
+    return decl;
+  }
+
+  // The declaration `name` refers to, which is written into `use`; null if
+  // there is none
+  const Decl *lookup(DeclId &use, Symbol name) {
+    if (auto local = locals.lookup(name); local != no_decl) {
+      use = local;
+      bodies->fixups.push_back(&use);
+      return &bodies->decls[local];
+    }
+    use = visible(globals.values.lookup(name));
+    return use == no_decl ? nullptr : &names.decls[use];
+  }
+
+  void use_variable(DeclId &use, Symbol name, SourceLoc loc) {
+    const auto *decl = lookup(use, name);
+    if (!decl)
+      error(loc, fmt::format("use of undeclared identifier '{}'", name));
+    else if (decl->kind == DeclKind::FUNCTION)
+      error(loc, fmt::format("'{}' is a function, not a variable", name));
+  }
+
+  void use_function(DeclId &use, Symbol name, SourceLoc loc) {
+    const auto *decl = lookup(use, name);
+    if (!decl)
+      error(loc, fmt::format("call to undeclared function '{}'", name));
+    else if (decl->kind != DeclKind::FUNCTION)
+      error(loc, fmt::format("called object '{}' is not a function", name));
+  }
+
+  void error(SourceLoc loc, std::string message) {
+    diag.error(Phase::Names, loc, message);
+    if (!first.error)
+      first = FirstError{NameError{loc, std::move(message)}, position};
+  }
+
+  Names &names;
+  Globals &globals;
+  Diagnostics &diag;
+  FirstError &first;
+  // Null in the first phase
+  Bodies *bodies;
+  // Parameters and locals of the body being resolved
+  SymbolTable locals;
+  GlobalNode *current = nullptr;
+  // Of the global being resolved
+  std::size_t position = 0;
+  // The function being resolved
+  DeclId function = no_decl;
+  std::vector<Work> work;
+};
+
+} // namespace
+
+Names resolve_names(Prog &prog, Diagnostics &diag, ThreadPool &pool) {
+  Names names;
+  Globals globals;
+  FirstError first;
+  Resolver resolver(names, globals, diag, first);
+  for (std::size_t i = 0; i < prog.globals.size(); ++i)
+    resolver.resolve(*prog.globals[i], i);
+
+  // The bodies, a run of globals per task
+  auto runs = (prog.globals.size() + globals_per_run - 1) / globals_per_run;
+  std::vector<Bodies> bodies(runs);
+  pool.parallel_for(runs, [&](std::size_t run) {
+    auto &out = bodies[run];
+    Resolver resolver(names, globals, diag, out.first, &out);
+    auto begin = run * globals_per_run;
+    auto end = std::min(begin + globals_per_run, prog.globals.size());
+    for (auto i = begin; i < end; ++i) {
+      out.starts.push_back(static_cast<DeclId>(out.decls.size()));
+      if (auto *func = std::get_if<GFuncDef>(prog.globals[i]))
+        resolver.resolve_body(*func, i);
+    }
+  });
+
+  // Each run's parameters and locals go after the globals and the runs
+  // before it
+  std::vector<DeclId> bases(runs);
+  auto base = static_cast<DeclId>(names.decls.size());
+  names.locals.reserve(prog.globals.size() + 1);
+  for (std::size_t run = 0; run < runs; ++run) {
+    bases[run] = base;
+    for (auto start : bodies[run].starts)
+      names.locals.push_back(base + start);
+    base += static_cast<DeclId>(bodies[run].decls.size());
+  }
+  names.locals.push_back(base);
+  names.decls.resize(base);
+  pool.parallel_for(runs, [&](std::size_t run) {
+    std::copy(bodies[run].decls.begin(), bodies[run].decls.end(),
+              names.decls.begin() + bases[run]);
+    for (auto *decl : bodies[run].fixups)
+      *decl += bases[run];
+  });
+
+  // A global's own errors come before those of its body
+  auto *error = &first;
+  for (auto &run : bodies) {
+    if (!run.first.error)
+      continue;
+    if (!first.error || run.first.position < first.position)
+      error = &run.first;
+    break;
+  }
+  names.error = std::move(error->error);
+  return names;
+}
+
+Names resolve_names(Prog &prog, Diagnostics &diag) {
+  ThreadPool pool(1);
+  return resolve_names(prog, diag, pool);
+}
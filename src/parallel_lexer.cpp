@@ -0,0 +1,95 @@
+#include "lexer/parallel_lexer.hpp"
+
+#include <memory>
+
+#include "lexer/chunk_splitter.hpp"
+
+std::vector<std::uint32_t> find_chunk_boundaries(std::string_view source,
+                                                 std::size_t chunks) {
+  std::vector<std::uint32_t> cuts;
+  if (chunks < 2 || source.empty())
+    return cuts;
+  cuts.reserve(chunks - 1);
+
+  const char *begin = source.data();
+  const char *end = begin + source.size();
+  const std::size_t step = source.size() / chunks;
+  ChunkSplitter splitter;
+  const char *p = begin;
+  while (cuts.size() + 1 < chunks) {
+    const char *cut = splitter.scan(p, end, p + step);
+    // No empty last chunk
+    if (cut == nullptr || cut == end)
+      break;
+    cuts.push_back(static_cast<std::uint32_t>(cut - begin));
+    p = cut;
+  }
+  return cuts;
+}
+
+std::vector<Token> lex_parallel(const SourceManager &sources, FileId file,
+                                Diagnostics &diag, ThreadPool &pool,
+                                LexerEngine engine, Interner &interner) {
+  auto source = sources.buffer(file).view();
+  // A few chunks per thread, so that a slow chunk does not hold up the rest
+  auto cuts = find_chunk_boundaries(source, pool.size() * 4);
+  cuts.insert(cuts.begin(), 0);
+  cuts.push_back(static_cast<std::uint32_t>(source.size()));
+  std::size_t chunks = cuts.size() - 1;
+
+  struct Chunk {
+    std::vector<Token> tokens;
+    Diagnostics diag;
+    std::unique_ptr<Interner> symbols;
+  };
+  std::vector<Chunk> results(chunks);
+  pool.parallel_for(chunks, [&](std::size_t i) {
+    auto &chunk = results[i];
+    chunk.symbols = std::make_unique<Interner>();
+    Lexer lexer(sources, file, source.substr(cuts[i], cuts[i + 1] - cuts[i]),
+                cuts[i], chunk.diag, engine, *chunk.symbols);
+    chunk.tokens = lexer.gen_token();
+  });
+
+  // Sequential lexing stops at the first bad token, so does stitching
+  std::size_t used = 0;
+  while (used < chunks) {
+    const auto &tokens = results[used++].tokens;
+    if (!tokens.empty() && tokens.back().kind == TokenKind::BAD)
+      break;
+  }
+
+  // Local ids are in order of first occurrence within a chunk, so interning
+  // chunk by chunk reproduces the sequential order of first occurrence
+  std::vector<std::vector<std::uint32_t>> remap(used);
+  for (std::size_t i = 0; i < used; ++i) {
+    const auto &symbols = *results[i].symbols;
+    remap[i].reserve(symbols.size());
+    for (std::uint32_t id = 0; id < symbols.size(); ++id)
+      remap[i].push_back(interner.intern(symbols.lookup(Symbol{id})).id);
+  }
+
+  std::vector<std::size_t> starts(used + 1, 0);
+  for (std::size_t i = 0; i < used; ++i) {
+    auto count = results[i].tokens.size();
+    // Only the last chunk keeps its END_OF_FILE
+    if (i + 1 < used && results[i].tokens.back().kind != TokenKind::BAD)
+      --count;
+    starts[i + 1] = starts[i] + count;
+  }
+  std::vector<Token> tokens(starts[used]);
+  pool.parallel_for(used, [&](std::size_t i) {
+    const auto &chunk = results[i].tokens;
+    for (std::size_t k = 0; k < starts[i + 1] - starts[i]; ++k) {
+      Token token = chunk[k];
+      if (token.kind == TokenKind::IDENTIFIER ||
+          token.kind == TokenKind::STRING_LITERAL)
+        token.payload = remap[i][token.payload];
+      tokens[starts[i] + k] = token;
+    }
+  });
+
+  for (std::size_t i = 0; i < used; ++i)
+    diag.merge(std::move(results[i].diag));
+  return tokens;
+}
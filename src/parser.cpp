@@ -1,12 +1,13 @@
-#include <cstdlib> // use for std::exit
-#include <istream>
+#include <algorithm>
 #include <variant>
 
 #include "common.hpp"
 #include "fmt/core.h"
 #include "lexer/lexer.hpp"
+#include "lexer/parallel_lexer.hpp"
 #include "lexer/token.hpp"
 #include "parser/parser.hpp"
+#include "support/thread_pool.hpp"
 
 /* Grammars:
 | "<<" | ">>" (5)    TODO: need implementation
@@ -129,44 +130,189 @@ std::string to_string(TokenKind kind) {
   }
 }
 
-Parser::Parser(std::istream &file, Diagnostics &diag, CigridFlags &flags)
-    : flags(flags), diag(diag), source(read_stream(file)), lexer(source, diag) {
+std::vector<std::size_t> find_global_boundaries(std::span<const Token> tokens) {
+  std::vector<std::size_t> starts;
+  std::size_t depth = 0;
+  bool at_start = true;
+  for (std::size_t i = 0; i < tokens.size(); ++i) {
+    if (at_start) {
+      starts.push_back(i);
+      at_start = false;
+    }
+    switch (tokens[i].kind) {
+    case TokenKind::LBRACE:
+      ++depth;
+      break;
+    case TokenKind::RBRACE:
+      // The '}' of a struct is followed by the ';' that ends it
+      if (depth > 0 && --depth == 0)
+        at_start = i + 1 < tokens.size() &&
+                   tokens[i + 1].kind != TokenKind::SEMICOLON;
+      break;
+    case TokenKind::SEMICOLON:
+      at_start = depth == 0;
+      break;
+    default:
+      break;
+    }
+  }
+  return starts;
+}
+
+template <typename Builder>
+BasicParser<Builder>::BasicParser(const SourceManager &sources, FileId file,
+                                  Diagnostics &diag, const CigridFlags &flags)
+    : flags(flags), diag(diag), sources(sources),
+      lexer(sources, file, diag,
+            flags.dfa_lexer ? LexerEngine::DFA : LexerEngine::SWITCH),
+      file(file) {
+  // Debug output follows the tokens one by one, so it parses sequentially
+  bool parse_parallel = flags.parse_threads > 1 && !flags.debug;
+  auto threads = std::max(flags.lex_threads, flags.parse_threads);
+  if (flags.lex_threads > 1 || parse_parallel)
+    pool = std::make_unique<ThreadPool>(threads);
+  if (flags.lex_threads > 1) {
+    pre_lexed = lex_parallel(
+        sources, file, diag, *pool,
+        flags.dfa_lexer ? LexerEngine::DFA : LexerEngine::SWITCH);
+  } else if (parse_parallel) {
+    // Lexed token by token as the parser would, so diagnostics are the same
+    do
+      pre_lexed.push_back(lexer.next_token().value());
+    while (pre_lexed.back().kind != TokenKind::END_OF_FILE &&
+           pre_lexed.back().kind != TokenKind::BAD);
+  }
+  if (!pre_lexed.empty()) {
+    // The stream ends in END_OF_FILE or BAD, which then keeps coming back
+    from_tokens = true;
+    tokens = std::span<const Token>(pre_lexed).first(pre_lexed.size() - 1);
+    end_token = pre_lexed.back();
+  }
+  start();
+}
+
+template <typename Builder>
+BasicParser<Builder>::BasicParser(SourceManager &sources, FileId file,
+                                  StreamLexer::ReadFn read, Diagnostics &diag,
+                                  const CigridFlags &flags)
+    : flags(flags), diag(diag), sources(sources),
+      lexer(sources, file, diag,
+            flags.dfa_lexer ? LexerEngine::DFA : LexerEngine::SWITCH),
+      file(file), stream(std::make_unique<StreamLexer>(
+                      sources, file, std::move(read), diag,
+                      flags.dfa_lexer ? LexerEngine::DFA : LexerEngine::SWITCH)) {
+  start();
+}
+
+template <typename Builder>
+BasicParser<Builder>::BasicParser(const SourceManager &sources, FileId file,
+                                  Diagnostics &diag, const CigridFlags &flags,
+                                  std::span<const Token> tokens,
+                                  Token end_token)
+    : flags(flags), diag(diag), sources(sources),
+      lexer(sources, file, diag,
+            flags.dfa_lexer ? LexerEngine::DFA : LexerEngine::SWITCH),
+      file(file), from_tokens(true), tokens(tokens), end_token(end_token) {
+  start();
+}
 
+template <typename Builder>
+auto BasicParser<Builder>::start() -> void {
   advance();
-  if (flags.debug) {
+  if (flags.debug && !failed) {
     fmt::print("Parser initialized.\n");
-    fmt::print("The first token is: {}\n", current_token.lexeme);
+    fmt::print("The first token is: {}\n", lexeme(current_token));
   }
 }
-auto Parser::read_stream(std::istream &file) -> std::string {
-  return std::string((std::istreambuf_iterator<char>(file)),
-                     std::istreambuf_iterator<char>());
-}
 
-auto Parser::parse() -> std::unique_ptr<Prog> {
+template <typename Builder>
+auto BasicParser<Builder>::parse() -> Result {
+  if (pool && flags.parse_threads > 1 && from_tokens && !flags.debug &&
+      !failed) {
+    if (auto prog = parse_parallel())
+      return prog;
+  }
   auto prog = parse_prog();
   expect(TokenKind::END_OF_FILE);
+  if (failed)
+    return {};
   return prog;
 }
 
-auto Parser::advance() -> void {
+template <typename Builder>
+auto BasicParser<Builder>::parse_parallel() -> Result {
+  auto starts = find_global_boundaries(tokens);
+  // Runs of whole globals of about equal token counts, a few per thread so
+  // that uneven runs balance out
+  auto runs = std::min<std::size_t>(pool->size() * 4, starts.size());
+  if (runs < 2)
+    return {};
+  std::vector<std::size_t> cuts{0};
+  for (auto start : starts) {
+    if (start >= cuts.back() + tokens.size() / runs)
+      cuts.push_back(start);
+  }
+  cuts.push_back(tokens.size());
+
+  std::vector<Result> parts(cuts.size() - 1);
+  pool->parallel_for(parts.size(), [&](std::size_t i) {
+    // A run sees the end of the file where the next one begins. Its errors
+    // are dropped, the sequential parse reports them in order.
+    auto end = end_token;
+    if (cuts[i + 1] < tokens.size()) {
+      end = tokens[cuts[i + 1]];
+      end.kind = TokenKind::END_OF_FILE;
+    }
+    Diagnostics run_diag;
+    BasicParser run(sources, file, run_diag, flags,
+                    tokens.subspan(cuts[i], cuts[i + 1] - cuts[i]), end);
+    parts[i] = run.parse();
+  });
+  for (const auto &part : parts) {
+    if (!part)
+      return {};
+  }
+  return builder.merge(parts);
+}
+
+template <typename Builder>
+auto BasicParser<Builder>::next_token() -> Token {
+  if (stream)
+    return stream->next_token();
+  if (!from_tokens)
+    return lexer.next_token().value(); // next_token returns std::optional<Token>
+  if (next_index < tokens.size())
+    return tokens[next_index++];
+  return end_token;
+}
+
+template <typename Builder>
+auto BasicParser<Builder>::lexeme(const Token &token) const -> std::string_view {
+  return stream ? stream->lexeme(token) : lexer.lexeme(token);
+}
+
+template <typename Builder>
+auto BasicParser<Builder>::advance() -> void {
+  if (failed)
+    return;
   if (has_peeked) {
     current_token = peek_token;
     has_peeked = false;
   } else
-    current_token =
-        lexer.next_token().value(); // next_token returns std::optional<Token>
+    current_token = next_token();
   if (flags.debug) {
     // TODO: a temp debug print
-    fmt::print("Advanced to token: {}\n", current_token.lexeme);
+    fmt::print("Advanced to token: {}\n", lexeme(current_token));
   }
   if (current_token.kind == TokenKind::BAD) {
-    error(current_token.pos,
-          fmt::format("bad token encountered, {}", current_token.lexeme));
+    error(location(),
+          fmt::format("bad token encountered, {}",
+                      lexeme(current_token)));
   }
 }
 
-auto Parser::expect(TokenKind kind) -> void {
+template <typename Builder>
+auto BasicParser<Builder>::expect(TokenKind kind) -> void {
   if (current_token.kind == kind) {
     advance();
   } else {
@@ -174,92 +320,82 @@ auto Parser::expect(TokenKind kind) -> void {
     // need implementation of fmt::format for TokenKind, or implement a
     // to_string method for TokenKind
     // TODO: what is the difference between enum and enum class?
-    error(current_token.pos,
+    error(location(),
           fmt::format("Expected token kind {}, but got {}", to_string(kind),
                       to_string(current_token.kind)));
   }
 }
 
-auto Parser::error(Position pos, std::string message) -> void {
-  // diag.error(pos, message);
-  if (flags.line_error) {
-    fmt::print(stderr, "{}", pos.line);
-  }
-  if (flags.debug) {
-    fmt::print(stderr, "Error at {}:{}: {}\n", pos.line, pos.column, message);
-  }
-  // TODO: a better way to handle errors
-  std::exit(1);
+template <typename Builder>
+auto BasicParser<Builder>::error(SourceLoc loc, std::string message) -> void {
+  // Only the first error is reported, the rest would follow from it
+  if (failed)
+    return;
+  failed = true;
+  diag.error(Phase::Parse, loc, message);
+  first_error = ParseError{loc, std::move(message)};
+  // Unwind: every loop stops at END_OF_FILE and advance() no longer moves,
+  // so the remaining parse functions return without consuming anything
+  current_token.kind = TokenKind::END_OF_FILE;
+  peek_token = current_token;
+  has_peeked = true;
 }
 
-auto Parser::peek(int num) -> const Token & {
+template <typename Builder>
+auto BasicParser<Builder>::peek(int num) -> const Token & {
   if (!has_peeked && num == 1) {
-    peek_token = lexer.next_token().value();
+    peek_token = next_token();
     has_peeked = true;
   }
   return peek_token;
 }
 
-auto Parser::parse_ident() -> std::string {
-  auto pos = current_token.pos;
-  // TODO: 这个bug记录一下：
-  //   bug 原因是调用 advance() 后访问了 std::variant 中被覆盖的内部指针，导致返回的标识符字符串变成悬垂引用并打印出乱码。
-  // 补充建议：先 std::move 提取字符串再调用 advance() 可避免该问题
-  // GPT找到这一段，还有总结好的bug详细解析
-  // 也还有点没完全搞懂
-
-  // if (auto *name = std::get_if<std::string>(&current_token.value)) {
-  //   advance();
-  //   return *name;
-  // } 
-  if (std::holds_alternative<std::string>(current_token.value)){
-    std::string ident = std::move(std::get<std::string>(current_token.value));
+template <typename Builder>
+auto BasicParser<Builder>::parse_ident() -> Symbol {
+  if (current_token.kind == TokenKind::IDENTIFIER) {
+    Symbol ident{current_token.payload};
     advance();
     return ident;
   } else {
-    error(pos, "fail to parse identifier token");
+    error(location(), "fail to parse identifier token");
   }
-  return ""; // unreachable, but needed to satisfy the return type
+  return Symbol{0}; // unreachable, but needed to satisfy the return type
 }
-auto Parser::parse_ty() -> std::unique_ptr<TypeNode> {
-  auto pos = current_token.pos;
-  std::unique_ptr<TypeNode> result;
+template <typename Builder>
+auto BasicParser<Builder>::parse_ty() -> Type {
+  auto loc = location();
+  Type result = Builder::none;
   switch (current_token.kind) {
   case TokenKind::VOID:
     advance();
-    result = std::make_unique<TypeNode>(TVoid{pos});
+    result = builder.type_void(loc);
     break;
   case TokenKind::INT:
     advance();
-    result = std::make_unique<TypeNode>(TInt{pos});
+    result = builder.type_int(loc);
     break;
   case TokenKind::CHAR:
     advance();
-    result = std::make_unique<TypeNode>(TChar{pos});
+    result = builder.type_char(loc);
+    break;
+  case TokenKind::IDENTIFIER:
+    result = builder.type_ident(loc, Symbol{current_token.payload});
+    advance();
     break;
-  case TokenKind::IDENTIFIER: {
-    if (auto *name = std::get_if<std::string>(&current_token.value)) {
-      result = std::make_unique<TypeNode>(TIdent{pos, *name});
-      advance();
-      break;
-    } else {
-      error(pos, fmt::format("Expected an identifier for type, but got {}",
-                             to_string(current_token.kind)));
-    }
-  }
   default:
-    error(pos, fmt::format("Expected a type token, but got {}",
+    error(loc, fmt::format("Expected a type token, but got {}",
                            to_string(current_token.kind)));
   }
   while (current_token.kind == TokenKind::MULTIPLY) {
-    pos = current_token.pos;
-    result = std::make_unique<TypeNode>(TPoint{pos, std::move(result)});
+    loc = location();
+    result = builder.type_point(loc, result);
     advance();
   }
 
   return result;
 }
-auto Parser::is_type_token() const -> bool {
+template <typename Builder>
+auto BasicParser<Builder>::is_type_token() const -> bool {
   using enum TokenKind;
   switch (current_token.kind) {
   case CHAR:
@@ -273,7 +409,8 @@ auto Parser::is_type_token() const -> bool {
   }
 };
 
-auto Parser::is_type_token(const Token &token) const -> bool {
+template <typename Builder>
+auto BasicParser<Builder>::is_type_token(const Token &token) const -> bool {
   using enum TokenKind;
   switch (token.kind) {
   case CHAR:
@@ -287,22 +424,24 @@ auto Parser::is_type_token(const Token &token) const -> bool {
   }
 }
 
-auto Parser::is_binop() const -> bool {
-  return precedence.find(current_token.kind) != precedence.end();
+template <typename Builder>
+auto BasicParser<Builder>::is_binop() const -> bool {
+  return precedence[current_token.kind] > 0;
 }
 
-auto Parser::is_binop(const TokenKind &kind) const -> bool {
-  return precedence.find(kind) != precedence.end();
+template <typename Builder>
+auto BasicParser<Builder>::is_binop(const TokenKind &kind) const -> bool {
+  return precedence[kind] > 0;
 }
 
-auto Parser::parse_bop() -> Bop {
+template <typename Builder>
+auto BasicParser<Builder>::parse_bop() -> Bop {
   // Map current TokenKind to ast Bop
-  auto sth = bop_map.find(current_token.kind);
-  if (sth != bop_map.end()) {
+  if (auto op = bop_map[current_token.kind]) {
     advance();
-    return sth->second;
+    return *op;
   } else {
-    error(current_token.pos,
+    error(location(),
           fmt::format("Expected a binary operator, but got {}",
                       to_string(current_token.kind)));
   }
@@ -310,14 +449,14 @@ auto Parser::parse_bop() -> Bop {
   return Bop::NOT; // unreachable, but needed to satisfy the return type
 }
 
-auto Parser::parse_uop() -> Uop {
+template <typename Builder>
+auto BasicParser<Builder>::parse_uop() -> Uop {
   // Map current TokenKind to ast Uop
-  auto sth = uop_map.find(current_token.kind);
-  if (sth != uop_map.end()) {
+  if (auto op = uop_map[current_token.kind]) {
     advance();
-    return sth->second;
+    return *op;
   } else {
-    error(current_token.pos,
+    error(location(),
           fmt::format("Expected a unary operator, but got {}",
                       to_string(current_token.kind)));
   }
@@ -330,164 +469,222 @@ auto Parser::parse_uop() -> Uop {
 // | unop expr (9)
 // | Ident "(" [ expr { "," expr } ] ")" (10)
 // | "new" ty "[" expr "]" (11)
+// | Ident "[" expr "]" ["." Ident] (12)
 // | "(" expr ")" (13)
-// expr is parsed as atom()
-auto Parser::parse_atom() -> std::unique_ptr<ExprNode> {
-  if (current_token.kind == TokenKind::IDENTIFIER) {
-    if (peek(1).kind == TokenKind::LBRACKET) {
-      // array access
-      return parse_expr_array_access();
-    } else if (peek(1).kind == TokenKind::LPAREN) {
-      // function call
-      return parse_expr_function_call();
-    } else {
-      // variable
-      return parse_expr_var();
-    }
-  }
-  if (current_token.kind == TokenKind::INT_LITERAL ||
-      current_token.kind == TokenKind::CHAR_LITERAL ||
-      current_token.kind == TokenKind::STRING_LITERAL) {
-    // constant
-    return parse_expr_constant();
-  }
-  if (current_token.kind == TokenKind::NOT ||
-      current_token.kind == TokenKind::BITWISE_NOT ||
-      current_token.kind == TokenKind::MINUS) {
-    // unop
-    return parse_expr_unop();
-  }
-
-  if (current_token.kind == TokenKind::LPAREN) {
-    // parenthesized expression
-    return parse_expr_in_paren();
-  }
-  if (current_token.kind == TokenKind::NEW) {
-    return parse_expr_new();
-  } else {
-    error(current_token.pos, fmt::format("Expected an expression, but got {}",
-                                         to_string(current_token.kind)));
-  }
-
-  return nullptr; // unreachable, but needed to satisfy the return type
-}
+// A unary operator applies to the operand right after it, binary operators
+// are climbed by precedence.
 
 // expr → UInt | Char | String (7)
-auto Parser::parse_expr_constant() -> std::unique_ptr<ExprNode> {
-  auto pos = current_token.pos;
-  auto token_value_visitor = overload{
-      [=, this](int value) {
-        advance();
-        return std::make_unique<ExprNode>(EInt{pos, value});
-      },
-      [=, this](char value) {
-        advance();
-        return std::make_unique<ExprNode>(EChar{pos, value});
-      },
-      [=, this](std::string value) {
-        advance();
-        return std::make_unique<ExprNode>(EString{pos, std::move(value)});
-      },
-      // default case
-      [=, this](auto &&) -> std::unique_ptr<ExprNode> {
-        error(pos, "unsupported token type");
-        return nullptr; // unreachable, but needed to satisfy the return type
-      }};
-  // Note: current_token.value is a std::variant<std::monostate, int, char,
-  // std::string> The visitor will handle the different types and return the
-  // appropriate ExprNode type.
-  return std::visit(token_value_visitor, current_token.value);
-}
-
-// expr → Ident (7)
-auto Parser::parse_expr_var() -> std::unique_ptr<ExprNode> {
-  // use get_if to access variant
-  if (auto *name = std::get_if<std::string>(&current_token.value)) {
+template <typename Builder>
+auto BasicParser<Builder>::parse_expr_constant() -> Expr {
+  auto loc = location();
+  auto token = current_token;
+  switch (token.kind) {
+  case TokenKind::INT_LITERAL:
     advance();
-    return std::make_unique<ExprNode>(EVar{current_token.pos, *name});
+    return builder.expr_int(loc, token.int_value());
+  case TokenKind::CHAR_LITERAL:
+    advance();
+    return builder.expr_char(loc, token.char_value());
+  case TokenKind::STRING_LITERAL:
+    advance();
+    return builder.expr_string(loc, Symbol{token.payload});
+  default:
+    error(loc, "unsupported token type");
   }
-  // There should be no case where current_token.value is not a string here,
-  // since we already checked that current_token.kind is IDENTIFIER.
-  return nullptr; // unreachable, but needed to satisfy the return type
+  return {}; // unreachable, but needed to satisfy the return type
 }
 
-// | unop expr (9)
-auto Parser::parse_expr_unop() -> std::unique_ptr<ExprNode> {
-  auto pos = current_token.pos;
-  auto op = parse_uop();
-  auto rhs = parse_atom();
-  return std::make_unique<ExprNode>(EUnOp{pos, op, std::move(rhs)});
+// expr → Ident (7)
+template <typename Builder>
+auto BasicParser<Builder>::parse_expr_var() -> Expr {
+  auto loc = location();
+  auto name = parse_ident();
+  return builder.expr_var(loc, name);
 }
 
-// | Ident "(" [ expr { "," expr } ] ")" (10)
-auto Parser::parse_expr_function_call() -> std::unique_ptr<ExprNode> {
-  auto pos = current_token.pos;
-  auto name = parse_ident();
-  expect(TokenKind::LPAREN);
-  std::vector<std::unique_ptr<ExprNode>> args;
-  if (current_token.kind != TokenKind::RPAREN) {
-    args.push_back(parse_expr(1));
-    while (current_token.kind == TokenKind::COMMA) {
+template <typename Builder>
+auto BasicParser<Builder>::parse_operand(Operand &operand) -> void {
+  while (true) {
+    auto loc = location();
+    switch (current_token.kind) {
+    case TokenKind::IDENTIFIER:
+      if (peek(1).kind == TokenKind::LBRACKET) {
+        // | Ident "[" expr "]" ["." Ident] (12)
+        auto name = parse_ident();
+        expect(TokenKind::LBRACKET);
+        expr_frames.push_back(
+            {.kind = ExprFrameKind::INDEX, .loc = loc, .name = name});
+        continue;
+      }
+      if (peek(1).kind == TokenKind::LPAREN) {
+        // | Ident "(" [ expr { "," expr } ] ")" (10)
+        auto name = parse_ident();
+        expect(TokenKind::LPAREN);
+        if (current_token.kind != TokenKind::RPAREN) {
+          expr_frames.push_back({.kind = ExprFrameKind::CALL,
+                                 .loc = loc,
+                                 .name = name,
+                                 .mark = expr_scratch.size()});
+          continue;
+        }
+        expect(TokenKind::RPAREN);
+        operand = {builder.expr_call(loc, name, {}), loc};
+        return;
+      }
+      operand = {parse_expr_var(), loc};
+      return;
+    case TokenKind::INT_LITERAL:
+    case TokenKind::CHAR_LITERAL:
+    case TokenKind::STRING_LITERAL:
+      operand = {parse_expr_constant(), loc};
+      return;
+    case TokenKind::NOT:
+    case TokenKind::BITWISE_NOT:
+    case TokenKind::MINUS:
+      // | unop expr (9)
+      expr_frames.push_back(
+          {.kind = ExprFrameKind::UNARY, .loc = loc, .uop = parse_uop()});
+      continue;
+    case TokenKind::LPAREN:
+      // | "(" expr ")" (13)
+      advance();
+      expr_frames.push_back({.kind = ExprFrameKind::PAREN, .loc = loc});
+      continue;
+    case TokenKind::NEW: {
+      // | "new" ty "[" expr "]" (11)
       advance();
-      args.push_back(parse_expr(1)); // parse next argument
+      auto type = parse_ty();
+      expect(TokenKind::LBRACKET);
+      expr_frames.push_back(
+          {.kind = ExprFrameKind::NEW, .loc = loc, .type = type});
+      continue;
+    }
+    default:
+      error(loc, fmt::format("Expected an expression, but got {}",
+                             to_string(current_token.kind)));
+      operand = {Builder::none, loc};
+      return;
     }
   }
-  expect(TokenKind::RPAREN);
-  return std::make_unique<ExprNode>(
-      ECall{pos, std::move(name), std::move(args)});
 }
 
-// | "new" ty "[" expr "]" (11)
-auto Parser::parse_expr_new() -> std::unique_ptr<ExprNode> {
-  auto pos = current_token.pos;
-  advance();
-  auto type = parse_ty();
-  expect(TokenKind::LBRACKET);
-  auto index = parse_expr(1);
-  expect(TokenKind::RBRACKET);
-  return std::make_unique<ExprNode>(
-      ENew{pos, std::move(type), std::move(index)});
-}
+template <typename Builder>
+auto BasicParser<Builder>::reduce_operand(Operand &operand, std::size_t base)
+    -> bool {
+  // Folds the BINARY frame on top, `operand` being its right operand
+  auto reduce_binary = [&] {
+    const auto &frame = expr_frames.back();
+    operand = {builder.expr_bin_op(frame.loc, frame.bop, frame.lhs,
+                                   operand.expr),
+               frame.loc};
+    expr_frames.pop_back();
+  };
+  auto top_is = [&](ExprFrameKind kind) {
+    return expr_frames.size() > base && expr_frames.back().kind == kind;
+  };
 
-// | Ident "[" expr "]" ["." Ident] (12)
-auto Parser::parse_expr_array_access() -> std::unique_ptr<ExprNode> {
-  auto pos = current_token.pos;
-  auto name = parse_ident();
-  expect(TokenKind::LBRACKET);
-  auto index = parse_expr(1);
-  expect(TokenKind::RBRACKET);
-  std::optional<std::string> label;
-  if (current_token.kind == TokenKind::PERIOD) {
-    advance();
-    label = parse_ident();
+  while (true) {
+    if (failed) {
+      unwind_expr(base);
+      operand.expr = Builder::none;
+      return false;
+    }
+    if (top_is(ExprFrameKind::UNARY)) {
+      const auto &frame = expr_frames.back();
+      operand = {builder.expr_un_op(frame.loc, frame.uop, operand.expr),
+                 frame.loc};
+      expr_frames.pop_back();
+      continue;
+    }
+    if (is_binop()) {
+      // Operators waiting for a right operand that binds tighter than this
+      // one take `operand` as theirs
+      auto prec = precedence[current_token.kind];
+      while (top_is(ExprFrameKind::BINARY) &&
+             prec < expr_frames.back().precedence)
+        reduce_binary();
+      auto min_precedence = prec + associativity[current_token.kind];
+      expr_frames.push_back({.kind = ExprFrameKind::BINARY,
+                             .loc = operand.loc,
+                             .bop = parse_bop(),
+                             .precedence = min_precedence,
+                             .lhs = operand.expr});
+      return true;
+    }
+    while (top_is(ExprFrameKind::BINARY))
+      reduce_binary();
+    if (expr_frames.size() == base)
+      return false;
+
+    // The expression nested in the frame on top is complete
+    auto frame = expr_frames.back();
+    expr_frames.pop_back();
+    switch (frame.kind) {
+    case ExprFrameKind::PAREN:
+      expect(TokenKind::RPAREN);
+      operand.loc = frame.loc;
+      break;
+    case ExprFrameKind::INDEX: {
+      expect(TokenKind::RBRACKET);
+      std::optional<Symbol> label;
+      if (current_token.kind == TokenKind::PERIOD) {
+        advance();
+        label = parse_ident();
+      }
+      operand = {builder.expr_array_access(frame.loc, frame.name,
+                                           operand.expr, label),
+                 frame.loc};
+      break;
+    }
+    case ExprFrameKind::NEW:
+      expect(TokenKind::RBRACKET);
+      operand = {builder.expr_new(frame.loc, frame.type, operand.expr),
+                 frame.loc};
+      break;
+    case ExprFrameKind::CALL: {
+      expr_scratch.push_back(operand.expr);
+      if (current_token.kind == TokenKind::COMMA) {
+        // parse next argument
+        advance();
+        expr_frames.push_back(frame);
+        return true;
+      }
+      expect(TokenKind::RPAREN);
+      auto args = std::span<const Expr>(expr_scratch).subspan(frame.mark);
+      operand = {builder.expr_call(frame.loc, frame.name, args), frame.loc};
+      expr_scratch.resize(frame.mark);
+      break;
+    }
+    case ExprFrameKind::UNARY:
+    case ExprFrameKind::BINARY:
+      break; // folded above
+    }
   }
-  return std::make_unique<ExprNode>(
-      EArrayAccess{pos, std::move(name), std::move(index), std::move(label)});
 }
 
-// | "(" expr ")" (13)
-auto Parser::parse_expr_in_paren() -> std::unique_ptr<ExprNode> {
-  advance();
-  auto expr = parse_expr(1);
-  expect(TokenKind::RPAREN);
-  return expr;
-}
-
-auto Parser::parse_expr(int min_precedence) -> std::unique_ptr<ExprNode> {
-  auto pos = current_token.pos;
-  auto lhs = parse_atom();
-  while (true) {
-    if (!is_binop() || precedence.at(current_token.kind) < min_precedence) {
+template <typename Builder>
+auto BasicParser<Builder>::unwind_expr(std::size_t base) -> void {
+  for (auto i = base; i < expr_frames.size(); ++i) {
+    if (expr_frames[i].kind == ExprFrameKind::CALL) {
+      expr_scratch.resize(expr_frames[i].mark);
       break;
     }
-    auto prec = precedence.at(current_token.kind);
-    auto assoc = associativity.at(current_token.kind);
-    auto op = parse_bop();
-    auto rhs = parse_expr(prec + assoc);
-    lhs = std::make_unique<ExprNode>(
-        EBinOp{pos, op, std::move(lhs), std::move(rhs)});
   }
-  return lhs;
+  expr_frames.erase(expr_frames.begin() + base, expr_frames.end());
+}
+
+// Every construct that nests an expression pushes a frame on expr_frames
+// instead of recursing: parse_operand() opens them up to the next plain
+// operand, reduce_operand() closes those that operand completes.
+template <typename Builder>
+auto BasicParser<Builder>::parse_expr() -> Expr {
+  auto base = expr_frames.size();
+  Operand operand;
+  do
+    parse_operand(operand);
+  while (reduce_operand(operand, base));
+  return operand.expr;
 }
 
 // stmt → varassign ";" (14)
@@ -498,150 +695,225 @@ auto Parser::parse_expr(int min_precedence) -> std::unique_ptr<ExprNode> {
 // | "return" [ expr ] ";" (19)
 // | "delete" "[" "]" Ident ";" (20)
 // | "for" "(" varassign ";" expr ";" assign ")" stmt (21)
-auto Parser::parse_stmt() -> std::unique_ptr<StmtNode> {
-  if (current_token.kind == TokenKind::LBRACE) {
-    return parse_stmt_scope();
-  }
-  if (current_token.kind == TokenKind::IF) {
-    return parse_stmt_if();
-  }
-  if (current_token.kind == TokenKind::WHILE) {
-    return parse_stmt_while();
-  }
-  if (current_token.kind == TokenKind::BREAK) {
-    return parse_stmt_break();
-  }
-  if (current_token.kind == TokenKind::RETURN) {
-    return parse_stmt_return();
-  }
-  if (current_token.kind == TokenKind::DELETE) {
-    return parse_stmt_delete();
-  }
-  if (current_token.kind == TokenKind::FOR) {
-    return parse_stmt_for();
-  } else {
-    // parse varassign
-    auto varassign = parse_varassign();
-    expect(TokenKind::SEMICOLON);
-    return varassign;
+// The heads of compound statements push a frame on stmt_frames instead of
+// recursing, and each statement parsed is folded into the frame on top.
+template <typename Builder>
+auto BasicParser<Builder>::parse_stmt() -> Stmt {
+  auto base = stmt_frames.size();
+  Stmt stmt = Builder::none;
+  bool at_head = true;
+  while (true) {
+    if (at_head) {
+      switch (current_token.kind) {
+      case TokenKind::LBRACE:
+        parse_stmt_scope();
+        if (current_token.kind == TokenKind::RBRACE) {
+          stmt = finish_stmt_scope();
+          at_head = false;
+        }
+        continue;
+      case TokenKind::IF:
+        parse_stmt_if();
+        continue;
+      case TokenKind::WHILE:
+        parse_stmt_while();
+        continue;
+      case TokenKind::FOR:
+        parse_stmt_for();
+        continue;
+      case TokenKind::BREAK:
+        stmt = parse_stmt_break();
+        break;
+      case TokenKind::RETURN:
+        stmt = parse_stmt_return();
+        break;
+      case TokenKind::DELETE:
+        stmt = parse_stmt_delete();
+        break;
+      default:
+        // parse varassign
+        stmt = parse_varassign();
+        expect(TokenKind::SEMICOLON);
+        break;
+      }
+      at_head = false;
+    }
+    if (failed) {
+      unwind_stmt(base);
+      return Builder::none;
+    }
+    if (stmt_frames.size() == base)
+      return stmt;
+
+    auto &frame = stmt_frames.back();
+    switch (frame.kind) {
+    case StmtFrameKind::SCOPE:
+      stmt_scratch.push_back(stmt);
+      if (current_token.kind != TokenKind::RBRACE) {
+        at_head = true;
+        continue;
+      }
+      stmt = finish_stmt_scope();
+      break;
+    case StmtFrameKind::THEN:
+      if (current_token.kind == TokenKind::ELSE) {
+        advance(); // consume ELSE
+        frame.kind = StmtFrameKind::ELSE;
+        frame.stmt = stmt;
+        at_head = true;
+        continue;
+      }
+      stmt = builder.stmt_if(frame.loc, frame.cond, stmt, Builder::none);
+      stmt_frames.pop_back();
+      break;
+    case StmtFrameKind::ELSE:
+      stmt = builder.stmt_if(frame.loc, frame.cond, frame.stmt, stmt);
+      stmt_frames.pop_back();
+      break;
+    case StmtFrameKind::WHILE:
+      stmt = builder.stmt_while(frame.loc, frame.cond, stmt);
+      stmt_frames.pop_back();
+      break;
+    case StmtFrameKind::FOR: {
+      Stmt stmts_and_update[] = {stmt, frame.assign};
+      auto s_body = builder.stmt_scope(frame.loc, stmts_and_update);
+      auto s_while = builder.stmt_while(frame.loc, frame.cond, s_body);
+      Stmt s_for[] = {frame.stmt, s_while};
+      stmt = builder.stmt_scope(frame.loc, s_for);
+      stmt_frames.pop_back();
+      break;
+    }
+    }
   }
 }
 
 // | "{" { stmt } "}" (15)
-auto Parser::parse_stmt_scope() -> std::unique_ptr<StmtNode> {
-  auto pos = current_token.pos;
+template <typename Builder>
+auto BasicParser<Builder>::parse_stmt_scope() -> void {
+  auto loc = location();
   advance(); // consume LBRACE
-  std::vector<std::unique_ptr<StmtNode>> stmts;
-  while (current_token.kind != TokenKind::RBRACE) {
-    stmts.push_back(parse_stmt());
-  }
+  stmt_frames.push_back({.kind = StmtFrameKind::SCOPE,
+                         .loc = loc,
+                         .mark = stmt_scratch.size()});
+}
+
+template <typename Builder>
+auto BasicParser<Builder>::finish_stmt_scope() -> Stmt {
+  auto frame = stmt_frames.back();
+  stmt_frames.pop_back();
   expect(TokenKind::RBRACE);
-  return std::make_unique<StmtNode>(SScope{pos, std::move(stmts)});
+  auto stmts = std::span<const Stmt>(stmt_scratch).subspan(frame.mark);
+  auto scope = builder.stmt_scope(frame.loc, stmts);
+  stmt_scratch.resize(frame.mark);
+  return scope;
 }
 
 // | "if" "(" expr ")" stmt [ "else" stmt ] (16)
-auto Parser::parse_stmt_if() -> std::unique_ptr<StmtNode> {
-  auto pos = current_token.pos;
+template <typename Builder>
+auto BasicParser<Builder>::parse_stmt_if() -> void {
+  auto loc = location();
   advance(); // consume IF
   expect(TokenKind::LPAREN);
-  auto cond = parse_expr(1);
+  auto cond = parse_expr();
   expect(TokenKind::RPAREN);
-  auto then_branch = parse_stmt();
-  std::unique_ptr<StmtNode> else_branch = nullptr;
-  if (current_token.kind == TokenKind::ELSE) {
-    advance(); // consume ELSE
-    else_branch = parse_stmt();
-  }
-  return std::make_unique<StmtNode>(SIf{
-      pos, std::move(cond), std::move(then_branch), std::move(else_branch)});
+  stmt_frames.push_back(
+      {.kind = StmtFrameKind::THEN, .loc = loc, .cond = cond});
 }
 
 // | "while" "(" expr ")" stmt (17)
-auto Parser::parse_stmt_while() -> std::unique_ptr<StmtNode> {
-  auto pos = current_token.pos;
+template <typename Builder>
+auto BasicParser<Builder>::parse_stmt_while() -> void {
+  auto loc = location();
   advance(); // consume WHILE
   expect(TokenKind::LPAREN);
-  auto cond = parse_expr(1);
+  auto cond = parse_expr();
   expect(TokenKind::RPAREN);
-  auto stmt = parse_stmt();
-  return std::make_unique<StmtNode>(
-      SWhile{pos, std::move(cond), std::move(stmt)});
+  stmt_frames.push_back(
+      {.kind = StmtFrameKind::WHILE, .loc = loc, .cond = cond});
 }
 
 // | "break" ";" (18)
-auto Parser::parse_stmt_break() -> std::unique_ptr<StmtNode> {
-  auto pos = current_token.pos;
+template <typename Builder>
+auto BasicParser<Builder>::parse_stmt_break() -> Stmt {
+  auto loc = location();
   advance(); // consume BREAK
   expect(TokenKind::SEMICOLON);
-  return std::make_unique<StmtNode>(SBreak{pos});
+  return builder.stmt_break(loc);
 }
 
 // | "return" [ expr ] ";" (19)
-auto Parser::parse_stmt_return() -> std::unique_ptr<StmtNode> {
-  auto pos = current_token.pos;
+template <typename Builder>
+auto BasicParser<Builder>::parse_stmt_return() -> Stmt {
+  auto loc = location();
   advance(); // consume RETURN
-    std::unique_ptr<ExprNode> expr = nullptr;
+    Expr expr = Builder::none;
     if (current_token.kind != TokenKind::SEMICOLON) {
-      expr = parse_expr(1);
+      expr = parse_expr();
     }
     expect(TokenKind::SEMICOLON);
-    return std::make_unique<StmtNode>(SReturn{pos, std::move(expr)});
+    return builder.stmt_return(loc, expr);
 }
 
 // | "delete" "[" "]" Ident ";" (20)
-auto Parser::parse_stmt_delete() -> std::unique_ptr<StmtNode> {
-  auto pos = current_token.pos;
+template <typename Builder>
+auto BasicParser<Builder>::parse_stmt_delete() -> Stmt {
+  auto loc = location();
   advance(); // consume DELETE
   expect(TokenKind::LBRACKET);
   expect(TokenKind::RBRACKET);
   auto name = parse_ident();
   expect(TokenKind::SEMICOLON);
-  return std::make_unique<StmtNode>(SDelete{pos, std::move(name)});
+  return builder.stmt_delete(loc, name);
 }
 
 // | "for" "(" varassign ";" expr ";" assign ")" stmt (21)
-auto Parser::parse_stmt_for() -> std::unique_ptr<StmtNode> {
-  auto pos = current_token.pos;
+template <typename Builder>
+auto BasicParser<Builder>::parse_stmt_for() -> void {
+  auto loc = location();
   advance(); // consume FOR
   expect(TokenKind::LPAREN);
   auto varassign = parse_varassign();
   expect(TokenKind::SEMICOLON);
-  auto cond = parse_expr(1);
+  auto cond = parse_expr();
   expect(TokenKind::SEMICOLON);
   auto assign = parse_assign();
   expect(TokenKind::RPAREN);
-  auto stmt = parse_stmt();
+  stmt_frames.push_back({.kind = StmtFrameKind::FOR,
+                         .loc = loc,
+                         .cond = cond,
+                         .stmt = varassign,
+                         .assign = assign});
+}
 
-  auto stmts_and_update = std::vector<std::unique_ptr<StmtNode>>();
-  stmts_and_update.push_back(std::move(stmt));
-  stmts_and_update.push_back(std::move(assign));
-  auto s_body =
-      std::make_unique<StmtNode>(SScope{pos, std::move(stmts_and_update)});
-  auto s_while = std::make_unique<StmtNode>(
-      SWhile{pos, std::move(cond), std::move(s_body)});
-  auto s_for = std::vector<std::unique_ptr<StmtNode>>();
-  s_for.push_back(std::move(varassign));
-  s_for.push_back(std::move(s_while));
-  return std::make_unique<StmtNode>(SScope{pos, std::move(s_for)});
+template <typename Builder>
+auto BasicParser<Builder>::unwind_stmt(std::size_t base) -> void {
+  for (auto i = base; i < stmt_frames.size(); ++i) {
+    if (stmt_frames[i].kind == StmtFrameKind::SCOPE) {
+      stmt_scratch.resize(stmt_frames[i].mark);
+      break;
+    }
+  }
+  stmt_frames.erase(stmt_frames.begin() + base, stmt_frames.end());
 }
 
 // lvalue → Ident | Ident "[" expr "]" [ "." Ident ] (22)
 // assign → lvalue "=" expr | lvalue "++" | lvalue "--" (24)
 // This function not only parse the lvalue, but also return the assign
 // expression
-auto Parser::parse_lvalue() -> std::unique_ptr<StmtNode> {
-  auto pos = current_token.pos;
+template <typename Builder>
+auto BasicParser<Builder>::parse_lvalue() -> Stmt {
+  auto loc = location();
   auto name = parse_ident();
   if (current_token.kind == TokenKind::LBRACKET) {
     // assign to an array elements
     advance(); // consume LBRACKET
-    auto index = parse_expr(1);
+    auto index = parse_expr();
     expect(TokenKind::RBRACKET);
-    std::optional<std::string> label;
+    std::optional<Symbol> label;
     if (current_token.kind == TokenKind::PERIOD) {
       advance(); // consume PERIOD
       if (current_token.kind != TokenKind::IDENTIFIER) {
-        error(current_token.pos,
+        error(location(),
               fmt::format("Expected Identifier after '.', but got {}",
                           to_string(current_token.kind)));
       }
@@ -650,31 +922,27 @@ auto Parser::parse_lvalue() -> std::unique_ptr<StmtNode> {
     // assign to this array element
     if (current_token.kind == TokenKind::ASSIGN) {
       advance();
-      auto value = parse_expr(1);
-      return std::make_unique<StmtNode>(
-          SArrayAssign{pos, std::move(name), std::move(index), std::move(label),
-                       std::move(value)});
+      auto value = parse_expr();
+      return builder.stmt_array_assign(loc, name, index, label, value);
     }
 
     // ++/-- when when the lvalue is an array element
     else if (current_token.kind == TokenKind::PLUS) {
       advance();
       expect(TokenKind::PLUS);
-      return std::make_unique<StmtNode>(SArrayPlusAssign{
-          pos, std::move(name), std::move(index), std::move(label),
-          std::make_unique<ExprNode>(EInt{pos, 1})});
+      return builder.stmt_array_plus_assign(loc, name, index, label,
+                                            builder.expr_int(loc, 1));
     }
 
     else if (current_token.kind == TokenKind::MINUS) {
       advance();
       expect(TokenKind::MINUS);
-      return std::make_unique<StmtNode>(SArrayMinusAssign{
-          pos, std::move(name), std::move(index), std::move(label),
-          std::make_unique<ExprNode>(EInt{pos, 1})});
+      return builder.stmt_array_minus_assign(loc, name, index, label,
+                                             builder.expr_int(loc, 1));
     }
 
     else {
-      error(current_token.pos,
+      error(location(),
             fmt::format("Expected '=', '++' or '--' after lvalue, but got {}",
                         to_string(current_token.kind)));
     }
@@ -682,68 +950,62 @@ auto Parser::parse_lvalue() -> std::unique_ptr<StmtNode> {
     // assign to a variable (lvalue is just a ident)
     if (current_token.kind == TokenKind::ASSIGN) {
       advance();
-      auto value = parse_expr(1);
-      return std::make_unique<StmtNode>(
-          SVarAssign{pos, std::move(name), std::move(value)});
+      auto value = parse_expr();
+      return builder.stmt_var_assign(loc, name, value);
     }
 
     // ident ++/--
     else if (current_token.kind == TokenKind::PLUS) {
       advance();
       expect(TokenKind::PLUS);
-      auto bin_op = std::make_unique<ExprNode>(
-          EBinOp{pos, Bop::PLUS, std::make_unique<ExprNode>(EVar{pos, name}),
-                 std::make_unique<ExprNode>(EInt{pos, 1})});
-      return std::make_unique<StmtNode>(
-          SVarAssign{pos, name, std::move(bin_op)});
+      auto bin_op = builder.expr_bin_op(loc, Bop::PLUS, builder.expr_var(loc, name),
+                                        builder.expr_int(loc, 1));
+      return builder.stmt_var_assign(loc, name, bin_op);
     }
 
     else if (current_token.kind == TokenKind::MINUS) {
       advance();
       expect(TokenKind::MINUS);
-      auto bin_op = std::make_unique<ExprNode>(
-          EBinOp{pos, Bop::MINUS, std::make_unique<ExprNode>(EVar{pos, name}),
-                 std::make_unique<ExprNode>(EInt{pos, 1})});
-      return std::make_unique<StmtNode>(
-          SVarAssign{pos, name, std::move(bin_op)});
+      auto bin_op = builder.expr_bin_op(loc, Bop::MINUS, builder.expr_var(loc, name),
+                                        builder.expr_int(loc, 1));
+      return builder.stmt_var_assign(loc, name, bin_op);
     }
 
     else {
-      error(current_token.pos,
+      error(location(),
             fmt::format("Expected '=', '++' or '--' after lvalue, but got {}",
                         to_string(current_token.kind)));
     }
   }
 
-  return nullptr; // unreachable, but needed to satisfy the return type
+  return {}; // unreachable, but needed to satisfy the return type
 }
 
 // assign → Ident "(" [ expr { "," expr } ] ")" (23)
 // | lvalue "=" expr | lvalue "++" | lvalue "--" (24)
-auto Parser::parse_assign() -> std::unique_ptr<StmtNode> {
-  auto pos = current_token.pos;
+template <typename Builder>
+auto BasicParser<Builder>::parse_assign() -> Stmt {
+  auto loc = location();
   if (current_token.kind != TokenKind::IDENTIFIER) {
-    error(current_token.pos,
+    error(location(),
           fmt::format("Expected Identifier to be assigned, but got {}",
                       to_string(current_token.kind)));
-    return nullptr; // unreachable, but needed to satisfy the return type
+    return {}; // unreachable, but needed to satisfy the return type
   } else {
     if (peek(1).kind == TokenKind::LPAREN) {
       // function call
       auto name = parse_ident();
       advance(); // consume LPAREN
-      std::vector<std::unique_ptr<ExprNode>> args;
+      ScratchList<Expr> args(expr_scratch);
       if (current_token.kind != TokenKind::RPAREN) {
-        args.push_back(parse_expr(1));
+        args.push_back(parse_expr());
         while (current_token.kind == TokenKind::COMMA) {
           advance();
-          args.push_back(parse_expr(1));
+          args.push_back(parse_expr());
         }
       }
       expect(TokenKind::RPAREN);
-      return std::make_unique<StmtNode>(
-          SExpr{pos, std::make_unique<ExprNode>(
-                         ECall{pos, std::move(name), std::move(args)})});
+      return builder.stmt_expr(loc, builder.expr_call(loc, name, args));
     } else {
       return parse_lvalue();
     }
@@ -751,8 +1013,9 @@ auto Parser::parse_assign() -> std::unique_ptr<StmtNode> {
 }
 
 // varassign → ty Ident "=" expr | assign (25)
-auto Parser::parse_varassign() -> std::unique_ptr<StmtNode> {
-  auto pos = current_token.pos;
+template <typename Builder>
+auto BasicParser<Builder>::parse_varassign() -> Stmt {
+  auto loc = location();
   // varassign starts with ty, all assign starts with Ident, but Ident is a
   // part of ty, so use peek to check if the token after ty is Idnet
   // note that ty can be TPoint, so peek(1) may be * instead of IDENTIFIER
@@ -763,31 +1026,29 @@ auto Parser::parse_varassign() -> std::unique_ptr<StmtNode> {
       auto type = parse_ty();
       auto name = parse_ident();
       expect(TokenKind::ASSIGN);
-      auto value = parse_expr(1);
-      return std::make_unique<StmtNode>(
-          SVarAssign{pos, std::move(name), std::move(value)});
+      auto value = parse_expr();
+      return builder.stmt_var_def(loc, type, name, value);
     } else {
       return parse_assign();
     }
   } else {
-    error(current_token.pos,
+    error(location(),
           fmt::format("Expected type token or Identifier, but got {}",
                       to_string(current_token.kind)));
   }
-  return nullptr; // unreachable, but needed to satisfy the return type
+  return {}; // unreachable, but needed to satisfy the return type
 }
 
 // params → [ ty Ident { "," ty Ident } ] (26)
-auto Parser::parse_params() -> std::vector<Parameter> {
-  auto result = std::vector<Parameter>();
+template <typename Builder>
+auto BasicParser<Builder>::parse_params(ScratchList<Param> &params) -> void {
   if (is_type_token()) {
-    result.push_back(Parameter{parse_ty(), parse_ident()});
+    params.push_back(Param{parse_ty(), parse_ident()});
     while (current_token.kind == TokenKind::COMMA) {
       advance();
-      result.push_back(Parameter{parse_ty(), parse_ident()});
+      params.push_back(Param{parse_ty(), parse_ident()});
     }
   }
-  return result;
 }
 
 // global → ty Ident "(" params ")" "{" { stmt } "}" (27)
@@ -795,7 +1056,8 @@ auto Parser::parse_params() -> std::vector<Parameter> {
 // | ty Ident "=" expr ";" (29)
 // | "extern" ty Ident ";" (30)
 // | "struct" Ident "{" { ty Ident ";" } "}" ";" (31)
-auto Parser::parse_global() -> std::unique_ptr<GlobalNode> {
+template <typename Builder>
+auto BasicParser<Builder>::parse_global() -> Global {
   if (current_token.kind == TokenKind::STRUCT) {
     return parse_global_struct();
   }
@@ -807,15 +1069,16 @@ auto Parser::parse_global() -> std::unique_ptr<GlobalNode> {
   else if (is_type_token()) {
     return parse_global_def();
   } else {
-    error(current_token.pos,
+    error(location(),
           fmt::format("Expected 'struct', 'extern' or type token, but got {}",
                       to_string(current_token.kind)));
   }
-  return nullptr; // unreachable, but needed to satisfy the return type
+  return {}; // unreachable, but needed to satisfy the return type
 }
 
-auto Parser::parse_global_extern() -> std::unique_ptr<GlobalNode> {
-  auto pos = current_token.pos;
+template <typename Builder>
+auto BasicParser<Builder>::parse_global_extern() -> Global {
+  auto loc = location();
   advance();
   auto type = parse_ty();
   auto name = parse_ident();
@@ -823,87 +1086,91 @@ auto Parser::parse_global_extern() -> std::unique_ptr<GlobalNode> {
   if (current_token.kind == TokenKind::LPAREN) {
     // extern function declaration
     advance();
-    auto params = parse_params();
+    ScratchList<Param> params(param_scratch);
+    parse_params(params);
     expect(TokenKind::RPAREN);
     expect(TokenKind::SEMICOLON);
-    return std::make_unique<GlobalNode>(
-        GFuncDecl{pos, std::move(type), std::move(name), std::move(params)});
+    return builder.global_func_decl(loc, type, name, params);
   }
 
   if (current_token.kind == TokenKind::SEMICOLON) {
     // extern variable declaration
     advance();
-    return std::make_unique<GlobalNode>(
-        GVarDecl{pos, std::move(type), std::move(name)});
+    return builder.global_var_decl(loc, type, name);
   }
 
-  error(current_token.pos, fmt::format("Expected ';' or '(', but got {}'",
+  error(location(), fmt::format("Expected ';' or '(', but got {}'",
                                        to_string(current_token.kind)));
-  return nullptr; // unreachable, but needed to satisfy the return type
+  return {}; // unreachable, but needed to satisfy the return type
 }
 
-auto Parser::parse_global_def() -> std::unique_ptr<GlobalNode> {
-  auto pos = current_token.pos;
+template <typename Builder>
+auto BasicParser<Builder>::parse_global_def() -> Global {
+  auto loc = location();
   auto type = parse_ty();
   auto name = parse_ident();
 
   if (current_token.kind == TokenKind::LPAREN) {
     // function definition
     advance();
-    auto params = parse_params();
-    ;
+    ScratchList<Param> params(param_scratch);
+    parse_params(params);
     expect(TokenKind::RPAREN);
     expect(TokenKind::LBRACE);
-    auto stmt_pos = current_token.pos;
-    std::vector<std::unique_ptr<StmtNode>> stmts;
-    while (current_token.kind != TokenKind::RBRACE) {
+    auto stmt_pos = location();
+    ScratchList<Stmt> stmts(stmt_scratch);
+    while (!failed && current_token.kind != TokenKind::RBRACE) {
       stmts.push_back(parse_stmt());
     }
     expect(TokenKind::RBRACE);
-    return std::make_unique<GlobalNode>(GFuncDef{
-        pos, std::move(type), std::move(name), std::move(params),
-        std::make_unique<StmtNode>(SScope{stmt_pos, std::move(stmts)})});
+    return builder.global_func_def(loc, type, name, params,
+                                   builder.stmt_scope(stmt_pos, stmts));
   }
 
   if (current_token.kind == TokenKind::ASSIGN) {
     // variable definition
     advance();
-    auto value = parse_expr(1);
+    auto value = parse_expr();
     expect(TokenKind::SEMICOLON);
-    return std::make_unique<GlobalNode>(
-        GVarDef{pos, std::move(type), std::move(name), std::move(value)});
+    return builder.global_var_def(loc, type, name, value);
   }
 
-  error(current_token.pos, fmt::format("Expected '(', '=', but got {}",
+  error(location(), fmt::format("Expected '(', '=', but got {}",
                                        to_string(current_token.kind)));
-  return nullptr; // unreachable, but needed to satisfy the return type
+  return {}; // unreachable, but needed to satisfy the return type
 }
 
-auto Parser::parse_global_struct() -> std::unique_ptr<GlobalNode> {
-  auto pos = current_token.pos;
+template <typename Builder>
+auto BasicParser<Builder>::parse_global_struct() -> Global {
+  auto loc = location();
   advance();
   auto name = parse_ident();
   expect(TokenKind::LBRACE);
 
-  std::vector<Parameter> params;
+  ScratchList<Param> params(param_scratch);
   if (is_type_token()) {
-    params.push_back(Parameter{parse_ty(), parse_ident()});
+    params.push_back(Param{parse_ty(), parse_ident()});
     expect(TokenKind::SEMICOLON);
-    while (current_token.kind != TokenKind::RBRACE) {
-      params.push_back(Parameter{parse_ty(), parse_ident()});
+    while (!failed && current_token.kind != TokenKind::RBRACE) {
+      params.push_back(Param{parse_ty(), parse_ident()});
       expect(TokenKind::SEMICOLON);
     }
   }
   expect(TokenKind::RBRACE);
   expect(TokenKind::SEMICOLON);
 
-  return std::make_unique<GlobalNode>(GStruct{pos, name, std::move(params)});
+  return builder.global_struct(loc, name, params);
 }
 
-auto Parser::parse_prog() -> std::unique_ptr<Prog> {
-  auto prog = std::make_unique<Prog>();
+template <typename Builder>
+auto BasicParser<Builder>::parse_prog() -> Result {
+  builder.begin();
+  ScratchList<Global> globals(global_scratch);
   while (current_token.kind != TokenKind::END_OF_FILE) {
-    prog->globals.push_back(std::move(parse_global()));
+    globals.push_back(parse_global());
   }
-  return prog;
-}
\ No newline at end of file
+  return builder.finish(globals);
+}
+
+template class BasicParser<TreeBuilder>;
+template class BasicParser<FlatBuilder>;
@@ -0,0 +1,261 @@
+#include "lexer/scan.hpp"
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CIGRID_SCAN_X86 1
+#endif
+
+namespace {
+
+// --- Scalar reference versions ---
+
+bool is_space(unsigned char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+bool is_ident(unsigned char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+const char *skip_whitespace_scalar(const char *p, const char *end) {
+  while (p < end && is_space(*p))
+    ++p;
+  return p;
+}
+
+const char *find_newline_scalar(const char *p, const char *end) {
+  while (p < end && *p != '\n')
+    ++p;
+  return p;
+}
+
+const char *find_comment_end_scalar(const char *p, const char *end) {
+  for (; p + 1 < end; ++p) {
+    if (p[0] == '*' && p[1] == '/')
+      return p;
+  }
+  return end;
+}
+
+const char *ident_end_scalar(const char *p, const char *end) {
+  while (p < end && is_ident(*p))
+    ++p;
+  return p;
+}
+
+#ifdef CIGRID_SCAN_X86
+
+// Unsigned `lo <= x <= lo + span` on every byte, SSE2 has no unsigned
+// compare so use min: x' <= span  <=>  min(x', span) == x'
+inline __m128i in_range_sse2(__m128i x, char lo, char span) {
+  __m128i shifted = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(span)), shifted);
+}
+
+inline __m128i space_mask_sse2(__m128i x) {
+  return _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')),
+                      in_range_sse2(x, '\t', '\r' - '\t'));
+}
+
+inline __m128i ident_mask_sse2(__m128i x) {
+  __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+  return _mm_or_si128(
+      _mm_or_si128(in_range_sse2(lower, 'a', 'z' - 'a'),
+                   in_range_sse2(x, '0', '9' - '0')),
+      _mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+}
+
+// Index of the first byte whose mask bit is clear
+inline int first_clear(int mask, int width_mask) {
+  return __builtin_ctz(~mask & width_mask);
+}
+
+const char *skip_whitespace_sse2(const char *p, const char *end) {
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    int mask = _mm_movemask_epi8(space_mask_sse2(x));
+    if (mask != 0xFFFF)
+      return p + first_clear(mask, 0xFFFF);
+  }
+  return skip_whitespace_scalar(p, end);
+}
+
+const char *find_newline_sse2(const char *p, const char *end) {
+  const __m128i newline = _mm_set1_epi8('\n');
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, newline));
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+  return find_newline_scalar(p, end);
+}
+
+const char *find_comment_end_sse2(const char *p, const char *end) {
+  const __m128i star = _mm_set1_epi8('*');
+  const __m128i slash = _mm_set1_epi8('/');
+  // Compare the block with itself shifted by one byte
+  for (; end - p >= 17; p += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+    int mask = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(x, star), _mm_cmpeq_epi8(next, slash)));
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+  return find_comment_end_scalar(p, end);
+}
+
+const char *ident_end_sse2(const char *p, const char *end) {
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    int mask = _mm_movemask_epi8(ident_mask_sse2(x));
+    if (mask != 0xFFFF)
+      return p + first_clear(mask, 0xFFFF);
+  }
+  return ident_end_scalar(p, end);
+}
+
+// AVX2 has signed byte compares only, so keep the min trick from SSE2
+#define CIGRID_AVX2 __attribute__((target("avx2")))
+
+CIGRID_AVX2 inline __m256i in_range_avx2(__m256i x, char lo, char span) {
+  __m256i shifted = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(span)),
+                           shifted);
+}
+
+CIGRID_AVX2 const char *skip_whitespace_avx2(const char *p, const char *end) {
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')),
+                                    in_range_avx2(x, '\t', '\r' - '\t'));
+    auto mask = static_cast<unsigned>(_mm256_movemask_epi8(space));
+    if (mask != 0xFFFFFFFFu)
+      return p + __builtin_ctz(~mask);
+  }
+  return skip_whitespace_sse2(p, end);
+}
+
+CIGRID_AVX2 const char *find_newline_avx2(const char *p, const char *end) {
+  const __m256i newline = _mm256_set1_epi8('\n');
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    auto mask =
+        static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, newline)));
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+  return find_newline_sse2(p, end);
+}
+
+CIGRID_AVX2 const char *find_comment_end_avx2(const char *p, const char *end) {
+  const __m256i star = _mm256_set1_epi8('*');
+  const __m256i slash = _mm256_set1_epi8('/');
+  for (; end - p >= 33; p += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i next =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1));
+    auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_and_si256(
+        _mm256_cmpeq_epi8(x, star), _mm256_cmpeq_epi8(next, slash))));
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+  return find_comment_end_sse2(p, end);
+}
+
+CIGRID_AVX2 const char *ident_end_avx2(const char *p, const char *end) {
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+    __m256i ident = _mm256_or_si256(
+        _mm256_or_si256(in_range_avx2(lower, 'a', 'z' - 'a'),
+                        in_range_avx2(x, '0', '9' - '0')),
+        _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+    auto mask = static_cast<unsigned>(_mm256_movemask_epi8(ident));
+    if (mask != 0xFFFFFFFFu)
+      return p + __builtin_ctz(~mask);
+  }
+  return ident_end_sse2(p, end);
+}
+
+#endif // CIGRID_SCAN_X86
+
+const ScanFunctions scalar_functions = {
+    ScanIsa::SCALAR, skip_whitespace_scalar, find_newline_scalar,
+    find_comment_end_scalar, ident_end_scalar};
+
+#ifdef CIGRID_SCAN_X86
+const ScanFunctions sse2_functions = {ScanIsa::SSE2, skip_whitespace_sse2,
+                                      find_newline_sse2, find_comment_end_sse2,
+                                      ident_end_sse2};
+const ScanFunctions avx2_functions = {ScanIsa::AVX2, skip_whitespace_avx2,
+                                      find_newline_avx2, find_comment_end_avx2,
+                                      ident_end_avx2};
+#endif
+
+ScanIsa best_supported_isa() {
+#ifdef CIGRID_SCAN_X86
+  if (__builtin_cpu_supports("avx2"))
+    return ScanIsa::AVX2;
+  return ScanIsa::SSE2;
+#else
+  return ScanIsa::SCALAR;
+#endif
+}
+
+std::atomic<const ScanFunctions *> active_functions = nullptr;
+
+} // namespace
+
+bool scan_isa_supported(ScanIsa isa) {
+  switch (isa) {
+  case ScanIsa::SCALAR:
+    return true;
+#ifdef CIGRID_SCAN_X86
+  case ScanIsa::SSE2:
+    return true;
+  case ScanIsa::AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+const ScanFunctions &scan_functions(ScanIsa isa) {
+  switch (isa) {
+#ifdef CIGRID_SCAN_X86
+  case ScanIsa::SSE2:
+    return sse2_functions;
+  case ScanIsa::AVX2:
+    return avx2_functions;
+#endif
+  default:
+    return scalar_functions;
+  }
+}
+
+const ScanFunctions &active_scan_functions() {
+  const ScanFunctions *functions = active_functions.load();
+  if (!functions) {
+    functions = &scan_functions(best_supported_isa());
+    active_functions.store(functions);
+  }
+  return *functions;
+}
+
+void set_scan_isa(ScanIsa isa) { active_functions.store(&scan_functions(isa)); }
+
+const char *to_string(ScanIsa isa) {
+  switch (isa) {
+  case ScanIsa::SCALAR:
+    return "scalar";
+  case ScanIsa::SSE2:
+    return "sse2";
+  case ScanIsa::AVX2:
+    return "avx2";
+  }
+  return "unknown";
+}
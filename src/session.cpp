@@ -0,0 +1,320 @@
+#include "frontend/session.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+#include "diagnostics/diagnostics.hpp"
+#include "lexer/chunk_splitter.hpp"
+#include "lexer/lexer.hpp"
+#include "parser/parser.hpp"
+#include "source/source_buffer.hpp"
+
+namespace {
+
+// Position just past `text` when it begins at `start`
+Position end_position(Position start, std::string_view text) {
+  auto newline = text.rfind('\n');
+  if (newline == std::string_view::npos)
+    return {start.line, start.column + static_cast<int>(text.size())};
+  auto lines = std::count(text.begin(), text.end(), '\n');
+  return {start.line + static_cast<int>(lines),
+          static_cast<int>(text.size() - newline)};
+}
+
+// Replaced units may take as much location space as the live ones, and
+// this much more, before the session is built again from its text
+constexpr std::uint32_t rebuild_slack = 1 << 20;
+
+// Every token of `text` before its end, lexing on past bad ones. The text
+// is not added to `sources`: the units report lexer errors again when they
+// are parsed, so `file` only labels diagnostics that are dropped.
+std::vector<Token> lex(const SourceManager &sources, FileId file,
+                       std::string_view text) {
+  Diagnostics diag;
+  Lexer lexer(sources, file, text, 0, diag, LexerEngine::SWITCH,
+              Interner::global());
+  std::vector<Token> tokens;
+  for (auto token = lexer.next_token().value();
+       token.kind != TokenKind::END_OF_FILE;
+       token = lexer.next_token().value())
+    tokens.push_back(token);
+  return tokens;
+}
+
+// How the tokens of an edited region end
+struct RegionEnd {
+  // Braces still open, leaving out stray '}'s as find_global_boundaries does
+  int open_braces = 0;
+  // Some '}' closes more braces than the region opened before it
+  bool stray_close = false;
+  // A comment or literal is still open, or the last token is bad
+  bool lexer_open = false;
+  // The last token can end a global: ';' or '}'
+  bool after_global = true;
+};
+
+RegionEnd region_end(std::string_view text, std::span<const Token> tokens) {
+  RegionEnd end;
+  for (const auto &token : tokens) {
+    if (token.kind == TokenKind::LBRACE)
+      ++end.open_braces;
+    else if (token.kind == TokenKind::RBRACE && end.open_braces > 0)
+      --end.open_braces;
+    else if (token.kind == TokenKind::RBRACE)
+      end.stray_close = true;
+  }
+  if (!tokens.empty()) {
+    const auto &last = tokens.back();
+    end.after_global =
+        last.kind == TokenKind::SEMICOLON || last.kind == TokenKind::RBRACE;
+    end.lexer_open = last.kind == TokenKind::BAD;
+  }
+  // Comments of either kind, with "//" or '#', and literals are followed
+  // the way the lexer skips them
+  ChunkSplitter splitter;
+  splitter.scan(text.data(), text.data() + text.size(),
+                text.data() + text.size());
+  end.lexer_open = end.lexer_open || splitter.inside();
+  return end;
+}
+
+} // namespace
+
+Session::Session(std::string_view text, const CigridFlags &flags)
+    : flags(flags) {
+  this->flags.lex_threads = 1;
+  this->flags.parse_threads = 1;
+  load(text);
+}
+
+void Session::edit(const TextEdit &edit) {
+  assert(edit.offset + edit.length <= size());
+  stats = {};
+  auto first = unit_at(edit.offset);
+  // An edit right at the start of a unit may join it to the one before
+  if (first > 0 && units[first]->start == edit.offset)
+    --first;
+  auto last = unit_at(edit.offset + edit.length);
+
+  std::uint32_t begin;
+  std::string text;
+  std::vector<Token> tokens;
+  Units built;
+  for (std::size_t extra = 1;; extra *= 2) {
+    begin = units[first]->start;
+    text.clear();
+    for (auto i = first; i <= last; ++i)
+      text.append(unit_text(*units[i]));
+    text.replace(edit.offset - begin, edit.length, edit.replacement);
+    // The lexer stops short of the last byte it is given, see build()
+    tokens = lex(sources, lex_label,
+                 last + 1 < units.size() ? text + ' ' : text);
+    stats.relexed_bytes += text.size();
+    auto end = region_end(text, tokens);
+    if (end.stray_close && opening_unit(first) < first) {
+      first = opening_unit(first);
+      continue;
+    }
+    if (last + 1 == units.size())
+      break;
+    // The units after the region lex and split as before only if it ends
+    // between two globals
+    if (!end.lexer_open && end.open_braces > 0) {
+      auto closing = closing_unit(last + 1, end.open_braces);
+      if (closing < units.size()) {
+        last = closing;
+        continue;
+      }
+      // Nothing closes them, so a parse from scratch reads on into the
+      // globals after the region until it fails. Where it fails is known
+      // once the region fails before its last token: the parser looks at
+      // most one token ahead, so it has not seen past the region yet.
+      built = build(text, tokens, begin, units[first]->position, false);
+      const auto &open = *built.back();
+      auto last_token = sources.loc(
+          open.file, tokens.back().offset - (open.start - begin));
+      if (open.result.error &&
+          open.result.error->loc.offset < last_token.offset)
+        break;
+      built.clear();
+      last = std::min(last + extra, units.size() - 1);
+    } else if (end.lexer_open || !end.after_global) {
+      // E.g. a comment that swallows the units after it. Growing the region
+      // geometrically keeps the relexing linear.
+      last = std::min(last + extra, units.size() - 1);
+    } else {
+      break;
+    }
+  }
+
+  if (built.empty())
+    built = build(text, tokens, begin, units[first]->position,
+                  last + 1 == units.size());
+  // The units after the region move by the change in its size, and those on
+  // the line where it ends also move sideways
+  if (last + 1 < units.size()) {
+    auto old_end = units[last + 1]->position;
+    auto new_end = end_position(units[first]->position, text);
+    auto old_size = units[last + 1]->start - begin;
+    for (auto i = last + 1; i < units.size(); ++i) {
+      auto &unit = *units[i];
+      unit.start += static_cast<std::uint32_t>(text.size()) - old_size;
+      if (unit.position.line == old_end.line)
+        unit.position.column += new_end.column - old_end.column;
+      unit.position.line += new_end.line - old_end.line;
+    }
+  }
+  for (auto i = first; i <= last; ++i)
+    unit_of_file.erase(units[i]->file);
+  for (const auto &unit : built)
+    unit_of_file[unit->file] = unit.get();
+  units.erase(units.begin() + first, units.begin() + last + 1);
+  units.insert(units.begin() + first, std::make_move_iterator(built.begin()),
+               std::make_move_iterator(built.end()));
+
+  // Each unit takes its size and up to two bytes past it, see build()
+  auto live = static_cast<std::uint32_t>(size() + 2 * units.size() + 1);
+  if (sources.end_offset() > 2 * live + rebuild_slack)
+    rebuild();
+}
+
+void Session::load(std::string_view text) {
+  lex_label = sources.add_file(SourceBuffer::from_string({}));
+  units = build(text, lex(sources, lex_label, text), 0, Position{1, 1}, true);
+  for (const auto &unit : units)
+    unit_of_file[unit->file] = unit.get();
+}
+
+void Session::rebuild() {
+  auto text = this->text();
+  unit_of_file.clear();
+  units.clear();
+  sources.clear();
+  load(text);
+  stats.relexed_bytes += text.size();
+  stats.rebuilt = true;
+}
+
+std::size_t Session::size() const {
+  return units.back()->start + unit_text(*units.back()).size();
+}
+
+std::string Session::text() const {
+  std::string text;
+  text.reserve(size());
+  for (const auto &unit : units)
+    text.append(unit_text(*unit));
+  return text;
+}
+
+bool Session::ok() const {
+  return std::all_of(units.begin(), units.end(),
+                     [](const auto &unit) { return unit->result.ok(); });
+}
+
+std::vector<ParseError> Session::errors() const {
+  std::vector<ParseError> errors;
+  for (const auto &unit : units) {
+    if (unit->result.error)
+      errors.push_back(*unit->result.error);
+  }
+  return errors;
+}
+
+std::vector<GlobalNode *> Session::globals() const {
+  std::vector<GlobalNode *> globals;
+  for (const auto &unit : units) {
+    if (unit->result.ok())
+      globals.insert(globals.end(), unit->result.prog->globals.begin(),
+                     unit->result.prog->globals.end());
+  }
+  return globals;
+}
+
+void Session::print(ASTPrinter &printer) const {
+  for (auto *global : globals())
+    printer.print_global(*global);
+}
+
+Position Session::position(SourceLoc loc) const {
+  auto found = unit_of_file.find(sources.file_of(loc));
+  // Replaced by an edit since
+  if (found == unit_of_file.end())
+    return Position{0, 0};
+  auto start = found->second->position;
+  auto position = sources.position(loc);
+  if (position.line == 1)
+    return {start.line, start.column + position.column - 1};
+  return {start.line + position.line - 1, position.column};
+}
+
+std::size_t Session::unit_at(std::uint32_t offset) const {
+  auto after = std::upper_bound(units.begin(), units.end(), offset,
+                                [](std::uint32_t offset, const auto &unit) {
+                                  return offset < unit->start;
+                                });
+  return static_cast<std::size_t>(after - units.begin()) - 1;
+}
+
+std::size_t Session::closing_unit(std::size_t next, int open) const {
+  for (; next < units.size(); ++next) {
+    if (open + units[next]->min_brace_balance <= 0)
+      return next;
+    open += units[next]->brace_balance;
+  }
+  return units.size();
+}
+
+std::size_t Session::opening_unit(std::size_t first) const {
+  int open = 0;
+  for (auto unit = first; unit-- > 0;) {
+    open += units[unit]->brace_balance;
+    if (open > 0)
+      return unit;
+  }
+  return first;
+}
+
+std::string_view Session::unit_text(const Unit &unit) const {
+  return sources.buffer(unit.file).view().substr(0, unit.length);
+}
+
+Session::Units Session::build(std::string_view text,
+                              std::span<const Token> tokens,
+                              std::uint32_t start, Position position,
+                              bool at_end) {
+  auto starts = find_global_boundaries(tokens);
+  // Whitespace and comments before the first global go to the first unit,
+  // and text without any global still makes one unit
+  Units built;
+  for (std::size_t i = 0; i < std::max<std::size_t>(starts.size(), 1); ++i) {
+    std::size_t begin = i == 0 ? 0 : tokens[starts[i]].offset;
+    std::size_t end =
+        i + 1 < starts.size() ? tokens[starts[i + 1]].offset : text.size();
+    auto piece = text.substr(begin, end - begin);
+    auto unit = std::make_unique<Unit>();
+    // The lexer never reads the last byte of a file as a token, so a unit
+    // the document goes on after gets a space past its end. The unit at the
+    // end of the document lexes like the whole document does.
+    unit->file = sources.add_file(SourceBuffer::from_string(
+        end < text.size() || !at_end ? std::string(piece) + ' '
+                                     : std::string(piece)));
+    unit->start = start + static_cast<std::uint32_t>(begin);
+    unit->length = static_cast<std::uint32_t>(piece.size());
+    unit->position = position;
+    unit->result = parse_unit(sources, unit->file, flags);
+    auto last = i + 1 < starts.size() ? starts[i + 1] : tokens.size();
+    for (auto j = i < starts.size() ? starts[i] : last; j < last; ++j) {
+      if (tokens[j].kind == TokenKind::LBRACE)
+        ++unit->brace_balance;
+      else if (tokens[j].kind == TokenKind::RBRACE)
+        unit->min_brace_balance =
+            std::min(unit->min_brace_balance, --unit->brace_balance);
+    }
+    position = end_position(position, piece);
+    built.push_back(std::move(unit));
+  }
+  stats.reparsed_globals += starts.size();
+  return built;
+}
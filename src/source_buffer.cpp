@@ -0,0 +1,151 @@
+#include "source/source_buffer.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Read everything left in fd with large reads, growing geometrically. Used for
+// pipes and other inputs whose size is not known up front.
+auto read_all(int fd, std::size_t size_hint, std::unique_ptr<char[]> &out)
+    -> std::optional<std::size_t> {
+  std::size_t capacity = size_hint > 0 ? size_hint : 64 * 1024;
+  std::size_t length = 0;
+  auto buffer = std::make_unique<char[]>(capacity);
+  while (true) {
+    if (length == capacity) {
+      auto bigger = std::make_unique<char[]>(capacity * 2);
+      std::memcpy(bigger.get(), buffer.get(), length);
+      buffer = std::move(bigger);
+      capacity *= 2;
+    }
+    ssize_t n = ::read(fd, buffer.get() + length, capacity - length);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return std::nullopt;
+    }
+    if (n == 0)
+      break;
+    length += static_cast<std::size_t>(n);
+  }
+  out = std::move(buffer);
+  return length;
+}
+
+} // namespace
+
+auto SourceBuffer::from_file(const std::string &filename)
+    -> std::optional<SourceBuffer> {
+  int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return std::nullopt;
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || S_ISDIR(st.st_mode)) {
+    ::close(fd);
+    return std::nullopt;
+  }
+
+  SourceBuffer buffer;
+  buffer.filename = filename;
+
+  if (S_ISREG(st.st_mode) && st.st_size > 0) {
+    auto size = static_cast<std::size_t>(st.st_size);
+    void *addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      ::madvise(addr, size, MADV_SEQUENTIAL);
+      ::close(fd);
+      buffer.data = static_cast<const char *>(addr);
+      buffer.length = size;
+      buffer.mapped = true;
+      return buffer;
+    }
+  }
+
+  // Not mappable (pipe, tty, empty file, ...): one bulk read instead
+  std::size_t hint = S_ISREG(st.st_mode) ? st.st_size : 0;
+  auto length = read_all(fd, hint, buffer.owned);
+  ::close(fd);
+  if (!length)
+    return std::nullopt;
+  buffer.data = buffer.owned.get();
+  buffer.length = *length;
+  return buffer;
+}
+
+auto SourceBuffer::from_stream(std::istream &stream, std::string name)
+    -> SourceBuffer {
+  SourceBuffer buffer;
+  buffer.filename = std::move(name);
+
+  std::size_t capacity = 64 * 1024;
+  std::size_t length = 0;
+  auto bytes = std::make_unique<char[]>(capacity);
+  while (stream) {
+    if (length == capacity) {
+      auto bigger = std::make_unique<char[]>(capacity * 2);
+      std::memcpy(bigger.get(), bytes.get(), length);
+      bytes = std::move(bigger);
+      capacity *= 2;
+    }
+    stream.read(bytes.get() + length, capacity - length);
+    length += static_cast<std::size_t>(stream.gcount());
+  }
+
+  buffer.owned = std::move(bytes);
+  buffer.data = buffer.owned.get();
+  buffer.length = length;
+  return buffer;
+}
+
+auto SourceBuffer::from_string(std::string_view text, std::string name)
+    -> SourceBuffer {
+  SourceBuffer buffer;
+  buffer.filename = std::move(name);
+  buffer.owned = std::make_unique<char[]>(text.size() + 1);
+  if (!text.empty())
+    std::memcpy(buffer.owned.get(), text.data(), text.size());
+  buffer.data = buffer.owned.get();
+  buffer.length = text.size();
+  return buffer;
+}
+
+SourceBuffer::SourceBuffer(SourceBuffer &&other) noexcept
+    : filename(std::move(other.filename)), data(other.data),
+      length(other.length), mapped(other.mapped),
+      owned(std::move(other.owned)) {
+  other.data = "";
+  other.length = 0;
+  other.mapped = false;
+}
+
+auto SourceBuffer::operator=(SourceBuffer &&other) noexcept -> SourceBuffer & {
+  if (this != &other) {
+    release();
+    filename = std::move(other.filename);
+    data = std::exchange(other.data, "");
+    length = std::exchange(other.length, 0);
+    mapped = std::exchange(other.mapped, false);
+    owned = std::move(other.owned);
+  }
+  return *this;
+}
+
+SourceBuffer::~SourceBuffer() { release(); }
+
+auto SourceBuffer::release() -> void {
+  if (mapped) {
+    ::munmap(const_cast<char *>(data), length);
+    mapped = false;
+  }
+  owned.reset();
+  data = "";
+  length = 0;
+}
@@ -0,0 +1,72 @@
+#include "source/source_manager.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+#include "lexer/scan.hpp"
+
+FileId SourceManager::add_file(SourceBuffer buffer) {
+  auto base = next_base;
+  next_base += static_cast<std::uint32_t>(buffer.size()) + 1;
+  files.push_back(std::make_unique<File>(std::move(buffer), base));
+  return static_cast<FileId>(files.size() - 1);
+}
+
+void SourceManager::clear() {
+  files.clear();
+  next_base = 0;
+}
+
+FileId SourceManager::add_stream(std::string name) {
+  auto file = add_file(SourceBuffer::from_string({}, std::move(name)));
+  // The line table grows in append() instead
+  File &stream = *files[file];
+  std::call_once(stream.lines_built, [&] { stream.line_starts.push_back(0); });
+  return file;
+}
+
+void SourceManager::append(FileId file, std::string_view bytes) {
+  File &stream = *files[file];
+  const char *begin = bytes.data();
+  const char *end = begin + bytes.size();
+  const auto &scan = active_scan_functions();
+  for (const char *p = begin; (p = scan.find_newline(p, end)) != end; ++p) {
+    stream.line_starts.push_back(
+        stream.streamed + static_cast<std::uint32_t>(p - begin + 1));
+  }
+  stream.streamed += static_cast<std::uint32_t>(bytes.size());
+  next_base += static_cast<std::uint32_t>(bytes.size());
+}
+
+FileId SourceManager::file_of(SourceLoc loc) const {
+  // The file is the last one whose base is not after the location
+  auto it = std::upper_bound(
+      files.begin(), files.end(), loc.offset,
+      [](std::uint32_t offset, const auto &file) { return offset < file->base; });
+  return static_cast<FileId>(it - files.begin()) - 1;
+}
+
+std::string_view SourceManager::name(SourceLoc loc) const {
+  return files[file_of(loc)]->buffer.name();
+}
+
+Position SourceManager::position(SourceLoc loc) const {
+  const File &file = *files[file_of(loc)];
+  std::call_once(file.lines_built, [&] { build_lines(file); });
+  auto offset = loc.offset - file.base;
+  const auto &starts = file.line_starts;
+  auto it = std::upper_bound(starts.begin(), starts.end(), offset);
+  int line = static_cast<int>(it - starts.begin());
+  int column = static_cast<int>(offset - *std::prev(it)) + 1;
+  return Position{line, column};
+}
+
+void SourceManager::build_lines(const File &file) const {
+  const char *begin = file.buffer.begin();
+  const char *end = file.buffer.end();
+  const auto &scan = active_scan_functions();
+  file.line_starts.reserve(file.buffer.size() / 32 + 1);
+  file.line_starts.push_back(0);
+  for (const char *p = begin; (p = scan.find_newline(p, end)) != end; ++p)
+    file.line_starts.push_back(static_cast<std::uint32_t>(p - begin + 1));
+}
@@ -0,0 +1,98 @@
+#include "lexer/stream_lexer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+StreamLexer::StreamLexer(SourceManager &sources, FileId file, ReadFn read,
+                         Diagnostics &diag, LexerEngine engine,
+                         Interner &interner, std::size_t capacity)
+    : sources(sources), file(file), read(std::move(read)), diag(diag),
+      engine(engine), interner(interner),
+      buffer(std::max<std::size_t>(capacity, 1)) {}
+
+Token StreamLexer::next_token() {
+  while (!stopped) {
+    if (lexer) {
+      Token token = lexer->next_token().value();
+      // A chunk's END_OF_FILE only ends the chunk, unless it is the last one
+      if (token.kind != TokenKind::END_OF_FILE || last_chunk) {
+        stopped = token.kind == TokenKind::BAD;
+        recent[0] = recent[1];
+        recent[1] = token.offset;
+        return token;
+      }
+      lexer.reset();
+    }
+    stopped = !next_chunk();
+  }
+  auto end = buffer_base + static_cast<std::uint32_t>(filled);
+  return Token{TokenKind::END_OF_FILE, end, 0, 0};
+}
+
+std::string_view StreamLexer::lexeme(const Token &token) const {
+  switch (token.kind) {
+  case TokenKind::END_OF_FILE:
+    return "EOF";
+  case TokenKind::BAD:
+    return lex_error_message(static_cast<LexError>(token.payload));
+  default:
+    return std::string_view(buffer.data() + (token.offset - buffer_base),
+                            token.length);
+  }
+}
+
+bool StreamLexer::next_chunk() {
+  while (true) {
+    // Take everything up to the last cut the buffer holds
+    std::size_t cut = lexed;
+    const char *data = buffer.data();
+    while (const char *p =
+               splitter.scan(data + scanned, data + filled, data + scanned))
+      scanned = cut = p - data;
+    scanned = filled;
+
+    if (cut == lexed && input_done) {
+      // An empty tail after the last cut adds nothing, but an empty input is
+      // still lexed like Lexer would
+      if (lexed == filled && buffer_base + filled > 0)
+        return false;
+      cut = filled;
+      last_chunk = true;
+    }
+    if (cut > lexed || last_chunk) {
+      std::string_view window(data + lexed, cut - lexed);
+      lexer.emplace(sources, file, window,
+                    buffer_base + static_cast<std::uint32_t>(lexed), diag,
+                    engine, interner);
+      lexed = cut;
+      return true;
+    }
+    refill();
+  }
+}
+
+void StreamLexer::refill() {
+  // Drop what no token can refer to any more, then grow if that is not
+  // enough to read a good amount
+  auto tight = [this] {
+    return buffer.size() - filled < std::max<std::size_t>(buffer.size() / 4, 1);
+  };
+  std::size_t keep = std::min<std::size_t>(recent[0] - buffer_base, lexed);
+  if (tight() && keep > 0) {
+    std::memmove(buffer.data(), buffer.data() + keep, filled - keep);
+    buffer_base += static_cast<std::uint32_t>(keep);
+    filled -= keep;
+    lexed -= keep;
+    scanned -= keep;
+  }
+  if (tight())
+    buffer.resize(buffer.size() * 2);
+
+  std::size_t count = read(buffer.data() + filled, buffer.size() - filled);
+  if (count == 0) {
+    input_done = true;
+    return;
+  }
+  sources.append(file, std::string_view(buffer.data() + filled, count));
+  filled += count;
+}
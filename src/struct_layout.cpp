@@ -0,0 +1,114 @@
+#include "sema/struct_layout.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <variant>
+
+namespace {
+
+std::uint32_t round_up(std::uint32_t size, std::uint32_t align) {
+  return (size + align - 1) / align * align;
+}
+
+} // namespace
+
+void StructLayouts::add(DeclId decl, std::span<const Parameter> fields,
+                        std::span<const TypeId> types,
+                        const TypeContext &context) {
+  if (layouts.size() <= decl) {
+    layouts.resize(decl + 1);
+    first_offset.resize(decl + 1);
+  }
+  auto first = static_cast<std::uint32_t>(offsets.size());
+  first_offset[decl] = first;
+  offsets.resize(first + fields.size());
+  positions.resize(first + fields.size());
+  for (std::uint32_t i = 0; i < fields.size(); ++i)
+    this->fields.try_emplace(key(decl, fields[i].name), i);
+
+  // Places the fields in `order`, storing their offsets if `store`
+  std::vector<std::uint32_t> order(fields.size());
+  std::iota(order.begin(), order.end(), 0);
+  auto place = [&](bool store) {
+    StructLayout layout;
+    std::uint32_t position = 0;
+    for (auto i : order) {
+      auto align = align_of(types[i], context);
+      layout.size = round_up(layout.size, align);
+      if (store) {
+        offsets[first + i] = layout.size;
+        positions[first + i] = position++;
+      }
+      layout.size += size_of(types[i], context);
+      layout.align = std::max(layout.align, align);
+    }
+    layout.size = round_up(layout.size, layout.align);
+    return layout;
+  };
+  auto declared = place(!pack);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](std::uint32_t a, std::uint32_t b) {
+                     return align_of(types[a], context) >
+                            align_of(types[b], context);
+                   });
+  auto packed = place(pack);
+
+  auto &layout = layouts[decl];
+  layout = pack ? packed : declared;
+  layout.declared_size = declared.size;
+  layout.packed_size = packed.size;
+  layout.complete = true;
+}
+
+std::optional<std::uint32_t> StructLayouts::field(DeclId decl,
+                                                  Symbol name) const {
+  auto found = fields.find(key(decl, name));
+  if (found == fields.end())
+    return std::nullopt;
+  return found->second;
+}
+
+std::uint32_t StructLayouts::size_of(TypeId type,
+                                     const TypeContext &context) const {
+  switch (context.kind(type)) {
+  case TypeClass::CHAR:
+    return 1;
+  case TypeClass::INT:
+    return 4;
+  case TypeClass::POINTER:
+    return 8;
+  case TypeClass::STRUCT:
+    return layout(context.struct_decl(type)).size;
+  default:
+    return 0;
+  }
+}
+
+std::uint32_t StructLayouts::align_of(TypeId type,
+                                      const TypeContext &context) const {
+  switch (context.kind(type)) {
+  case TypeClass::INT:
+    return 4;
+  case TypeClass::POINTER:
+    return 8;
+  case TypeClass::STRUCT:
+    return layout(context.struct_decl(type)).align;
+  default:
+    return 1;
+  }
+}
+
+void print_layout_report(const Prog &prog, const StructLayouts &layouts,
+                         fmt::memory_buffer &out) {
+  for (const auto *global : prog.globals) {
+    const auto *record = std::get_if<GStruct>(global);
+    if (!record)
+      continue;
+    const auto &layout = layouts.layout(record->decl);
+    fmt::format_to(std::back_inserter(out),
+                   "struct {}: {} bytes in declaration order, {} packed, "
+                   "{} saved\n",
+                   record->name, layout.declared_size, layout.packed_size,
+                   layout.declared_size - layout.packed_size);
+  }
+}
@@ -0,0 +1,65 @@
+#include "sema/symbol_table.hpp"
+
+#include <utility>
+
+namespace {
+
+constexpr int initial_bits = 6;
+
+} // namespace
+
+SymbolTable::SymbolTable()
+    : slots(std::size_t{1} << initial_bits), shift(32 - initial_bits) {}
+
+void SymbolTable::exit_scope() {
+  auto start = scope_starts.back();
+  scope_starts.pop_back();
+  while (undo.size() > start) {
+    const auto &hidden = undo.back();
+    auto &slot = slots[find(hidden.name)];
+    slot.value = hidden.value;
+    slot.depth = hidden.depth;
+    undo.pop_back();
+  }
+}
+
+bool SymbolTable::declare(Symbol name, Value value) {
+  auto index = find(name);
+  if (slots[index].key == empty) {
+    // Keep the load at most one half
+    if (2 * (used + 1) > slots.size()) {
+      grow();
+      index = find(name);
+    }
+    slots[index].key = name.id;
+    ++used;
+  }
+  auto &slot = slots[index];
+  auto current = static_cast<std::uint32_t>(depth());
+  if (slot.value != none && slot.depth == current)
+    return false;
+  if (current > 0)
+    undo.push_back(Undo{name, slot.value, slot.depth});
+  slot.value = value;
+  slot.depth = current;
+  return true;
+}
+
+std::size_t SymbolTable::find(Symbol name) const {
+  // Fibonacci hashing spreads the dense symbol ids over the high bits
+  std::size_t mask = slots.size() - 1;
+  std::size_t index = (name.id * 0x9e3779b9u) >> shift;
+  while (slots[index].key != name.id && slots[index].key != empty)
+    index = (index + 1) & mask;
+  return index;
+}
+
+void SymbolTable::grow() {
+  auto old = std::move(slots);
+  slots.assign(old.size() * 2, Slot{});
+  --shift;
+  for (const auto &slot : old) {
+    if (slot.key != empty)
+      slots[find(Symbol{slot.key})] = slot;
+  }
+}
@@ -0,0 +1,72 @@
+#include "support/thread_pool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threads) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  workers.reserve(threads - 1);
+  for (unsigned i = 1; i < threads; ++i)
+    workers.emplace_back([this] { worker_loop(); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+}
+
+void ThreadPool::parallel_for(std::size_t count,
+                              const std::function<void(std::size_t)> &body) {
+  if (count == 0)
+    return;
+  if (workers.empty() || count == 1) {
+    for (std::size_t i = 0; i < count; ++i)
+      body(i);
+    return;
+  }
+
+  {
+    std::lock_guard lock(mutex);
+    job = &body;
+    job_count = count;
+    next_index.store(0, std::memory_order_relaxed);
+    busy_workers = static_cast<unsigned>(workers.size());
+    ++generation;
+  }
+  wake.notify_all();
+  run_tasks();
+
+  std::unique_lock lock(mutex);
+  done.wait(lock, [this] { return busy_workers == 0; });
+  job = nullptr;
+}
+
+void ThreadPool::worker_loop() {
+  std::uint64_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock lock(mutex);
+      wake.wait(lock, [&] { return stopping || generation != seen; });
+      if (stopping)
+        return;
+      seen = generation;
+    }
+    run_tasks();
+    {
+      std::lock_guard lock(mutex);
+      if (--busy_workers == 0)
+        done.notify_one();
+    }
+  }
+}
+
+void ThreadPool::run_tasks() {
+  for (auto i = next_index.fetch_add(1, std::memory_order_relaxed);
+       i < job_count; i = next_index.fetch_add(1, std::memory_order_relaxed))
+    (*job)(i);
+}
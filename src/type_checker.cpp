@@ -0,0 +1,515 @@
+#include "sema/type_checker.hpp"
+
+#include <algorithm>
+#include <span>
+#include <variant>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace {
+
+// Work on the checker's stack besides nodes: a node whose children are
+// checked, a global variable whose initializer is, and the end of a loop
+struct ExprDone {
+  ExprNode *expr;
+};
+struct StmtDone {
+  StmtNode *stmt;
+};
+struct ExitLoop {};
+using Work = std::variant<ExprNode *, ExprDone, StmtNode *, StmtDone,
+                          GVarDef *, ExitLoop>;
+
+TypeId type_of(const ExprNode &expr) {
+  return std::visit([](const auto &node) { return node.type_id; }, expr);
+}
+
+// The literal 0, which converts to any pointer
+bool is_null(const ExprNode &expr) {
+  const auto *value = std::get_if<EInt>(&expr);
+  return value && value->value == 0;
+}
+
+std::span<const Parameter> params_of(const GlobalNode &global) {
+  if (const auto *func = std::get_if<GFuncDef>(&global))
+    return func->params;
+  if (const auto *func = std::get_if<GFuncDecl>(&global))
+    return func->params;
+  return std::get<GStruct>(global).fields;
+}
+
+// Globals whose function bodies one task of check_types() checks
+constexpr std::size_t globals_per_run = 16;
+
+// Parameters of a function or fields of a struct in member_types
+struct Members {
+  std::uint32_t first = 0;
+  std::uint32_t count = 0;
+};
+
+// What every body is checked against, made before any is: the parameters
+// of every function and fields of every struct, indexed by global DeclId
+struct Signatures {
+  std::vector<Members> members;
+  std::vector<TypeId> member_types;
+};
+
+// Types of the globals go into `types`, each made once
+Signatures collect_signatures(Types &types, const Names &names) {
+  Signatures signatures;
+  auto globals = names.locals.front();
+  signatures.members.resize(globals);
+  for (DeclId id = 0; id < globals; ++id) {
+    const auto &decl = names.decls[id];
+    types.decls[id] = decl.kind == DeclKind::STRUCT
+                          ? types.context.struct_type(id, decl.name)
+                          : types.context.of(*decl.type);
+    if (decl.kind == DeclKind::FUNCTION || decl.kind == DeclKind::STRUCT) {
+      auto params = params_of(*decl.global);
+      signatures.members[id] = {
+          static_cast<std::uint32_t>(signatures.member_types.size()),
+          static_cast<std::uint32_t>(params.size())};
+      for (const auto &param : params)
+        signatures.member_types.push_back(types.context.of(*param.type));
+    }
+  }
+  return signatures;
+}
+
+class Checker {
+public:
+  // Keeps the error at the lowest location in `first`
+  Checker(Types &types, const Signatures &signatures, const Names &names,
+          Diagnostics &diag, std::optional<TypeError> &first)
+      : types(types), context(types.context), signatures(signatures),
+        names(names), diag(diag), first(first) {}
+
+  // All of a global but a function body
+  void check(GlobalNode &global) {
+    std::visit([this](auto &node) { check_global(node); }, global);
+    run();
+  }
+
+  // The body of a function, whose parameters and locals are [begin, end)
+  void check_body(GFuncDef &func, DeclId begin, DeclId end) {
+    for (auto id = begin; id < end; ++id)
+      types.decls[id] = context.of(*names.decls[id].type);
+    for (const auto &param : func.params)
+      check_object(types.decls[param.decl], func.loc);
+    return_type = types.decls[func.decl];
+    loops = 0;
+    work.push_back(func.stmt);
+    run();
+  }
+
+private:
+  std::span<const TypeId> members_of(DeclId decl) const {
+    const auto &members = signatures.members[decl];
+    return std::span(signatures.member_types)
+        .subspan(members.first, members.count);
+  }
+
+  void check_global(GFuncDef &func) { check_signature(func, func.params); }
+  void check_global(GFuncDecl &func) { check_signature(func, func.params); }
+  void check_global(GVarDef &var) {
+    check_object(types.decls[var.decl], var.loc);
+    work.push_back(&var);
+    work.push_back(var.value);
+  }
+  void check_global(GVarDecl &var) {
+    check_object(types.decls[var.decl], var.loc);
+  }
+  // Laid out here, in order, so a struct held by value is laid out before
+  // the structs holding it
+  void check_global(GStruct &record) {
+    auto fields = members_of(record.decl);
+    for (auto type : fields) {
+      check_object(type, record.loc);
+      if (context.kind(type) == TypeClass::STRUCT &&
+          !types.layouts.layout(context.struct_decl(type)).complete)
+        error(record.loc, fmt::format("field has incomplete type '{}'",
+                                      context.to_string(type)));
+    }
+    types.layouts.add(record.decl, record.fields, fields, context);
+    for (std::uint32_t i = 0; i < fields.size(); ++i) {
+      auto name = record.fields[i].name;
+      if (types.layouts.field(record.decl, name) != i)
+        error(record.loc, fmt::format("duplicate member '{}'", name));
+    }
+  }
+
+  // A declaration of a function must agree with its definition; a mismatch
+  // is reported at whichever of the two comes later
+  template <typename Func>
+  void check_signature(const Func &func, std::span<const Parameter> params) {
+    auto expected = members_of(func.decl);
+    bool same = params.size() == expected.size() &&
+                context.of(*func.return_type) == types.decls[func.decl];
+    for (std::size_t i = 0; same && i < params.size(); ++i)
+      same = context.of(*params[i].type) == expected[i];
+    if (same)
+      return;
+    auto loc = func.loc;
+    if (auto defined = names.decls[func.decl].loc; loc.offset < defined.offset)
+      loc = defined;
+    error(loc, fmt::format("conflicting types for '{}'", func.name));
+  }
+
+  // Variables, parameters and fields hold a value
+  void check_object(TypeId type, SourceLoc loc) {
+    if (type == TypeContext::void_type)
+      error(loc, "variable has incomplete type 'void'");
+  }
+
+  // Checks everything on the work stack
+  void run() {
+    while (!work.empty()) {
+      auto item = work.back();
+      work.pop_back();
+      std::visit(overload{
+                     [this](ExprNode *expr) { enter(*expr); },
+                     [this](ExprDone done) { finish(*done.expr); },
+                     [this](StmtNode *stmt) {
+                       current = stmt;
+                       std::visit([this](auto &node) { enter(node); }, *stmt);
+                     },
+                     [this](StmtDone done) { finish(*done.stmt); },
+                     [this](GVarDef *var) {
+                       check_assign(types.decls[var->decl], *var->value,
+                                    var->loc);
+                     },
+                     [this](ExitLoop) { --loops; },
+                 },
+                 item);
+    }
+  }
+
+  // Leaves get their type at once, other expressions once their operands
+  // have theirs. Children are pushed last first, to go in source order.
+  void enter(ExprNode &expr) {
+    std::visit(
+        overload{
+            [this](EVar &var) { var.type_id = types.decls[var.decl]; },
+            [](EInt &value) { value.type_id = TypeContext::int_type; },
+            [](EChar &value) { value.type_id = TypeContext::char_type; },
+            [this](EString &value) {
+              value.type_id = context.pointer_to(TypeContext::char_type);
+            },
+            [this, &expr](EBinOp &op) {
+              work.push_back(ExprDone{&expr});
+              work.push_back(op.rhs);
+              work.push_back(op.lhs);
+            },
+            [this, &expr](EUnOp &op) {
+              work.push_back(ExprDone{&expr});
+              work.push_back(op.rhs);
+            },
+            [this, &expr](ECall &call) {
+              work.push_back(ExprDone{&expr});
+              for (auto arg = call.args.rbegin(); arg != call.args.rend();
+                   ++arg)
+                work.push_back(*arg);
+            },
+            [this, &expr](ENew &alloc) {
+              work.push_back(ExprDone{&expr});
+              work.push_back(alloc.expr);
+            },
+            [this, &expr](EArrayAccess &access) {
+              work.push_back(ExprDone{&expr});
+              work.push_back(access.index);
+            },
+        },
+        expr);
+  }
+
+  void finish(ExprNode &expr) {
+    std::visit(
+        overload{
+            [this](EBinOp &op) { op.type_id = binary(op); },
+            [this](EUnOp &op) {
+              auto operand = type_of(*op.rhs);
+              bool ok = op.op == Uop::NOT ? context.is_scalar(operand)
+                                          : context.is_integer(operand);
+              op.type_id = TypeContext::int_type;
+              if (!ok && operand != TypeContext::error_type) {
+                error(op.loc, fmt::format("invalid operand to unary operator "
+                                          "('{}')",
+                                          context.to_string(operand)));
+                op.type_id = TypeContext::error_type;
+              }
+            },
+            [this](ECall &call) { call.type_id = this->call(call); },
+            [this](ENew &alloc) {
+              auto element = context.of(*alloc.type);
+              check_index(*alloc.expr);
+              if (element == TypeContext::void_type)
+                error(alloc.loc, "allocation of incomplete type 'void'");
+              alloc.type_id = context.pointer_to(element);
+            },
+            [this](EArrayAccess &access) {
+              access.type_id = element(access.loc, access.decl, access.name,
+                                       *access.index, access.label);
+            },
+            [](auto &) {},
+        },
+        expr);
+  }
+
+  TypeId binary(const EBinOp &op) {
+    auto lhs = type_of(*op.lhs), rhs = type_of(*op.rhs);
+    if (lhs == TypeContext::error_type || rhs == TypeContext::error_type)
+      return TypeContext::error_type;
+    bool ok;
+    switch (op.op) {
+    case Bop::EQUAL:
+    case Bop::NOT_EQUAL:
+      ok = (context.is_integer(lhs) && context.is_integer(rhs)) ||
+           (lhs == rhs && context.is_scalar(lhs)) ||
+           (context.kind(lhs) == TypeClass::POINTER && is_null(*op.rhs)) ||
+           (context.kind(rhs) == TypeClass::POINTER && is_null(*op.lhs));
+      break;
+    case Bop::LOGICAL_AND:
+    case Bop::LOGICAL_OR:
+      ok = context.is_scalar(lhs) && context.is_scalar(rhs);
+      break;
+    case Bop::NOT:
+    case Bop::BITWISE_NOT:
+    case Bop::EXPONENTIAL:
+    case Bop::ASSIGN:
+      ok = false;
+      break;
+    default:
+      ok = context.is_integer(lhs) && context.is_integer(rhs);
+      break;
+    }
+    if (ok)
+      return TypeContext::int_type;
+    error(op.loc, fmt::format("invalid operands to binary expression ('{}' "
+                              "and '{}')",
+                              context.to_string(lhs), context.to_string(rhs)));
+    return TypeContext::error_type;
+  }
+
+  TypeId call(const ECall &call) {
+    auto params = members_of(call.decl);
+    if (call.args.size() != params.size()) {
+      error(call.loc,
+            fmt::format("too {} arguments to function call '{}', expected "
+                        "{}, have {}",
+                        call.args.size() < params.size() ? "few" : "many",
+                        call.name, params.size(), call.args.size()));
+    }
+    for (std::size_t i = 0; i < call.args.size() && i < params.size(); ++i)
+      check_assign(params[i], *call.args[i], call.loc);
+    return types.decls[call.decl];
+  }
+
+  // Type of `name[index]`, or of `name[index].label`
+  TypeId element(SourceLoc loc, DeclId decl, Symbol name,
+                 const ExprNode &index, std::optional<Symbol> label) {
+    check_index(index);
+    auto array = types.decls[decl];
+    if (array == TypeContext::error_type)
+      return array;
+    if (context.kind(array) != TypeClass::POINTER) {
+      error(loc, fmt::format("subscripted value '{}' is not a pointer", name));
+      return TypeContext::error_type;
+    }
+    auto element = context.pointee(array);
+    if (!label)
+      return element;
+    if (context.kind(element) != TypeClass::STRUCT) {
+      error(loc, fmt::format("'{}' does not point to a struct", name));
+      return TypeContext::error_type;
+    }
+    auto record = context.struct_decl(element);
+    if (auto field = types.layouts.field(record, *label))
+      return members_of(record)[*field];
+    error(loc, fmt::format("no member named '{}' in '{}'", *label,
+                           context.to_string(element)));
+    return TypeContext::error_type;
+  }
+
+  void check_index(const ExprNode &index) {
+    auto type = type_of(index);
+    if (!context.is_integer(type) && type != TypeContext::error_type)
+      error(std::visit([](const auto &node) { return node.loc; }, index),
+            fmt::format("array size or subscript has type '{}', not an "
+                        "integer",
+                        context.to_string(type)));
+  }
+
+  // `value` may be stored where `target` is expected
+  void check_assign(TypeId target, const ExprNode &value, SourceLoc loc) {
+    auto type = type_of(value);
+    if (target == type || target == TypeContext::error_type ||
+        type == TypeContext::error_type ||
+        (context.is_integer(target) && context.is_integer(type)) ||
+        (context.kind(target) == TypeClass::POINTER && is_null(value)))
+      return;
+    error(loc, fmt::format("incompatible types: expected '{}', got '{}'",
+                           context.to_string(target),
+                           context.to_string(type)));
+  }
+
+  void check_condition(const ExprNode &cond, SourceLoc loc) {
+    auto type = type_of(cond);
+    if (!context.is_scalar(type) && type != TypeContext::error_type)
+      error(loc, fmt::format("condition has type '{}', not a scalar",
+                             context.to_string(type)));
+  }
+
+  void enter(SExpr &stmt) { work.push_back(stmt.expr); }
+  void enter(SVarDef &def) {
+    check_object(types.decls[def.decl], def.loc);
+    push_done(def.value);
+  }
+  void enter(SVarAssign &assign) { push_done(assign.value); }
+  template <typename ArrayAssign> void enter_array(ArrayAssign &assign) {
+    push_done(assign.value);
+    work.push_back(assign.index);
+  }
+  void enter(SArrayAssign &assign) { enter_array(assign); }
+  void enter(SArrayPlusAssign &assign) { enter_array(assign); }
+  void enter(SArrayMinusAssign &assign) { enter_array(assign); }
+  void enter(SScope &scope) {
+    for (auto stmt = scope.stmts.rbegin(); stmt != scope.stmts.rend(); ++stmt)
+      work.push_back(*stmt);
+  }
+  void enter(SIf &stmt) {
+    if (stmt.else_branch)
+      work.push_back(stmt.else_branch);
+    work.push_back(stmt.then_branch);
+    push_done(stmt.cond);
+  }
+  // The condition is checked, and the loop entered, before the body
+  void enter(SWhile &stmt) {
+    work.push_back(ExitLoop{});
+    work.push_back(stmt.stmt);
+    push_done(stmt.cond);
+  }
+  void enter(SBreak &stmt) {
+    if (loops == 0)
+      error(stmt.loc, "'break' statement not in loop statement");
+  }
+  void enter(SReturn &stmt) {
+    if (stmt.expr) {
+      push_done(stmt.expr);
+    } else if (return_type != TypeContext::void_type) {
+      error(stmt.loc, "non-void function should return a value");
+    }
+  }
+  void enter(SDelete &stmt) {
+    auto type = types.decls[stmt.decl];
+    if (context.kind(type) != TypeClass::POINTER &&
+        type != TypeContext::error_type)
+      error(stmt.loc, fmt::format("cannot delete expression of type '{}'",
+                                  context.to_string(type)));
+  }
+
+  // Finishes the statement being entered once `expr` is checked
+  void push_done(ExprNode *expr) {
+    work.push_back(StmtDone{current});
+    work.push_back(expr);
+  }
+
+  void finish(StmtNode &stmt) {
+    std::visit(
+        overload{
+            [this](SVarDef &def) {
+              check_assign(types.decls[def.decl], *def.value, def.loc);
+            },
+            [this](SVarAssign &assign) {
+              check_assign(types.decls[assign.decl], *assign.value,
+                           assign.loc);
+            },
+            [this](SArrayAssign &assign) {
+              auto target = element(assign.loc, assign.decl, assign.name,
+                                    *assign.index, assign.label);
+              check_assign(target, *assign.value, assign.loc);
+            },
+            [this](SArrayPlusAssign &assign) { finish_step(assign); },
+            [this](SArrayMinusAssign &assign) { finish_step(assign); },
+            [this](SIf &stmt) { check_condition(*stmt.cond, stmt.loc); },
+            [this](SWhile &stmt) {
+              check_condition(*stmt.cond, stmt.loc);
+              ++loops;
+            },
+            [this](SReturn &stmt) {
+              if (return_type == TypeContext::void_type)
+                error(stmt.loc, "void function should not return a value");
+              else
+                check_assign(return_type, *stmt.expr, stmt.loc);
+            },
+            [](auto &) {},
+        },
+        stmt);
+  }
+
+  // `a[i]++` and `a[i]--` need an integer element
+  template <typename Step> void finish_step(Step &step) {
+    auto target = element(step.loc, step.decl, step.name, *step.index,
+                          step.label);
+    if (!context.is_integer(target) && target != TypeContext::error_type)
+      error(step.loc, fmt::format("cannot increment or decrement '{}'",
+                                  context.to_string(target)));
+  }
+
+  void error(SourceLoc loc, std::string message) {
+    diag.error(Phase::Types, loc, message);
+    if (!first || loc.offset < first->loc.offset)
+      first = TypeError{loc, std::move(message)};
+  }
+
+  Types &types;
+  TypeContext &context;
+  const Signatures &signatures;
+  const Names &names;
+  Diagnostics &diag;
+  std::optional<TypeError> &first;
+  // Of the function being checked
+  TypeId return_type = TypeContext::void_type;
+  // Loops around the statement being checked
+  int loops = 0;
+  // The statement being entered
+  StmtNode *current = nullptr;
+  std::vector<Work> work;
+};
+
+} // namespace
+
+Types check_types(Prog &prog, const Names &names, Diagnostics &diag,
+                  ThreadPool &pool, bool pack_structs) {
+  Types types;
+  types.layouts = StructLayouts(pack_structs);
+  types.decls.resize(names.decls.size(), TypeContext::error_type);
+  auto signatures = collect_signatures(types, names);
+  Checker checker(types, signatures, names, diag, types.error);
+  for (auto *global : prog.globals)
+    checker.check(*global);
+
+  // The bodies, a run of globals per task. A body only writes the types of
+  // its own nodes and locals.
+  auto runs = (prog.globals.size() + globals_per_run - 1) / globals_per_run;
+  std::vector<std::optional<TypeError>> errors(runs);
+  pool.parallel_for(runs, [&](std::size_t run) {
+    Checker checker(types, signatures, names, diag, errors[run]);
+    auto begin = run * globals_per_run;
+    auto end = std::min(begin + globals_per_run, prog.globals.size());
+    for (auto i = begin; i < end; ++i) {
+      if (auto *func = std::get_if<GFuncDef>(prog.globals[i]))
+        checker.check_body(*func, names.locals[i], names.locals[i + 1]);
+    }
+  });
+  for (auto &error : errors) {
+    if (error && (!types.error || error->loc.offset < types.error->loc.offset))
+      types.error = std::move(error);
+  }
+  return types;
+}
+
+Types check_types(Prog &prog, const Names &names, Diagnostics &diag) {
+  ThreadPool pool(1);
+  return check_types(prog, names, diag, pool);
+}
@@ -0,0 +1,102 @@
+#include "sema/type_context.hpp"
+
+#include <mutex>
+#include <variant>
+
+TypeContext::TypeContext() : state(std::make_unique<State>()) {
+  add(TypeClass::VOID, 0, Symbol{});
+  add(TypeClass::INT, 0, Symbol{});
+  add(TypeClass::CHAR, 0, Symbol{});
+  add(TypeClass::ERROR, 0, Symbol{});
+}
+
+TypeId TypeContext::add(TypeClass kind, std::uint32_t operand, Symbol name) {
+  auto type = state->count.load(std::memory_order_relaxed);
+  auto index = std::uint64_t{type} + (1u << first_chunk_bits);
+  auto bits = std::bit_width(index) - 1;
+  auto &chunk = state->chunks[bits - first_chunk_bits];
+  if (!chunk)
+    chunk = std::make_unique<Type[]>(std::size_t{1} << bits);
+  auto &added = chunk[index - (std::uint64_t{1} << bits)];
+  added.kind = kind;
+  added.operand = operand;
+  added.name = name;
+  state->count.store(type + 1, std::memory_order_release);
+  return type;
+}
+
+TypeId TypeContext::pointer_to(TypeId pointee) {
+  if (pointee == error_type)
+    return error_type;
+  auto &type = at(pointee);
+  auto pointer = type.pointer.load(std::memory_order_acquire);
+  if (pointer != no_type)
+    return pointer;
+  std::unique_lock lock(state->mutex);
+  pointer = type.pointer.load(std::memory_order_relaxed);
+  if (pointer == no_type) {
+    pointer = add(TypeClass::POINTER, pointee, Symbol{});
+    type.pointer.store(pointer, std::memory_order_release);
+  }
+  return pointer;
+}
+
+TypeId TypeContext::struct_type(DeclId decl, Symbol name) {
+  {
+    std::shared_lock lock(state->mutex);
+    if (auto found = state->structs.find(decl); found != state->structs.end())
+      return found->second;
+  }
+  std::unique_lock lock(state->mutex);
+  auto [found, added] = state->structs.try_emplace(decl, no_type);
+  if (added)
+    found->second = add(TypeClass::STRUCT, decl, name);
+  return found->second;
+}
+
+TypeId TypeContext::of(const TypeNode &node) {
+  int pointers = 0;
+  const auto *base = &node;
+  while (const auto *pointer = std::get_if<TPoint>(base)) {
+    base = pointer->point_type;
+    ++pointers;
+  }
+  TypeId type = error_type;
+  if (std::holds_alternative<TVoid>(*base))
+    type = void_type;
+  else if (std::holds_alternative<TInt>(*base))
+    type = int_type;
+  else if (std::holds_alternative<TChar>(*base))
+    type = char_type;
+  else if (const auto &ident = std::get<TIdent>(*base); ident.decl != no_decl)
+    type = struct_type(ident.decl, ident.name);
+  for (; pointers > 0; --pointers)
+    type = pointer_to(type);
+  return type;
+}
+
+std::string TypeContext::to_string(TypeId type) const {
+  int pointers = 0;
+  for (; kind(type) == TypeClass::POINTER; type = pointee(type))
+    ++pointers;
+  std::string text;
+  switch (kind(type)) {
+  case TypeClass::VOID:
+    text = "void";
+    break;
+  case TypeClass::INT:
+    text = "int";
+    break;
+  case TypeClass::CHAR:
+    text = "char";
+    break;
+  case TypeClass::STRUCT:
+    text = at(type).name.str();
+    break;
+  default:
+    text = "<error>";
+    break;
+  }
+  text.append(pointers, '*');
+  return text;
+}
@@ -0,0 +1,100 @@
+// Arena hands out aligned, non-overlapping memory across chunk boundaries,
+// including requests larger than a chunk, copies lists intact and hands
+// its chunks over to another arena on adopt().
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "support/arena.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+struct Block {
+  unsigned char *data;
+  std::size_t size;
+  unsigned char fill;
+};
+
+} // namespace
+
+int main() {
+  std::mt19937 rng(1234);
+  // A tiny first chunk so that growth and oversized requests both happen
+  Arena arena(256);
+  std::vector<Block> blocks;
+  std::size_t requested = 0;
+  for (int i = 0; i < 20000; ++i) {
+    std::size_t align = std::size_t{1} << rng() % 5;
+    std::size_t size = rng() % 8 == 0 ? rng() % 5000 : rng() % 64;
+    auto *data = static_cast<unsigned char *>(arena.allocate(size, align));
+    check(reinterpret_cast<std::uintptr_t>(data) % align == 0,
+          fmt::format("allocation {} aligned to {}", i, align));
+    auto fill = static_cast<unsigned char>(i);
+    std::fill_n(data, size, fill);
+    blocks.push_back({data, size, fill});
+    requested += size;
+  }
+  // Any overlap would have overwritten an earlier block
+  for (std::size_t i = 0; i < blocks.size(); ++i) {
+    const auto &block = blocks[i];
+    bool intact = std::all_of(block.data, block.data + block.size,
+                              [&](unsigned char c) { return c == block.fill; });
+    check(intact, fmt::format("block {} intact", i));
+  }
+  check(arena.bytes_used() >= requested, "bytes_used covers every request");
+  check(arena.chunk_count() > 1, "arena grew past its first chunk");
+
+  struct Pair {
+    int key;
+    double value;
+  };
+  auto *pair = arena.make<Pair>(Pair{7, 2.5});
+  check(pair->key == 7 && pair->value == 2.5, "make constructs in place");
+
+  std::vector<int> items(1000);
+  for (std::size_t i = 0; i < items.size(); ++i)
+    items[i] = static_cast<int>(i * i);
+  auto copied = arena.copy<int>(items);
+  check(copied.size() == items.size() &&
+            std::equal(copied.begin(), copied.end(), items.begin()),
+        "copy preserves the list");
+  check(arena.copy<int>(std::vector<int>{}).empty(), "copy of empty list");
+
+  // Adopted chunks outlive the arena they came from, both into an arena
+  // already in use and into an empty one
+  Arena empty;
+  for (auto *into : {&arena, &empty}) {
+    std::span<int> moved;
+    auto used = into->bytes_used();
+    auto chunks = into->chunk_count();
+    std::size_t adopted_bytes = 0, adopted_chunks = 0;
+    {
+      Arena part(256);
+      for (int i = 0; i < 100; ++i)
+        part.allocate(100, 8);
+      moved = part.copy<int>(items);
+      adopted_bytes = part.bytes_used();
+      adopted_chunks = part.chunk_count();
+      into->adopt(part);
+      check(part.bytes_used() == 0 && part.chunk_count() == 0,
+            "adopt empties the source arena");
+    }
+    check(std::equal(moved.begin(), moved.end(), items.begin()),
+          "adopted memory survives its old arena");
+    check(into->bytes_used() == used + adopted_bytes &&
+              into->chunk_count() == chunks + adopted_chunks,
+          "adopt carries the byte and chunk counts over");
+    auto *after = into->make<Pair>(Pair{9, 1.5});
+    check(after->key == 9 && std::equal(moved.begin(), moved.end(),
+                                        items.begin()),
+          "allocating after adopt leaves adopted memory alone");
+  }
+
+  return finish("arena_test");
+}
@@ -0,0 +1,121 @@
+// The generated IR passes the LLVM verifier for the syntax test file, packed
+// or not, and for deeply nested code. Constant global initializers fold,
+// others go to a module constructor, and the object file is x86-64 ELF.
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+#include <fmt/core.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/raw_ostream.h>
+#include <unistd.h>
+
+#include "codegen/codegen.hpp"
+#include "common.hpp"
+#include "frontend/frontend.hpp"
+#include "sema/name_analysis.hpp"
+#include "sema/type_checker.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "support/thread_pool.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+constexpr std::size_t depth = 100'000;
+
+// Checks `source`, generates its module and hands it to `inspect`
+template <typename Inspect>
+void generate(std::string_view name, std::string source, bool pack,
+              llvm::TargetMachine &target, Inspect inspect) {
+  SourceManager sources;
+  auto file = sources.add_file(SourceBuffer::from_string(source));
+  auto result = parse_unit(sources, file, CigridFlags{});
+  check(result.ok(), fmt::format("{} parses", name));
+  if (!result.ok())
+    return;
+  ThreadPool pool(1);
+  auto names = resolve_names(*result.prog, result.diag, pool);
+  auto types = check_types(*result.prog, names, result.diag, pool, pack);
+  check(names.ok() && types.ok(), fmt::format("{} checks", name));
+  if (!names.ok() || !types.ok())
+    return;
+  llvm::LLVMContext context;
+  auto module =
+      generate_module(*result.prog, names, types, context, target, name);
+  std::string errors;
+  llvm::raw_string_ostream out(errors);
+  check(!llvm::verifyModule(*module, &out),
+        fmt::format("{} verifies: {}", name, out.str()));
+  inspect(*module);
+}
+
+const char *program =
+    "extern int printf(char* format, int x);\n"
+    "struct P {\n  char a;\n  P* next;\n  int b;\n};\n"
+    "int answer = 6 * 7;\n"
+    "int twice = answer * 2;\n"
+    "char* greeting = \"hello\";\n"
+    "int sum(P* p, int n) {\n  int s = 0;\n  int i = 0;\n"
+    "  while (i < n && p != 0) {\n    s = s + p[i].a + p[i].b;\n"
+    "    i++;\n  }\n  return s;\n}\n"
+    "int main() {\n  P* p = new P[2];\n  p[0].a = 1;\n  p[1].b = 2;\n"
+    "  printf(greeting, sum(p, 2));\n  delete[] p;\n  return 0;\n}\n";
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Diagnostics diag;
+  auto target = x86_64_target(diag);
+  check(target != nullptr, "the x86-64 target is made");
+  if (!target)
+    return finish("codegen_test");
+  auto ignore = [](llvm::Module &) {};
+
+  if (argc > 1) {
+    auto source = SourceBuffer::from_file(argv[1]);
+    check(source.has_value(), fmt::format("{} is read", argv[1]));
+    if (source) {
+      std::string text(source->view());
+      generate("test.cpp", text, false, *target, ignore);
+      generate("packed test.cpp", text, true, *target, ignore);
+    }
+  }
+
+  generate("deep expression",
+           "int main() {\n  return " + repeat("1 + (", depth) + "1" +
+               repeat(")", depth) + ";\n}\n",
+           false, *target, ignore);
+  generate("deep statements",
+           "int main() {\n  int x = 1;\n" +
+               repeat("while (x) {\nif (x) {\nbreak;\n} else {\n", depth) +
+               "x = 0;\n" + repeat("}\n}\n", depth) + "  return x;\n}\n",
+           false, *target, ignore);
+
+  auto path = std::filesystem::temp_directory_path() /
+              fmt::format("codegen_test_{}.o", ::getpid());
+  generate("program", program, true, *target, [&](llvm::Module &module) {
+    const auto *answer = module.getGlobalVariable("answer");
+    check(answer && answer->hasInitializer() &&
+              answer->getInitializer()->getUniqueInteger() == 42,
+          "a constant initializer folds");
+    check(module.getGlobalVariable("llvm.global_ctors") != nullptr,
+          "an initializer reading a global runs in a constructor");
+    check(module.getFunction("malloc") && module.getFunction("free"),
+          "new and delete call malloc and free");
+    check(emit_object(module, *target, path.string(), diag),
+          "the object file is written");
+  });
+  std::ifstream object(path, std::ios::binary);
+  char magic[5] = {};
+  object.read(magic, 5);
+  check(magic[0] == 0x7f && std::string_view(magic + 1, 3) == "ELF" &&
+            magic[4] == 2,
+        "the object file is 64-bit ELF");
+  std::filesystem::remove(path);
+
+  return finish("codegen_test");
+}
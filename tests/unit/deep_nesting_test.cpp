@@ -0,0 +1,152 @@
+// Parsing and printing must not recurse per level of nesting: expressions
+// and statements nested a million levels deep (a hundred thousand without
+// NDEBUG) parse with both builders and print exactly as expected, on a
+// thread whose stack is far too small for one native frame per level.
+#include <string>
+#include <string_view>
+#include <variant>
+
+#include <fmt/format.h>
+#include <pthread.h>
+
+#include "common.hpp"
+#include "diagnostics/diagnostics.hpp"
+#include "parser/flat_ast.hpp"
+#include "parser/parser.hpp"
+#include "printer/ast_printer.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+// Debug builds take ten times as long per level. A tenth of the depth
+// still needs far more stack than the thread has, at one frame per level.
+#ifdef NDEBUG
+constexpr std::size_t depth = 1'000'000;
+#else
+constexpr std::size_t depth = 100'000;
+#endif
+constexpr std::size_t stack_size = 1 << 20;
+
+struct Case {
+  std::string_view name;
+  std::string text;
+  // Printed program
+  std::string expected;
+};
+
+// `int a = <open> 1 <close>;`, printing as `<print_open> EInt(1) <print_close>`
+Case expr_case(std::string_view name, std::string_view open,
+               std::string_view close, std::string_view print_open,
+               std::string_view print_close) {
+  return {name,
+          "int a = " + repeat(open, depth) + "1" + repeat(close, depth) +
+              ";\n",
+          "GVarDef(TInt, a, " + repeat(print_open, depth) + "EInt(1)" +
+              repeat(print_close, depth) + ")\n\n\n"};
+}
+
+// `int main() { <open> x = 1; }` for statements that do not indent
+Case stmt_case(std::string_view name, std::string_view open,
+               std::string_view print_open, std::string_view print_close) {
+  return {name,
+          "int main() {\n" + repeat(open, depth) + "x = 1;\n}\n",
+          "GFuncDef(TInt, main, {}, \n  SScope({\n" +
+              repeat(print_open, depth) + "    SVarAssign(\"x\", EInt(1))" +
+              repeat(print_close, depth) + "\n  }))\n\n\n"};
+}
+
+void check_case(const Case &test) {
+  SourceManager sources;
+  auto file = sources.add_file(SourceBuffer::from_string(test.text));
+  CigridFlags flags;
+  Diagnostics diag;
+  auto tree = Parser(sources, file, diag, flags).parse();
+  check(tree && print(*tree) == test.expected,
+        fmt::format("{}: parses and prints", test.name));
+  auto flat = FlatParser(sources, file, diag, flags).parse();
+  check(flat && print(*to_tree(*flat)) == test.expected,
+        fmt::format("{}: flat parse prints", test.name));
+}
+
+// Nested scopes indent every level, so they are not printed: their output
+// grows with the square of the depth
+void check_scopes() {
+  auto text = "int main() {\n" + repeat("{", depth) + "x = 1;" +
+              repeat("}", depth) + "\n}\n";
+  SourceManager sources;
+  auto file = sources.add_file(SourceBuffer::from_string(text));
+  CigridFlags flags;
+  Diagnostics diag;
+  auto prog = Parser(sources, file, diag, flags).parse();
+  std::size_t levels = 0;
+  if (prog) {
+    const auto *stmt = std::get<GFuncDef>(*prog->globals[0]).stmt;
+    while (const auto *scope = std::get_if<SScope>(stmt)) {
+      if (scope->stmts.size() != 1)
+        break;
+      stmt = scope->stmts[0];
+      ++levels;
+    }
+  }
+  check(levels == depth + 1,
+        fmt::format("nested scopes: {} levels, expected {}", levels,
+                    depth + 1));
+  check(FlatParser(sources, file, diag, flags).parse() != nullptr,
+        "nested scopes: flat parse");
+}
+
+// Unclosed nesting fails with a syntax error, after unwinding every level
+void check_unclosed(std::string_view name, const std::string &text) {
+  SourceManager sources;
+  auto file = sources.add_file(SourceBuffer::from_string(text));
+  CigridFlags flags;
+  Diagnostics diag;
+  Parser parser(sources, file, diag, flags);
+  check(!parser.parse() && parser.parse_error() && diag.has_errors(),
+        fmt::format("{}: fails with a syntax error", name));
+}
+
+void *run(void *) {
+  check_case(expr_case("parentheses", "(", ")", "", ""));
+  check_case({"left-leaning +",
+              "int a = 1" + repeat(" + 1", depth) + ";\n",
+              "GVarDef(TInt, a, " + repeat("EBinOp(+, ", depth) + "EInt(1)" +
+                  repeat(", EInt(1))", depth) + ")\n\n\n"});
+  check_case(expr_case("right-leaning +", "1 + (", ")", "EBinOp(+, EInt(1), ",
+                       ")"));
+  check_case(expr_case("unary operators", "-!", "", "EUnOp(-, EUnOp(!, ",
+                       "))"));
+  check_case(expr_case("calls", "f(", ")", "ECall(\"f\", {", "})"));
+  check_case(expr_case("array accesses", "a[", "]", "EArrayAccess(\"a\", ",
+                       ")"));
+  check_case(expr_case("new", "new int[", "]", "ENew(TInt, ", ")"));
+  check_case(stmt_case("else-if ladder", "if (x) x = 1; else ",
+                       "    SIf(EVar(\"x\"),     SVarAssign(\"x\", EInt(1)), ",
+                       ")"));
+  check_case(stmt_case("nested while", "while (x) ", "    SWhile(EVar(\"x\"), ",
+                       ")"));
+  check_scopes();
+  check_unclosed("unclosed parentheses",
+                 "int a = " + repeat("(", depth) + "1;\n");
+  check_unclosed("unclosed scopes", "int main() " + repeat("{", depth));
+  return nullptr;
+}
+
+} // namespace
+
+int main() {
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, stack_size);
+  pthread_t thread;
+  if (pthread_create(&thread, &attr, run, nullptr) != 0) {
+    fmt::print(stderr, "cannot start the test thread\n");
+    return 1;
+  }
+  pthread_join(thread, nullptr);
+  pthread_attr_destroy(&attr);
+
+  return finish("deep_nesting_test", fmt::format("depth {}", depth));
+}
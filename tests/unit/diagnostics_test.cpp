@@ -0,0 +1,91 @@
+// Many threads reporting to one Diagnostics at once must print exactly what
+// reporting the same messages in source order prints, with every location
+// shown as file:line:column.
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "diagnostics/diagnostics.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "support/thread_pool.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+constexpr std::uint32_t lines = 20000;
+
+std::string print(const Diagnostics &diag, const SourceManager &sources) {
+  fmt::memory_buffer out;
+  diag.print_all(sources, out);
+  return fmt::to_string(out);
+}
+
+// Every line gets a lexer and a parser message. The parser's goes in
+// first, print_all() has to put the lexer's back in front of it.
+void report(Diagnostics &diag, const SourceManager &sources, FileId file,
+            std::uint32_t line) {
+  auto loc = sources.loc(file, line * 3);
+  diag.error(Phase::Parse, loc, fmt::format("parse {}", line));
+  diag.error(Phase::Lex, loc, fmt::format("lex {}", line));
+}
+
+} // namespace
+
+int main() {
+  std::string text;
+  for (std::uint32_t i = 0; i < lines; ++i)
+    text.append("x;\n");
+  SourceManager sources;
+  auto file = sources.add_file(SourceBuffer::from_string(text, "input.c"));
+
+  Diagnostics serial;
+  for (std::uint32_t line = 0; line < lines; ++line) {
+    serial.error(Phase::Lex, sources.loc(file, line * 3),
+                 fmt::format("lex {}", line));
+    serial.error(Phase::Parse, sources.loc(file, line * 3),
+                 fmt::format("parse {}", line));
+  }
+  auto expected = print(serial, sources);
+  check(expected.find("input.c:7:1") != std::string::npos,
+        "locations are printed");
+
+  // Lines are reported in shuffled blocks, a few threads at a time
+  std::vector<std::uint32_t> blocks(lines / 100);
+  std::iota(blocks.begin(), blocks.end(), 0);
+  std::shuffle(blocks.begin(), blocks.end(), std::mt19937(3));
+  for (unsigned threads : {1u, 2u, 8u}) {
+    ThreadPool pool(threads);
+    Diagnostics diag;
+    pool.parallel_for(blocks.size(), [&](std::size_t i) {
+      for (std::uint32_t line = blocks[i] * 100; line < blocks[i] * 100 + 100;
+           ++line)
+        report(diag, sources, file, line);
+    });
+    check(diag.error_count() == static_cast<int>(2 * lines),
+          fmt::format("{} threads: error count", threads));
+    check(print(diag, sources) == expected,
+          fmt::format("{} threads: printed in source order", threads));
+
+    // A merged sink prints the same, and the merged one is empty
+    Diagnostics merged;
+    merged.merge(std::move(diag));
+    check(print(merged, sources) == expected && !diag.has_errors(),
+          fmt::format("{} threads: merged", threads));
+  }
+
+  // Driver messages have no location and go before the rest
+  Diagnostics diag;
+  diag.error(Phase::Parse, sources.loc(file, 0), "parse 0");
+  diag.fatal("no input");
+  check(print(diag, sources).starts_with("\x1b[1mzzc_cigrid") &&
+            print(diag, sources).ends_with("Compileation terminated.\n"),
+        "fatal errors first");
+
+  return finish("diagnostics_test");
+}
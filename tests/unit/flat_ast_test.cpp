@@ -0,0 +1,89 @@
+// FlatParser builds the same program as Parser: converting its FlatAst back
+// with to_tree must print byte-identically, and every child must come
+// before its parent in the tables.
+#include <string>
+#include <string_view>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "diagnostics/diagnostics.hpp"
+#include "parser/flat_ast.hpp"
+#include "parser/parser.hpp"
+#include "printer/ast_printer.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+// Children of a node in the same table must come before it
+void check_before(NodeId child, NodeId parent, std::string_view table) {
+  if (child != no_node && child >= parent)
+    check(false, fmt::format("{} {} refers forward to {}", table, parent,
+                             child));
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  auto source = source_argument(argc, argv);
+  if (!source)
+    return 1;
+  SourceManager sources;
+  auto file = sources.add_file(std::move(*source));
+  CigridFlags flags;
+  Diagnostics diag;
+
+  auto tree = Parser(sources, file, diag, flags).parse();
+  auto flat = FlatParser(sources, file, diag, flags).parse();
+  auto expected = print(*tree);
+  check(!expected.empty(), "tree printed");
+  check(print(*to_tree(*flat)) == expected, "to_tree prints identically");
+
+  check(flat->types.size() > 0 && flat->exprs.size() > 0 &&
+            flat->stmts.size() > 0 && flat->globals.size() > 0,
+        "every table used");
+  for (NodeId id = 0; id < flat->types.size(); ++id) {
+    if (flat->types.kind[id] == TypeKind::POINT)
+      check_before(flat->types.operand(id, 0), id, "type");
+  }
+  for (NodeId id = 0; id < flat->exprs.size(); ++id) {
+    switch (flat->exprs.kind[id]) {
+    case ExprKind::BIN_OP:
+      check_before(flat->exprs.operand(id, 2), id, "expr");
+      [[fallthrough]];
+    case ExprKind::UN_OP:
+    case ExprKind::NEW:
+    case ExprKind::ARRAY_ACCESS:
+      check_before(flat->exprs.operand(id, 1), id, "expr");
+      break;
+    case ExprKind::CALL:
+      for (auto arg : flat->list(flat->exprs.operand(id, 1)))
+        check_before(arg, id, "expr");
+      break;
+    default:
+      break;
+    }
+  }
+  for (NodeId id = 0; id < flat->stmts.size(); ++id) {
+    switch (flat->stmts.kind[id]) {
+    case StmtKind::IF:
+      check_before(flat->stmts.operand(id, 2), id, "stmt");
+      [[fallthrough]];
+    case StmtKind::WHILE:
+      check_before(flat->stmts.operand(id, 1), id, "stmt");
+      break;
+    case StmtKind::SCOPE:
+      for (auto stmt : flat->list(flat->stmts.operand(id, 0)))
+        check_before(stmt, id, "stmt");
+      break;
+    default:
+      break;
+    }
+  }
+  check(flat->list(flat->prog).size() == tree->globals.size(),
+        "same number of globals");
+
+  return finish("flat_ast_test");
+}
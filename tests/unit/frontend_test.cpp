@@ -0,0 +1,81 @@
+// The front-end library must survive syntax errors: many units are parsed
+// back to back in one process, each bad unit reports its error line through
+// its ParseResult, and good units parsed afterwards still succeed.
+#include <string>
+#include <string_view>
+
+#include <fmt/core.h>
+
+#include "common.hpp"
+#include "frontend/frontend.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+struct BadUnit {
+  std::string_view text;
+  int line;
+};
+
+// Each snippet has exactly one syntax error, on the given line
+constexpr BadUnit bad_units[] = {
+    {"int main() {\n  int x = ;\n}\n", 2},
+    {"int main() {\n  return 0;\n", 3},
+    {"struct S {\n  int a;\n  int b\n};\n", 4},
+    {"int f(int a,) {\n  return a;\n}\n", 1},
+    {"int main() {\n  if (1) {\n    x = 1 +;\n  }\n}\n", 3},
+    {"int\n", 2},
+};
+
+void check_good(const SourceManager &sources, FileId file,
+                const CigridFlags &flags, std::string_view name) {
+  auto result = parse_unit(sources, file, flags);
+  check(result.ok(), fmt::format("{} parses", name));
+  check(!result.error, fmt::format("{} has no error", name));
+  check(!result.diag.has_errors(), fmt::format("{} has no diagnostics", name));
+  check(result.ok() && !result.prog->globals.empty(),
+        fmt::format("{} has globals", name));
+}
+
+void check_bad(const SourceManager &sources, FileId file,
+               const CigridFlags &flags, const BadUnit &unit) {
+  auto result = parse_unit(sources, file, flags);
+  auto name = fmt::format("unit {:?}", unit.text);
+  check(!result.ok(), fmt::format("{} fails", name));
+  check(result.diag.has_errors(), fmt::format("{} reports an error", name));
+  if (!result.error) {
+    check(false, fmt::format("{} carries its ParseError", name));
+    return;
+  }
+  auto line = sources.position(result.error->loc).line;
+  check(line == unit.line, fmt::format("{} errors on line {}, expected {}",
+                                       name, line, unit.line));
+  check(!result.error->message.empty(), fmt::format("{} has a message", name));
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  auto source = source_argument(argc, argv);
+  if (!source)
+    return 1;
+  SourceManager sources;
+  auto good = sources.add_file(std::move(*source));
+
+  for (bool flat : {false, true}) {
+    CigridFlags flags;
+    flags.flat_ast = flat;
+    for (int round = 0; round < 50; ++round) {
+      check_good(sources, good, flags, argv[1]);
+      for (const auto &unit : bad_units) {
+        auto file = sources.add_file(SourceBuffer::from_string(unit.text));
+        check_bad(sources, file, flags, unit);
+      }
+    }
+    check_good(sources, good, flags, argv[1]);
+  }
+
+  return finish("frontend_test");
+}
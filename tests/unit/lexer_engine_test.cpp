@@ -0,0 +1,125 @@
+// Differential test for the two lexer engines.
+//
+// The table-driven DFA engine must produce exactly the tokens, positions and
+// errors of the switch engine, on the files given on the command line, on
+// random token soup and on random bytes.
+#include <cctype>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "diagnostics/diagnostics.hpp"
+#include "lexer/char_table.hpp"
+#include "lexer/lexer.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+void test_char_table() {
+  for (int c = 0; c < 256; ++c) {
+    char ch = static_cast<char>(c);
+    auto where = fmt::format("byte {}", c);
+    check(is_space(ch) == (std::isspace(c) != 0), "is_space " + where);
+    check(is_alpha(ch) == (std::isalpha(c) != 0), "is_alpha " + where);
+    check(is_digit(ch) == (std::isdigit(c) != 0), "is_digit " + where);
+    check(is_xdigit(ch) == (std::isxdigit(c) != 0), "is_xdigit " + where);
+  }
+}
+
+struct Lexed {
+  std::vector<Token> tokens;
+  std::vector<Position> positions;
+  bool has_errors;
+};
+
+Lexed lex_with(LexerEngine engine, std::string_view text) {
+  SourceManager sources;
+  auto file = sources.add_file(SourceBuffer::from_string(text));
+  Diagnostics diag;
+  Lexer lexer(sources, file, diag, engine);
+  Lexed result;
+  result.tokens = lexer.gen_token();
+  for (const auto &token : result.tokens)
+    result.positions.push_back(sources.position(lexer.loc(token.offset)));
+  result.has_errors = diag.has_errors();
+  return result;
+}
+
+void compare_engines(std::string_view source, const std::string &name) {
+  auto ref = lex_with(LexerEngine::SWITCH, source);
+  auto dfa = lex_with(LexerEngine::DFA, source);
+  check(dfa.tokens.size() == ref.tokens.size(), "token count on " + name);
+  check(dfa.has_errors == ref.has_errors, "errors on " + name);
+  for (std::size_t i = 0; i < dfa.tokens.size() && i < ref.tokens.size();
+       ++i) {
+    const Token &a = ref.tokens[i];
+    const Token &b = dfa.tokens[i];
+    check(a.kind == b.kind && a.offset == b.offset && a.length == b.length &&
+              a.payload == b.payload,
+          fmt::format("token {} on {}", i, name));
+    check(ref.positions[i].line == dfa.positions[i].line &&
+              ref.positions[i].column == dfa.positions[i].column,
+          fmt::format("position of token {} on {}", i, name));
+  }
+}
+
+std::string random_program(std::mt19937 &rng) {
+  static const char *pieces[] = {
+      "int",   "x1",     "_tmp",  "while", "return", "  ",   "\t",   "\n",
+      "/* comment * / **/",     "/*/ closes */",  "// line comment\n",
+      "# include <x>\n",        "+",     "-",     "*",    "/",    "%",
+      "<<",    ">>",     "<=",    ">=",    "<",    ">",    "==",   "=",
+      "!=",    "!",      "&&",    "&",     "||",   "|",    "^",    "~",
+      "(",     ")",      "[",     "]",     "{",    "}",    ";",    ",",
+      ".",     "123",    "0x1F",  "0",     "'a'",  "'\\n'", "\"str\\t\""};
+  std::string text;
+  int count = rng() % 400;
+  for (int i = 0; i < count; ++i) {
+    text += pieces[rng() % std::size(pieces)];
+    // Leave operators glued together now and then
+    if (rng() % 3 != 0)
+      text += ' ';
+  }
+  return text + "\n";
+}
+
+std::string random_bytes(std::mt19937 &rng) {
+  // Mostly lexable bytes so that the soup does not stop at the first error
+  static const std::string alphabet =
+      " \n\t/*#<>=!|&+-~^%()[]{};,.'\"\\_ax0F9";
+  std::string text(rng() % 300, ' ');
+  for (auto &c : text) {
+    c = rng() % 16 == 0 ? static_cast<char>(rng() % 256)
+                        : alphabet[rng() % alphabet.size()];
+  }
+  return text;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::mt19937 rng(4242);
+  test_char_table();
+
+  for (int i = 1; i < argc; ++i) {
+    auto file = SourceBuffer::from_file(argv[i]);
+    check(file.has_value(), fmt::format("cannot open {}", argv[i]));
+    if (file)
+      compare_engines(file->view(), argv[i]);
+  }
+  for (int round = 0; round < 2000; ++round) {
+    compare_engines(random_program(rng),
+                    fmt::format("random program {}", round));
+  }
+  for (int round = 0; round < 20000; ++round) {
+    compare_engines(random_bytes(rng), fmt::format("random bytes {}", round));
+  }
+
+  return finish("lexer_engine_test");
+}
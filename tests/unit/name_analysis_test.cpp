@@ -0,0 +1,254 @@
+// Name analysis binds every use to the right declaration and reports the
+// first bad name on its line. The symbol table behind it must agree with a
+// stack of maps on random scopes, and a hundred thousand nested scopes
+// resolve without recursion.
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "common.hpp"
+#include "diagnostics/diagnostics.hpp"
+#include "frontend/frontend.hpp"
+#include "sema/name_analysis.hpp"
+#include "sema/symbol_table.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+struct Unit {
+  std::string_view text;
+  // Line of the first name error, 0 for none
+  int line;
+};
+
+constexpr Unit units[] = {
+    {"int f(int a) {\n  int b = a;\n  {\n    int a = b;\n  }\n  return a;\n}\n",
+     0},
+    {"int main() {\n  return x;\n}\n", 2},
+    {"int main() {\n  int x = 1;\n  int x = 2;\n}\n", 3},
+    {"int f(int a) {\n  int a = 1;\n}\n", 2},
+    {"int f(int a, int a) {\n  return a;\n}\n", 1},
+    {"int main() {\n  {\n    int x = 1;\n  }\n  x = 2;\n}\n", 5},
+    {"int main() {\n  if (1) int x = 1;\n  return x;\n}\n", 3},
+    {"int main() {\n  int x = x;\n}\n", 2},
+    {"int main() {\n  return f(1);\n}\nint f(int a) {\n  return a;\n}\n", 2},
+    {"int f(int a) {\n  return f(a);\n}\n", 0},
+    {"extern int f(int a);\nint g() {\n  return f(1);\n}\n"
+     "int f(int a) {\n  return a;\n}\n",
+     0},
+    {"int f() {\n  return 0;\n}\nint f() {\n  return 1;\n}\n", 4},
+    {"int x = 1;\nint main() {\n  return x(1);\n}\n", 3},
+    {"int f() {\n  return 0;\n}\nint main() {\n  return f + 1;\n}\n", 5},
+    {"struct Node {\n  Node* next;\n};\nNode* head = 0;\n", 0},
+    {"int main() {\n  Leaf* l = 0;\n}\n", 2},
+    {"int main() {\n  int* p = new int[2];\n  delete[] q;\n}\n", 3},
+    {"int main() {\n  int a = 0;\n  b[a] = 1;\n}\n", 3},
+    {"int x = 1;\nint f() {\n  int x = x + 1;\n  return x;\n}\n", 0},
+};
+
+void check_unit(const Unit &unit) {
+  SourceManager sources;
+  auto file = sources.add_file(SourceBuffer::from_string(unit.text));
+  auto result = parse_unit(sources, file, CigridFlags{});
+  auto name = fmt::format("unit {:?}", unit.text);
+  check(result.ok(), fmt::format("{} parses", name));
+  if (!result.ok())
+    return;
+  auto names = resolve_names(*result.prog, result.diag);
+  int line = names.error ? sources.position(names.error->loc).line : 0;
+  check(line == unit.line, fmt::format("{}: error on line {}, expected {}",
+                                       name, line, unit.line));
+  check(result.diag.has_errors() == !names.ok(),
+        fmt::format("{}: diagnostics", name));
+}
+
+// Every use and declaration in the tree is bound to a declaration of its
+// own name
+class BindingCheck {
+public:
+  explicit BindingCheck(const Names &names) : names(names) {}
+
+  void global(const GlobalNode &global) {
+    std::visit(overload{
+                   [&](const GFuncDef &func) {
+                     bound(func.decl, func.name, "function");
+                     for (const auto &param : func.params)
+                       bound(param.decl, param.name, "parameter");
+                     stmt(*func.stmt);
+                   },
+                   [&](const GVarDef &var) {
+                     bound(var.decl, var.name, "global");
+                     expr(*var.value);
+                   },
+                   [&](const auto &other) {
+                     bound(other.decl, other.name, "declaration");
+                   },
+               },
+               global);
+  }
+
+  int checked = 0;
+
+private:
+  void bound(DeclId decl, Symbol name, std::string_view what) {
+    ++checked;
+    check(decl < names.decls.size() && names.decls[decl].name == name,
+          fmt::format("{} {} is bound", what, name));
+  }
+
+  void expr(const ExprNode &node) {
+    std::visit(overload{
+                   [&](const EVar &var) { bound(var.decl, var.name, "var"); },
+                   [&](const EBinOp &op) {
+                     expr(*op.lhs);
+                     expr(*op.rhs);
+                   },
+                   [&](const EUnOp &op) { expr(*op.rhs); },
+                   [&](const ECall &call) {
+                     bound(call.decl, call.name, "call");
+                     for (const auto *arg : call.args)
+                       expr(*arg);
+                   },
+                   [&](const ENew &expr_new) { expr(*expr_new.expr); },
+                   [&](const EArrayAccess &access) {
+                     bound(access.decl, access.name, "array");
+                     expr(*access.index);
+                   },
+                   [](const auto &) {},
+               },
+               node);
+  }
+
+  void stmt(const StmtNode &node) {
+    std::visit(
+        overload{
+            [&](const SExpr &s) { expr(*s.expr); },
+            [&](const SVarDef &def) {
+              bound(def.decl, def.name, "local");
+              expr(*def.value);
+            },
+            [&](const SVarAssign &assign) {
+              bound(assign.decl, assign.name, "assignment");
+              expr(*assign.value);
+            },
+            [&](const SArrayAssign &assign) {
+              bound(assign.decl, assign.name, "array assignment");
+              expr(*assign.index);
+              expr(*assign.value);
+            },
+            [&](const SScope &scope) {
+              for (const auto *s : scope.stmts)
+                stmt(*s);
+            },
+            [&](const SIf &s) {
+              expr(*s.cond);
+              stmt(*s.then_branch);
+              if (s.else_branch)
+                stmt(*s.else_branch);
+            },
+            [&](const SWhile &s) {
+              expr(*s.cond);
+              stmt(*s.stmt);
+            },
+            [&](const SReturn &s) {
+              if (s.expr)
+                expr(*s.expr);
+            },
+            [&](const SDelete &s) { bound(s.decl, s.name, "delete"); },
+            [](const auto &) {},
+        },
+        node);
+  }
+
+  const Names &names;
+};
+
+// Random scopes, declarations and lookups against a stack of maps
+void check_symbol_table() {
+  std::mt19937 rng(11);
+  SymbolTable table;
+  std::vector<std::map<std::uint32_t, SymbolTable::Value>> model(1);
+  for (int step = 0; step < 200000; ++step) {
+    Symbol name{static_cast<std::uint32_t>(rng() % 300)};
+    auto op = rng() % 10;
+    if (op == 0 && model.size() < 40) {
+      table.enter_scope();
+      model.emplace_back();
+    } else if (op == 1 && model.size() > 1) {
+      table.exit_scope();
+      model.pop_back();
+    } else if (op < 5) {
+      auto value = static_cast<SymbolTable::Value>(step);
+      bool fresh = !model.back().contains(name.id);
+      check(table.declare(name, value) == fresh,
+            fmt::format("step {}: declare", step));
+      if (fresh)
+        model.back()[name.id] = value;
+    } else {
+      auto expected = SymbolTable::none;
+      for (auto scope = model.rbegin(); scope != model.rend(); ++scope) {
+        if (auto found = scope->find(name.id); found != scope->end()) {
+          expected = found->second;
+          break;
+        }
+      }
+      check(table.lookup(name) == expected,
+            fmt::format("step {}: lookup", step));
+    }
+  }
+}
+
+// Each scope declares `x` from the one around it
+void check_deep_scopes() {
+  constexpr int depth = 100000;
+  std::string text = "int main() {\n  int x = 0;\n";
+  for (int i = 0; i < depth; ++i)
+    text.append("{ int x = x + 1;\n");
+  text.append("x = x;\n");
+  text.append(depth, '}');
+  text.append("\n  return x;\n}\n");
+  SourceManager sources;
+  auto file = sources.add_file(SourceBuffer::from_string(text));
+  auto result = parse_unit(sources, file, CigridFlags{});
+  check(result.ok(), "deep scopes parse");
+  if (!result.ok())
+    return;
+  auto names = resolve_names(*result.prog, result.diag);
+  check(names.ok(), "deep scopes resolve");
+  // The function, then one local per level
+  check(names.decls.size() == depth + 2, "deep scopes: one local per level");
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  auto source = source_argument(argc, argv);
+  if (!source)
+    return 1;
+  SourceManager sources;
+  auto file = sources.add_file(std::move(*source));
+  auto result = parse_unit(sources, file, CigridFlags{});
+  check(result.ok(), "test program parses");
+  if (result.ok()) {
+    auto names = resolve_names(*result.prog, result.diag);
+    check(names.ok(), "test program resolves");
+    BindingCheck bindings(names);
+    for (const auto *global : result.prog->globals)
+      bindings.global(*global);
+    check(bindings.checked > 100, "test program has bindings to check");
+  }
+
+  for (const auto &unit : units)
+    check_unit(unit);
+  check_symbol_table();
+  check_deep_scopes();
+
+  return finish("name_analysis_test");
+}
@@ -0,0 +1,135 @@
+// Chunked parallel lexing must be bit-identical to Lexer::gen_token: same
+// tokens, same Symbol ids (checked with fresh interners on both sides) and
+// the same errors, for every number of threads.
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "diagnostics/diagnostics.hpp"
+#include "interner/interner.hpp"
+#include "lexer/lexer.hpp"
+#include "lexer/parallel_lexer.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "support/thread_pool.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+void compare(std::string_view text, ThreadPool &pool, const std::string &name) {
+  SourceManager sources;
+  auto file = sources.add_file(SourceBuffer::from_string(text));
+
+  Interner seq_symbols;
+  Diagnostics seq_diag;
+  Lexer lexer(sources, file, seq_diag, LexerEngine::SWITCH, seq_symbols);
+  auto expected = lexer.gen_token();
+
+  Interner par_symbols;
+  Diagnostics par_diag;
+  auto tokens = lex_parallel(sources, file, par_diag, pool,
+                             LexerEngine::SWITCH, par_symbols);
+
+  auto where = fmt::format("{} with {} threads", name, pool.size());
+  check(tokens.size() == expected.size(), "token count on " + where);
+  for (std::size_t i = 0; i < tokens.size() && i < expected.size(); ++i) {
+    const Token &a = expected[i];
+    const Token &b = tokens[i];
+    check(a.kind == b.kind && a.offset == b.offset && a.length == b.length &&
+              a.payload == b.payload,
+          fmt::format("token {} on {}", i, where));
+  }
+  check(seq_symbols.size() == par_symbols.size(), "symbol count on " + where);
+  for (std::uint32_t id = 0;
+       id < seq_symbols.size() && id < par_symbols.size(); ++id) {
+    check(seq_symbols.lookup(Symbol{id}) == par_symbols.lookup(Symbol{id}),
+          fmt::format("symbol {} on {}", id, where));
+  }
+  check(seq_diag.has_errors() == par_diag.has_errors(), "errors on " + where);
+}
+
+void check_boundaries(std::string_view text, const std::string &name) {
+  for (std::size_t chunks : {2, 3, 7, 64}) {
+    auto cuts = find_chunk_boundaries(text, chunks);
+    check(cuts.size() < chunks, "too many cuts on " + name);
+    for (std::size_t i = 0; i < cuts.size(); ++i) {
+      check(cuts[i] > 0 && cuts[i] < text.size() && text[cuts[i] - 1] == '\n',
+            fmt::format("cut {} not after a newline on {}", i, name));
+      check(i == 0 || cuts[i - 1] < cuts[i],
+            fmt::format("cut {} out of order on {}", i, name));
+    }
+  }
+}
+
+std::string random_program(std::mt19937 &rng) {
+  // Newlines hidden in literals and comments are what the splitter must not
+  // cut at
+  static const char *pieces[] = {
+      "int",     "x1",       "_tmp",          "while",
+      "\n",      "\n\n  ",   "/* a\n b */",   "/*/ closes\n */",
+      "/*\n*/",  "// line\n", "# include <x>\n", "\"s\\\nt\"",
+      "\"a\\\"b\\n\"", "'\n'", "'\\''", "'\"'", "'\\\n'",
+      "+",       "/",        "<<",            "==",
+      "(",       ")",        "{",             "}",
+      ";",       "123",      "0x1F",          "'a'"};
+  std::string text;
+  int count = rng() % 600;
+  for (int i = 0; i < count; ++i) {
+    text += pieces[rng() % std::size(pieces)];
+    if (rng() % 3 != 0)
+      text += ' ';
+  }
+  return text + "\n";
+}
+
+std::string random_bytes(std::mt19937 &rng) {
+  static const std::string alphabet = " \n\n\n/*#'\"\\ax0=;";
+  std::string text(rng() % 400, ' ');
+  for (auto &c : text) {
+    c = rng() % 32 == 0 ? static_cast<char>(rng() % 256)
+                        : alphabet[rng() % alphabet.size()];
+  }
+  return text;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::mt19937 rng(99);
+  std::vector<std::unique_ptr<ThreadPool>> pools;
+  for (unsigned threads : {1, 2, 3, 8})
+    pools.push_back(std::make_unique<ThreadPool>(threads));
+
+  for (int i = 1; i < argc; ++i) {
+    auto file = SourceBuffer::from_file(argv[i]);
+    check(file.has_value(), fmt::format("cannot open {}", argv[i]));
+    if (!file)
+      continue;
+    // Repeated so that every thread gets several chunks
+    std::string text;
+    for (int k = 0; k < 50; ++k)
+      text.append(file->view());
+    check_boundaries(text, argv[i]);
+    for (auto &pool : pools)
+      compare(text, *pool, argv[i]);
+  }
+  for (int round = 0; round < 300; ++round) {
+    auto text = random_program(rng);
+    auto name = fmt::format("random program {}", round);
+    check_boundaries(text, name);
+    for (auto &pool : pools)
+      compare(text, *pool, name);
+  }
+  for (int round = 0; round < 3000; ++round) {
+    auto text = random_bytes(rng);
+    auto name = fmt::format("random bytes {}", round);
+    check_boundaries(text, name);
+    compare(text, *pools[rng() % pools.size()], name);
+  }
+
+  return finish("parallel_lexer_test");
+}
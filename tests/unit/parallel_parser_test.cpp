@@ -0,0 +1,95 @@
+// Parsing the top-level globals on a thread pool must give the same program
+// as the sequential parser, for both builders, and a syntax error anywhere
+// must be reported exactly as the sequential parser reports it.
+#include <optional>
+#include <span>
+#include <string>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "diagnostics/diagnostics.hpp"
+#include "lexer/lexer.hpp"
+#include "parser/flat_ast.hpp"
+#include "parser/parser.hpp"
+#include "printer/ast_printer.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+std::string parse_and_print(const SourceManager &sources, FileId file,
+                            const CigridFlags &flags) {
+  Diagnostics diag;
+  if (flags.flat_ast) {
+    auto ast = FlatParser(sources, file, diag, flags).parse();
+    return ast ? print(*to_tree(*ast)) : "";
+  }
+  auto prog = Parser(sources, file, diag, flags).parse();
+  return prog ? print(*prog) : "";
+}
+
+std::optional<ParseError> parse_error(const SourceManager &sources,
+                                      FileId file, const CigridFlags &flags) {
+  Diagnostics diag;
+  Parser parser(sources, file, diag, flags);
+  auto prog = parser.parse();
+  check(!prog && diag.has_errors(), "bad input fails with a diagnostic");
+  return parser.parse_error();
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  auto source = source_argument(argc, argv);
+  if (!source)
+    return 1;
+  std::string text;
+  for (int i = 0; i < 50; ++i)
+    text.append(source->view());
+  SourceManager sources;
+  auto file = sources.add_file(SourceBuffer::from_string(text));
+
+  // The pre-pass finds exactly the globals the parser finds
+  CigridFlags sequential;
+  Diagnostics diag;
+  auto tokens = Lexer(sources, file, diag).gen_token();
+  auto prog = Parser(sources, file, diag, sequential).parse();
+  auto starts = find_global_boundaries(
+      std::span<const Token>(tokens).first(tokens.size() - 1));
+  check(prog && starts.size() == prog->globals.size(),
+        fmt::format("{} global boundaries for {} globals", starts.size(),
+                    prog ? prog->globals.size() : 0));
+
+  for (bool flat : {false, true}) {
+    CigridFlags flags;
+    flags.flat_ast = flat;
+    auto expected = parse_and_print(sources, file, flags);
+    check(!expected.empty(), "sequential parse printed");
+    for (unsigned threads : {2u, 3u, 8u}) {
+      flags.parse_threads = threads;
+      check(parse_and_print(sources, file, flags) == expected,
+            fmt::format("{} parse on {} threads prints identically",
+                        flat ? "flat" : "tree", threads));
+    }
+  }
+
+  // An error inside a function, inside a struct, and a stray '}' between
+  // globals, each near the middle of the file
+  for (const char *bad : {"int f() { return ; + }\n", "struct S { int a }; ",
+                          "}\n"}) {
+    std::string broken = text;
+    broken.insert(broken.find("\nint ", text.size() / 2) + 1, bad);
+    auto bad_file = sources.add_file(SourceBuffer::from_string(broken));
+    auto expected = parse_error(sources, bad_file, sequential);
+    CigridFlags flags;
+    flags.parse_threads = 4;
+    auto error = parse_error(sources, bad_file, flags);
+    check(expected && error && error->loc.offset == expected->loc.offset &&
+              error->message == expected->message,
+          fmt::format("error in {:?} reported as sequentially", bad));
+  }
+
+  return finish("parallel_parser_test");
+}
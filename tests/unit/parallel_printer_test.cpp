@@ -0,0 +1,51 @@
+// Printing the globals on a thread pool must give exactly the output of the
+// sequential printer, whatever the number of threads and globals.
+#include <string>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "frontend/frontend.hpp"
+#include "printer/ast_printer.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "support/thread_pool.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+std::string print_parallel(const Prog &prog, ThreadPool &pool) {
+  fmt::memory_buffer out;
+  ASTPrinter printer(out);
+  printer.print_parallel(prog, pool);
+  return fmt::to_string(out);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  auto source = source_argument(argc, argv);
+  if (!source)
+    return 1;
+
+  // From one copy to enough globals for several waves on every pool
+  for (int copies : {1, 7, 50, 400}) {
+    std::string text;
+    for (int i = 0; i < copies; ++i)
+      text.append(source->view());
+    SourceManager sources;
+    auto file = sources.add_file(SourceBuffer::from_string(text));
+    auto result = parse_unit(sources, file, CigridFlags{});
+    check(result.ok(), fmt::format("{} copies parse", copies));
+    if (!result.ok())
+      continue;
+    auto expected = print(*result.prog);
+    for (unsigned threads : {1u, 2u, 3u, 8u}) {
+      ThreadPool pool(threads);
+      check(print_parallel(*result.prog, pool) == expected,
+            fmt::format("{} copies on {} threads", copies, threads));
+    }
+  }
+
+  return finish("parallel_printer_test");
+}
@@ -0,0 +1,112 @@
+// Resolving names and checking types of the function bodies on a thread
+// pool must give exactly what one thread gives: the same declarations and
+// types, the same first error and the same diagnostics, whatever the number
+// of threads and functions.
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "frontend/frontend.hpp"
+#include "sema/name_analysis.hpp"
+#include "sema/type_checker.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "support/thread_pool.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+// A function per struct and global, each using the globals before it. With
+// `name_errors` some bodies use names declared only after them; without,
+// some have type errors instead.
+std::string program(int functions, bool name_errors) {
+  std::string text = "int g0 = 0;\n";
+  for (int i = 1; i <= functions; ++i) {
+    text += fmt::format("struct S{0} {{\n  int a;\n  S{0}* next;\n}};\n", i);
+    text += fmt::format("int g{} = {};\n", i, i);
+    text += fmt::format("int f{0}(int x, S{0}* s) {{\n  int y = x + g{1};\n",
+                        i, i - 1);
+    if (i > 1)
+      text += fmt::format("  y = y + f{}(x, 0);\n", i - 1);
+    if (name_errors && i % 7 == 3)
+      text += fmt::format("  y = f{0}(y, 0) + g{0};\n", i + 1);
+    if (name_errors && i % 11 == 5)
+      text += fmt::format("  S{}* t = 0;\n", i + 1);
+    if (name_errors && i % 13 == 0)
+      text += "  int y = 2;\n";
+    if (!name_errors && i % 5 == 2)
+      text += "  char* c = x;\n";
+    if (!name_errors && i % 9 == 4)
+      text += "  break;\n";
+    text += "  while (y > 0) {\n    int t = s[0].a;\n    y = y - t;\n  }\n"
+            "  return y;\n}\n";
+  }
+  return text;
+}
+
+struct Analysis {
+  std::string diagnostics;
+  std::string error;
+  // Every declaration with its type
+  std::vector<std::string> decls;
+
+  bool operator==(const Analysis &) const = default;
+};
+
+Analysis analyze(const std::string &text, unsigned threads) {
+  Analysis analysis;
+  SourceManager sources;
+  auto file = sources.add_file(SourceBuffer::from_string(text));
+  auto result = parse_unit(sources, file, CigridFlags{});
+  if (!result.ok()) {
+    analysis.error = "syntax error";
+    return analysis;
+  }
+  ThreadPool pool(threads);
+  auto names = resolve_names(*result.prog, result.diag, pool);
+  std::optional<Types> types;
+  if (names.ok())
+    types = check_types(*result.prog, names, result.diag, pool);
+
+  fmt::memory_buffer out;
+  result.diag.print_all(sources, out);
+  analysis.diagnostics = fmt::to_string(out);
+  if (names.error)
+    analysis.error = fmt::format("{}: {}", names.error->loc.offset,
+                                 names.error->message);
+  else if (types->error)
+    analysis.error = fmt::format("{}: {}", types->error->loc.offset,
+                                 types->error->message);
+  for (DeclId id = 0; id < names.decls.size(); ++id) {
+    const auto &decl = names.decls[id];
+    analysis.decls.push_back(fmt::format(
+        "{} {} {} {} {}", static_cast<int>(decl.kind), decl.name,
+        decl.loc.offset, decl.function,
+        types ? types->context.to_string(types->decls[id]) : ""));
+  }
+  return analysis;
+}
+
+} // namespace
+
+int main() {
+  for (bool name_errors : {false, true}) {
+    for (int functions : {1, 20, 500}) {
+      auto text = program(functions, name_errors);
+      auto expected = analyze(text, 1);
+      auto what = fmt::format("{} functions with {} errors", functions,
+                              name_errors ? "name" : "type");
+      check(functions == 1 || !expected.error.empty(),
+            fmt::format("{} fail", what));
+      for (unsigned threads : {2u, 3u, 8u}) {
+        check(analyze(text, threads) == expected,
+              fmt::format("{} on {} threads", what, threads));
+      }
+    }
+  }
+
+  return finish("parallel_sema_test");
+}
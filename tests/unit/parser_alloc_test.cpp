@@ -0,0 +1,70 @@
+// Parsing must not allocate per token: besides the growth of the arena,
+// the node tables and the parser's scratch stacks, which is logarithmic in
+// the input, nothing on the lexer or parser hot path may touch the heap.
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include <fmt/core.h>
+
+#include "common.hpp"
+#include "diagnostics/diagnostics.hpp"
+#include "lexer/lexer.hpp"
+#include "parser/parser.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+std::size_t allocations = 0;
+
+// Allowed heap allocations per token. Growing the ~20 FlatAst arrays costs
+// a few hundred allocations here; anything done per node or per token
+// would be orders of magnitude above this.
+constexpr double budget = 0.01;
+
+template <typename ParserType>
+void check_budget(const SourceManager &sources, FileId file,
+                  std::size_t tokens, const char *name) {
+  CigridFlags flags;
+  Diagnostics diag;
+  auto before = allocations;
+  auto ast = ParserType(sources, file, diag, flags).parse();
+  auto count = allocations - before;
+  fmt::print("{}: {} allocations for {} tokens\n", name, count, tokens);
+  check(count <= budget * tokens,
+        fmt::format("{} allocated {} times, budget is {:.0f}", name, count,
+                    budget * tokens));
+}
+
+} // namespace
+
+void *operator new(std::size_t size) {
+  ++allocations;
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  std::abort();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+int main(int argc, char *argv[]) {
+  auto source = source_argument(argc, argv);
+  if (!source)
+    return 1;
+  std::string text;
+  for (int i = 0; i < 200; ++i)
+    text.append(source->view());
+  SourceManager sources;
+  auto file = sources.add_file(SourceBuffer::from_string(text));
+
+  Diagnostics diag;
+  auto tokens = Lexer(sources, file, diag).gen_token().size();
+  check(!diag.has_errors(), "input lexes cleanly");
+
+  check_budget<Parser>(sources, file, tokens, "Parser");
+  check_budget<FlatParser>(sources, file, tokens, "FlatParser");
+
+  return finish("parser_alloc_test");
+}
@@ -0,0 +1,143 @@
+// Differential test for the bulk scanners in lexer/scan.hpp.
+//
+// 1. Every vector scanner must return exactly what the scalar reference
+//    returns, for random buffers and every start offset.
+// 2. Lexing with the vector scanners must produce the same tokens and the
+//    same line/column positions as lexing with the scalar ones, on the files
+//    given on the command line and on random token soup.
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "diagnostics/diagnostics.hpp"
+#include "lexer/lexer.hpp"
+#include "lexer/scan.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+std::string random_bytes(std::mt19937 &rng, std::size_t length) {
+  // Mostly bytes the scanners care about, plus arbitrary ones
+  static const std::string alphabet = " \t\n\r\v\f*/_aZz09@[`{\x80\xff";
+  std::string text(length, ' ');
+  for (auto &c : text) {
+    auto r = rng() % 8;
+    c = r == 0 ? static_cast<char>(rng() % 256)
+               : alphabet[rng() % alphabet.size()];
+  }
+  return text;
+}
+
+void test_scanners(std::mt19937 &rng) {
+  const ScanFunctions &ref = scan_functions(ScanIsa::SCALAR);
+  for (auto isa : {ScanIsa::SSE2, ScanIsa::AVX2}) {
+    if (!scan_isa_supported(isa))
+      continue;
+    const ScanFunctions &vec = scan_functions(isa);
+    for (int round = 0; round < 2000; ++round) {
+      auto text = random_bytes(rng, rng() % 200);
+      // Long runs so that the vector loops take more than one step
+      if (round % 4 == 0)
+        text.insert(rng() % (text.size() + 1), std::string(rng() % 100, ' '));
+      if (round % 4 == 1)
+        text.insert(rng() % (text.size() + 1), std::string(rng() % 100, 'x'));
+      const char *begin = text.data();
+      const char *end = begin + text.size();
+      for (const char *p = begin; p <= end; ++p) {
+        auto where = fmt::format("{} round {} offset {}", to_string(isa), round,
+                                 p - begin);
+        check(vec.skip_whitespace(p, end) == ref.skip_whitespace(p, end),
+              "skip_whitespace " + where);
+        check(vec.find_newline(p, end) == ref.find_newline(p, end),
+              "find_newline " + where);
+        check(vec.find_comment_end(p, end) == ref.find_comment_end(p, end),
+              "find_comment_end " + where);
+        check(vec.ident_end(p, end) == ref.ident_end(p, end),
+              "ident_end " + where);
+      }
+    }
+  }
+}
+
+struct Lexed {
+  std::vector<Token> tokens;
+  std::vector<Position> positions;
+};
+
+Lexed lex_with(ScanIsa isa, std::string_view text) {
+  set_scan_isa(isa);
+  // A fresh manager, so that its line table is built with this ISA too
+  SourceManager sources;
+  auto file = sources.add_file(SourceBuffer::from_string(text));
+  Diagnostics diag;
+  Lexer lexer(sources, file, diag);
+  Lexed result;
+  result.tokens = lexer.gen_token();
+  for (const auto &token : result.tokens)
+    result.positions.push_back(sources.position(lexer.loc(token.offset)));
+  return result;
+}
+
+void compare_lexers(std::string_view source, const std::string &name) {
+  auto ref = lex_with(ScanIsa::SCALAR, source);
+  for (auto isa : {ScanIsa::SSE2, ScanIsa::AVX2}) {
+    if (!scan_isa_supported(isa))
+      continue;
+    auto vec = lex_with(isa, source);
+    auto where = fmt::format("{} on {}", to_string(isa), name);
+    check(vec.tokens.size() == ref.tokens.size(), "token count " + where);
+    for (std::size_t i = 0; i < vec.tokens.size() && i < ref.tokens.size();
+         ++i) {
+      const Token &a = ref.tokens[i];
+      const Token &b = vec.tokens[i];
+      check(a.kind == b.kind && a.offset == b.offset && a.length == b.length &&
+                a.payload == b.payload,
+            fmt::format("token {} {}", i, where));
+      check(ref.positions[i].line == vec.positions[i].line &&
+                ref.positions[i].column == vec.positions[i].column,
+            fmt::format("position of token {} {}", i, where));
+    }
+  }
+}
+
+std::string random_program(std::mt19937 &rng) {
+  static const char *pieces[] = {
+      "int",  "x1",   "_tmp",   "while", "  ",  "\t", "\n",    "\n\n  ",
+      "/* comment * / **/", "/*/ closes */", "// line comment\n",
+      "# include <x>\n", "+",  "<<",  "<=", "==", "(",   ")",   "{",  "}",
+      ";",    "123",  "0x1F",  "'a'",  "'\\n'", "\"str\\t\"", "a_very_long_identifier_name_0123456789",
+      "                                        "};
+  std::string text;
+  int count = rng() % 400;
+  for (int i = 0; i < count; ++i) {
+    text += pieces[rng() % std::size(pieces)];
+    text += ' ';
+  }
+  return text + "\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::mt19937 rng(12345);
+  test_scanners(rng);
+
+  for (int i = 1; i < argc; ++i) {
+    auto file = SourceBuffer::from_file(argv[i]);
+    check(file.has_value(), fmt::format("cannot open {}", argv[i]));
+    if (file)
+      compare_lexers(file->view(), argv[i]);
+  }
+  for (int round = 0; round < 500; ++round) {
+    compare_lexers(random_program(rng),
+                   fmt::format("random program {}", round));
+  }
+
+  return finish("scan_test");
+}
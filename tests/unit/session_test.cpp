@@ -0,0 +1,180 @@
+// A Session edited many times must always agree with parsing the edited
+// text from scratch: same program, same positions, same line for the first
+// error, while an edit inside one function only re-lexes and re-parses
+// around it.
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <string>
+#include <utility>
+#include <variant>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "frontend/frontend.hpp"
+#include "frontend/session.hpp"
+#include "interner/interner.hpp"
+#include "printer/ast_printer.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+SourceLoc loc_of(const GlobalNode &global) {
+  return std::visit([](const auto &node) { return node.loc; }, global);
+}
+
+bool same(Position a, Position b) {
+  return a.line == b.line && a.column == b.column;
+}
+
+// Compares the session with a fresh parse of `text`
+void check_session(const Session &session, const std::string &text,
+                   int step) {
+  check(session.text() == text, fmt::format("step {}: text", step));
+  SourceManager sources;
+  auto file = sources.add_file(SourceBuffer::from_string(text));
+  auto fresh = parse_unit(sources, file, CigridFlags{});
+  check(session.ok() == fresh.ok(), fmt::format("step {}: ok", step));
+  if (session.ok() != fresh.ok())
+    return;
+
+  // A unit ends where the next global begins, so the parser may stop on
+  // its end instead of the token after: compare lines only
+  if (!fresh.ok()) {
+    auto errors = session.errors();
+    check(!errors.empty() && session.position(errors.front().loc).line ==
+                                 sources.position(fresh.error->loc).line,
+          fmt::format("step {}: line of the first error", step));
+    return;
+  }
+  check(print(session) == print(*fresh.prog),
+        fmt::format("step {}: printed program", step));
+  auto globals = session.globals();
+  check(globals.size() == fresh.prog->globals.size(),
+        fmt::format("step {}: number of globals", step));
+  for (std::size_t i = 0; i < globals.size() && i < fresh.prog->globals.size();
+       ++i) {
+    check(same(session.position(loc_of(*globals[i])),
+               sources.position(loc_of(*fresh.prog->globals[i]))),
+          fmt::format("step {}: position of global {}", step, i));
+  }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  auto source = source_argument(argc, argv);
+  if (!source)
+    return 1;
+  std::string text;
+  for (int i = 0; i < 20; ++i)
+    text.append(source->view());
+  Session session(text);
+  int step = 0;
+  check_session(session, text, step);
+
+  // Applies the edit to both the session and the expected text
+  auto apply = [&](std::uint32_t offset, std::uint32_t length,
+                   std::string replacement) {
+    text.erase(offset, length);
+    text.insert(offset, replacement);
+    session.edit(TextEdit{offset, length, std::move(replacement)});
+    check_session(session, text, ++step);
+  };
+
+  // Typing a statement into a function touches that function alone
+  auto body = text.find("{\n", text.size() / 2) + 2;
+  for (char c : std::string("x = x + 1;\n")) {
+    apply(static_cast<std::uint32_t>(body), 0, std::string(1, c));
+    check(session.last_edit().relexed_bytes < text.size() / 20 &&
+              session.last_edit().reparsed_globals <= 2,
+          fmt::format("typing relexed {} bytes and reparsed {} globals",
+                      session.last_edit().relexed_bytes,
+                      session.last_edit().reparsed_globals));
+    ++body;
+  }
+
+  // Edits on small documents: a line comment left open at the end of the
+  // edited region, however it is written, a ';' right before the next
+  // global, and a '}' taken away with nothing after to close its function
+  const std::string globals = "int a = 1; int b = 2; int c = 3;\n";
+  const std::string functions = "int f() {\n  x = 1;\n}\n// c\n"
+                                "int y = 2;\nvoid g(int x) {\n}\n";
+  const std::pair<const std::string &, TextEdit> small_edits[] = {
+      {globals, {10, 0, "//"}},
+      {globals, {10, 0, "#"}},
+      {functions, {26, 0, ";"}},
+      {functions, {19, 1, ""}}};
+  for (const auto &[small_text, edit] : small_edits) {
+    Session small(small_text);
+    small.edit(edit);
+    auto edited = small_text;
+    edited.replace(edit.offset, edit.length, edit.replacement);
+    check_session(small, edited, ++step);
+  }
+
+  // A long run of edits leaves the files of many replaced units behind.
+  // The session drops them now and then, keeping the SourceManager small.
+  {
+    std::string edited = globals;
+    Session small(edited);
+    bool rebuilt = false;
+    std::uint32_t most = 0;
+    for (int i = 0; i < 100'000; ++i) {
+      if (i % 2 == 0)
+        small.edit(TextEdit{11, 0, "int d = 4; "});
+      else
+        small.edit(TextEdit{11, 11, ""});
+      rebuilt = rebuilt || small.last_edit().rebuilt;
+      most = std::max(most, small.source_manager().end_offset());
+    }
+    check(rebuilt, "many edits rebuild the session");
+    check(most < 2u << 20 && small.source_manager().file_count() < 100'000,
+          fmt::format("location space stays bounded, up to {}", most));
+    check_session(small, edited, ++step);
+  }
+
+  // Typing interns every prefix of a name into the global table, which
+  // never shrinks. Typing the same text again adds nothing to it.
+  {
+    const std::string typed = "int total = 4; ";
+    Session small(globals);
+    std::size_t interned = 0;
+    for (int round = 0; round < 1000; ++round) {
+      for (std::uint32_t i = 0; i < typed.size(); ++i)
+        small.edit(TextEdit{11 + i, 0, std::string(1, typed[i])});
+      small.edit(TextEdit{11, static_cast<std::uint32_t>(typed.size()), ""});
+      if (round == 0)
+        interned = Interner::global().size();
+    }
+    check(Interner::global().size() == interned,
+          "replaying the same typing interns nothing new");
+    check_session(small, globals, ++step);
+  }
+
+  // Random edits, each undone again: deletions, stray punctuation, comment
+  // openers that swallow the rest of the document, and new statements
+  std::mt19937 rng(42);
+  const std::string inserts[] = {"{", "}", ";", "(", ")", "/*", "*/", "//",
+                                 "#", "\n", " ", "x", "\"", "'", "@",
+                                 "x = 1;\n", "int f() { return 0; }\n"};
+  for (int round = 0; round < 150; ++round) {
+    auto offset = static_cast<std::uint32_t>(rng() % (text.size() + 1));
+    if (round % 3 == 0) {
+      auto length = static_cast<std::uint32_t>(
+          std::min<std::size_t>(rng() % 20 + 1, text.size() - offset));
+      auto removed = text.substr(offset, length);
+      apply(offset, length, "");
+      apply(offset, 0, removed);
+    } else {
+      const auto &insert = inserts[rng() % std::size(inserts)];
+      apply(offset, 0, insert);
+      apply(offset, static_cast<std::uint32_t>(insert.size()), "");
+    }
+  }
+
+  return finish("session_test", fmt::format("{} edits", step));
+}
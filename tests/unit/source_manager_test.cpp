@@ -0,0 +1,58 @@
+// SourceManager maps locations of several files back to file, line and
+// column. Checked against a byte-by-byte count on random text.
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "common.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+std::string random_text(std::mt19937 &rng) {
+  std::string text(rng() % 500, ' ');
+  for (auto &c : text)
+    c = rng() % 10 == 0 ? '\n' : static_cast<char>('a' + rng() % 26);
+  return text;
+}
+
+} // namespace
+
+int main() {
+  std::mt19937 rng(7);
+  SourceManager sources;
+  std::vector<std::string> texts;
+  std::vector<FileId> files;
+  for (int i = 0; i < 50; ++i) {
+    texts.push_back(random_text(rng));
+    files.push_back(sources.add_file(
+        SourceBuffer::from_string(texts.back(), fmt::format("file{}", i))));
+  }
+
+  for (std::size_t i = 0; i < files.size(); ++i) {
+    const auto &text = texts[i];
+    int line = 1;
+    int column = 1;
+    // Every offset including the end of file
+    for (std::uint32_t offset = 0; offset <= text.size(); ++offset) {
+      auto loc = sources.loc(files[i], offset);
+      auto where = fmt::format("file {} offset {}", i, offset);
+      check(sources.file_of(loc) == files[i], "file_of " + where);
+      check(sources.name(loc) == fmt::format("file{}", i), "name " + where);
+      auto pos = sources.position(loc);
+      check(pos.line == line && pos.column == column, "position " + where);
+      if (offset < text.size() && text[offset] == '\n') {
+        ++line;
+        column = 1;
+      } else {
+        ++column;
+      }
+    }
+  }
+
+  return finish("source_manager_test");
+}
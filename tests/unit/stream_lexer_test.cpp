@@ -0,0 +1,153 @@
+// StreamLexer must give the tokens, Symbol ids, errors and positions of
+// Lexer::gen_token on the whole input, however the input is split into
+// reads, while its buffer stays small.
+#include <algorithm>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "diagnostics/diagnostics.hpp"
+#include "interner/interner.hpp"
+#include "lexer/lexer.hpp"
+#include "lexer/stream_lexer.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+// Hands out the text in pieces of random size up to max_read
+StreamLexer::ReadFn reader(std::string_view text, std::mt19937 &rng,
+                           std::size_t max_read) {
+  return [text, &rng, max_read, pos = std::size_t{0}](
+             char *buffer, std::size_t capacity) mutable {
+    std::size_t count = std::min({capacity, text.size() - pos,
+                                  1 + rng() % max_read});
+    std::copy_n(text.data() + pos, count, buffer);
+    pos += count;
+    return count;
+  };
+}
+
+// Returns the largest buffer the stream needed
+std::size_t compare(std::string_view text, std::mt19937 &rng,
+                    std::size_t max_read, std::size_t capacity,
+                    const std::string &name) {
+  SourceManager batch_sources;
+  auto batch_file = batch_sources.add_file(SourceBuffer::from_string(text));
+  Interner batch_symbols;
+  Diagnostics batch_diag;
+  Lexer lexer(batch_sources, batch_file, batch_diag, LexerEngine::SWITCH,
+              batch_symbols);
+  auto expected = lexer.gen_token();
+
+  SourceManager sources;
+  auto file = sources.add_stream("<pipe>");
+  Interner symbols;
+  Diagnostics diag;
+  StreamLexer stream(sources, file, reader(text, rng, max_read), diag,
+                     LexerEngine::SWITCH, symbols, capacity);
+  std::vector<Token> tokens;
+  while (true) {
+    tokens.push_back(stream.next_token());
+    const Token &token = tokens.back();
+    // The lexeme of the latest token is still in the buffer
+    if (tokens.size() <= expected.size()) {
+      check(stream.lexeme(token) == lexer.lexeme(expected[tokens.size() - 1]),
+            fmt::format("lexeme of token {} on {}", tokens.size() - 1, name));
+    }
+    if (token.kind == TokenKind::END_OF_FILE || token.kind == TokenKind::BAD)
+      break;
+  }
+
+  check(tokens.size() == expected.size(), "token count on " + name);
+  for (std::size_t i = 0; i < tokens.size() && i < expected.size(); ++i) {
+    const Token &a = expected[i];
+    const Token &b = tokens[i];
+    check(a.kind == b.kind && a.offset == b.offset && a.length == b.length &&
+              a.payload == b.payload,
+          fmt::format("token {} on {}", i, name));
+    auto pa = batch_sources.position(batch_sources.loc(batch_file, a.offset));
+    auto pb = sources.position(sources.loc(file, b.offset));
+    check(pa.line == pb.line && pa.column == pb.column,
+          fmt::format("position of token {} on {}", i, name));
+  }
+  check(symbols.size() == batch_symbols.size(), "symbol count on " + name);
+  for (std::uint32_t id = 0; id < symbols.size() && id < batch_symbols.size();
+       ++id) {
+    check(symbols.lookup(Symbol{id}) == batch_symbols.lookup(Symbol{id}),
+          fmt::format("symbol {} on {}", id, name));
+  }
+  // gen_token also reports the bad token it stops at, next_token does not
+  bool stopped_bad = tokens.back().kind == TokenKind::BAD;
+  check((diag.has_errors() || stopped_bad) == batch_diag.has_errors(),
+        "errors on " + name);
+  return stream.capacity();
+}
+
+std::string random_program(std::mt19937 &rng) {
+  static const char *pieces[] = {
+      "int",     "x1",        "_tmp",          "while",
+      "\n",      "\n\n  ",    "/* a\n b */",   "/*/ closes\n */",
+      "/*\n*/",  "// line\n", "# include <x>\n", "\"s\\\nt\"",
+      "\"a\\\"b\\n\"", "'\n'", "'\\''", "'\"'", "'\\\n'",
+      "+",       "/",         "<<",            "==",
+      "(",       ")",         "{",             "}",
+      ";",       "123",       "0x1F",          "'a'",
+      "a_rather_long_identifier_that_straddles_reads"};
+  std::string text;
+  int count = rng() % 600;
+  for (int i = 0; i < count; ++i) {
+    text += pieces[rng() % std::size(pieces)];
+    if (rng() % 3 != 0)
+      text += ' ';
+  }
+  return text + "\n";
+}
+
+std::string random_bytes(std::mt19937 &rng) {
+  static const std::string alphabet = " \n\n\n/*#'\"\\ax0=;";
+  std::string text(rng() % 400, ' ');
+  for (auto &c : text) {
+    c = rng() % 32 == 0 ? static_cast<char>(rng() % 256)
+                        : alphabet[rng() % alphabet.size()];
+  }
+  return text;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::mt19937 rng(2024);
+
+  for (int i = 1; i < argc; ++i) {
+    auto file = SourceBuffer::from_file(argv[i]);
+    check(file.has_value(), fmt::format("cannot open {}", argv[i]));
+    if (!file)
+      continue;
+    compare(file->view(), rng, 7, 16, argv[i]);
+    // Memory must not grow with the input
+    std::string text;
+    for (int k = 0; k < 500; ++k)
+      text.append(file->view());
+    auto capacity = compare(text, rng, 4096, 4096, argv[i]);
+    check(capacity <= 16 * 1024,
+          fmt::format("buffer grew to {} bytes on {}", capacity, argv[i]));
+  }
+  for (int round = 0; round < 500; ++round) {
+    auto text = random_program(rng);
+    compare(text, rng, 1 + rng() % 64, 1 + rng() % 64,
+            fmt::format("random program {}", round));
+  }
+  for (int round = 0; round < 3000; ++round) {
+    auto text = random_bytes(rng);
+    compare(text, rng, 1 + rng() % 32, 1 + rng() % 32,
+            fmt::format("random bytes {}", round));
+  }
+  compare("", rng, 1, 1, "empty input");
+
+  return finish("stream_lexer_test");
+}
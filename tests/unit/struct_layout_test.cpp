@@ -0,0 +1,101 @@
+// Structs are laid out with x86-64 sizes and alignment, in declaration order
+// or packed, and fields are found by name. The report gives both sizes.
+#include <string>
+#include <variant>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "frontend/frontend.hpp"
+#include "sema/name_analysis.hpp"
+#include "sema/struct_layout.hpp"
+#include "sema/type_checker.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "support/thread_pool.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+const char *program = "struct P {\n  char a;\n  int b;\n  char c;\n"
+                      "  P* next;\n  char d;\n};\n"
+                      "struct Q {\n  P p;\n  char e;\n};\n"
+                      "struct E {\n};\n"
+                      "struct I {\n  int x;\n  int y;\n};\n"
+                      "int f(P* p) {\n  return p[0].d;\n}\n";
+
+struct Expected {
+  const char *name;
+  std::uint32_t size;
+  std::uint32_t align;
+  std::vector<std::uint32_t> offsets;
+};
+
+void check_layouts(bool pack, const std::vector<Expected> &expected,
+                   const std::string &report) {
+  SourceManager sources;
+  auto file = sources.add_file(SourceBuffer::from_string(program));
+  auto result = parse_unit(sources, file, CigridFlags{});
+  check(result.ok(), "program parses");
+  if (!result.ok())
+    return;
+  ThreadPool pool(1);
+  auto names = resolve_names(*result.prog, result.diag, pool);
+  auto types = check_types(*result.prog, names, result.diag, pool, pack);
+  check(names.ok() && types.ok(), "program checks");
+
+  std::size_t next = 0;
+  for (const auto *global : result.prog->globals) {
+    const auto *record = std::get_if<GStruct>(global);
+    if (!record)
+      continue;
+    const auto &want = expected[next++];
+    const auto &layout = types.layouts.layout(record->decl);
+    auto what = fmt::format("{} {}", pack ? "packed" : "declared", want.name);
+    check(layout.complete, fmt::format("{} is laid out", what));
+    check(layout.size == want.size && layout.align == want.align,
+          fmt::format("{}: size {} align {}, expected {} and {}", what,
+                      layout.size, layout.align, want.size, want.align));
+    for (std::uint32_t i = 0; i < want.offsets.size(); ++i) {
+      auto offset = types.layouts.offset(record->decl, i);
+      check(offset == want.offsets[i],
+            fmt::format("{} field {} at {}, expected {}", what, i, offset,
+                        want.offsets[i]));
+      check(types.layouts.field(record->decl, record->fields[i].name) == i,
+            fmt::format("{} field {} is found by name", what, i));
+    }
+    check(!types.layouts.field(record->decl, Interner::global().intern("z")),
+          fmt::format("{} has no field z", what));
+  }
+
+  fmt::memory_buffer out;
+  print_layout_report(*result.prog, types.layouts, out);
+  check(fmt::to_string(out) == report,
+        fmt::format("report:\n{}", fmt::to_string(out)));
+}
+
+} // namespace
+
+int main() {
+  std::string report =
+      "struct P: 32 bytes in declaration order, 16 packed, 16 saved\n"
+      "struct Q: {} bytes in declaration order, {} packed, 0 saved\n"
+      "struct E: 0 bytes in declaration order, 0 packed, 0 saved\n"
+      "struct I: 8 bytes in declaration order, 8 packed, 0 saved\n";
+  check_layouts(false,
+                {{"P", 32, 8, {0, 4, 8, 16, 24}},
+                 {"Q", 40, 8, {0, 32}},
+                 {"E", 0, 1, {}},
+                 {"I", 8, 4, {0, 4}}},
+                fmt::format(fmt::runtime(report), 40, 40));
+  // Q holds a packed P
+  check_layouts(true,
+                {{"P", 16, 8, {12, 8, 13, 0, 14}},
+                 {"Q", 24, 8, {0, 16}},
+                 {"E", 0, 1, {}},
+                 {"I", 8, 4, {0, 4}}},
+                fmt::format(fmt::runtime(report), 24, 24));
+
+  return finish("struct_layout_test");
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+// What every unit test shares: each is a program that checks its behaviour
+// with check(), reads the Cigrid file it is given with source_argument() if
+// it needs one, and returns finish() from main.
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <fmt/format.h>
+
+#include "printer/ast_printer.hpp"
+#include "source/source_buffer.hpp"
+
+inline int failures = 0;
+
+// Counts a failed check, printing the first few
+inline void check(bool ok, const std::string &what) {
+  if (!ok && failures++ < 20)
+    fmt::print(stderr, "FAIL: {}\n", what);
+}
+
+inline std::string repeat(std::string_view text, std::size_t count) {
+  std::string result;
+  result.reserve(text.size() * count);
+  for (std::size_t i = 0; i < count; ++i)
+    result.append(text);
+  return result;
+}
+
+// Pretty-printed text of anything with print(ASTPrinter &), e.g. a Prog
+template <typename Printable> std::string print(const Printable &printable) {
+  fmt::memory_buffer out;
+  ASTPrinter printer(out);
+  printable.print(printer);
+  return fmt::to_string(out);
+}
+
+// The Cigrid file named by the first argument, or nullopt after saying why
+inline std::optional<SourceBuffer> source_argument(int argc, char *argv[]) {
+  if (argc < 2) {
+    fmt::print(stderr, "usage: {} <cigrid file>\n", argv[0]);
+    return std::nullopt;
+  }
+  auto source = SourceBuffer::from_file(argv[1]);
+  if (!source)
+    fmt::print(stderr, "{}: No such file or directory\n", argv[1]);
+  return source;
+}
+
+// Reports the test `name` as passed, with `detail` if any, or how many
+// checks failed. The exit status of the test.
+inline int finish(std::string_view name, std::string_view detail = {}) {
+  if (failures > 0) {
+    fmt::print(stderr, "{} failures\n", failures);
+    return 1;
+  }
+  if (detail.empty())
+    fmt::print("{}: ok\n", name);
+  else
+    fmt::print("{}: ok ({})\n", name, detail);
+  return 0;
+}
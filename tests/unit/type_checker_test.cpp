@@ -0,0 +1,194 @@
+// The type checker reports the first ill-typed construct on its line and
+// gives every expression of a good program its type. Types are interned: the
+// same type written twice, however deep its pointers, gets the same id.
+#include <string>
+#include <string_view>
+#include <variant>
+
+#include <fmt/core.h>
+
+#include "common.hpp"
+#include "frontend/frontend.hpp"
+#include "sema/name_analysis.hpp"
+#include "sema/type_checker.hpp"
+#include "sema/type_context.hpp"
+#include "source/source_buffer.hpp"
+#include "source/source_manager.hpp"
+#include "test_support.hpp"
+
+namespace {
+
+struct Unit {
+  std::string text;
+  // Line of the first type error, 0 for none
+  int line;
+};
+
+const Unit units[] = {
+    {"int f(char c, int* p) {\n  int x = c + 1;\n  p[x] = c;\n"
+     "  return p[0];\n}\n",
+     0},
+    {"int main() {\n  char* s = \"text\";\n  int x = s;\n}\n", 3},
+    {"int main() {\n  int* p = 0;\n  char* q = p;\n}\n", 3},
+    {"int main() {\n  int* p = 0;\n  int x = p + 1;\n}\n", 3},
+    {"int main() {\n  int* p = 0;\n  if (p == 0) {\n    return 1;\n  }\n"
+     "  return p != p;\n}\n",
+     0},
+    {"int f(int a, int b) {\n  return a;\n}\nint main() {\n  return f(1);\n}\n",
+     5},
+    {"int f(int* a) {\n  return 0;\n}\nint main() {\n  return f('c');\n}\n",
+     5},
+    {"void f() {\n  return;\n}\nint main() {\n  int x = f();\n}\n", 5},
+    {"void f() {\n  return 1;\n}\n", 2},
+    {"int f() {\n  return;\n}\n", 2},
+    {"int main() {\n  break;\n}\n", 2},
+    {"int main() {\n  while (1) {\n    if (1) break;\n  }\n  return 0;\n}\n",
+     0},
+    {"struct S {\n  int a;\n  S* next;\n};\nint f(S* s) {\n"
+     "  S* n = s[0].next;\n  n[0].a = 1;\n  return s[0].a;\n}\n",
+     0},
+    {"struct S {\n  int a;\n};\nint f(S* s) {\n  return s[0].b;\n}\n", 5},
+    {"struct S {\n  int a;\n};\nint f(S* s) {\n  return s[0];\n}\n", 5},
+    {"int f(int x) {\n  return x[0];\n}\n", 2},
+    {"int f(int* x) {\n  return x[0].a;\n}\n", 2},
+    {"int main() {\n  int* p = new int[3];\n  char** q = new char*[2];\n"
+     "  delete[] p;\n  return 0;\n}\n",
+     0},
+    {"int main() {\n  int x = 1;\n  delete[] x;\n}\n", 3},
+    {"int main() {\n  char* s = 0;\n  int* p = new int[s];\n}\n", 3},
+    {"extern int f(int a);\nint f(char* a) {\n  return 0;\n}\n", 2},
+    {"void x = 0;\n", 1},
+    {"int main() {\n  int* p = 0;\n  p[0]++;\n  char** q = 0;\n  q[0]++;\n}\n",
+     5},
+    {"struct S {\n  int a;\n  S s;\n};\n", 1},
+    {"struct S {\n  int a;\n  char a;\n};\n", 1},
+    {"struct T {\n  int a;\n};\nstruct S {\n  T t;\n  char c;\n};\n", 0},
+    // The error in the initializer comes first, though checked last
+    {"int g = 1 + \"a\";\nint main() {\n  return 0;\n}\n", 1},
+};
+
+struct Checked {
+  bool parsed = false;
+  bool resolved = false;
+  Types types;
+};
+
+Checked check_text(SourceManager &sources, const std::string &text,
+                   ParseResult &result) {
+  auto file = sources.add_file(SourceBuffer::from_string(text));
+  result = parse_unit(sources, file, CigridFlags{});
+  Checked checked;
+  checked.parsed = result.ok();
+  if (!checked.parsed)
+    return checked;
+  auto names = resolve_names(*result.prog, result.diag);
+  checked.resolved = names.ok();
+  if (checked.resolved)
+    checked.types = check_types(*result.prog, names, result.diag);
+  return checked;
+}
+
+void check_unit(const Unit &unit) {
+  SourceManager sources;
+  ParseResult result;
+  auto checked = check_text(sources, unit.text, result);
+  auto name = fmt::format("unit {:?}", unit.text);
+  check(checked.parsed && checked.resolved,
+        fmt::format("{} parses and resolves", name));
+  const auto &error = checked.types.error;
+  int line = error ? sources.position(error->loc).line : 0;
+  check(line == unit.line, fmt::format("{}: error on line {}, expected {}",
+                                       name, line, unit.line));
+}
+
+// Every expression below `expr` has a type
+bool typed(const ExprNode &root) {
+  std::vector<const ExprNode *> stack{&root};
+  while (!stack.empty()) {
+    const auto &expr = *stack.back();
+    stack.pop_back();
+    if (std::visit([](const auto &node) { return node.type_id; }, expr) ==
+        no_type)
+      return false;
+    std::visit(overload{
+                   [&](const EBinOp &op) {
+                     stack.push_back(op.lhs);
+                     stack.push_back(op.rhs);
+                   },
+                   [&](const EUnOp &op) { stack.push_back(op.rhs); },
+                   [&](const ECall &call) {
+                     for (const auto *arg : call.args)
+                       stack.push_back(arg);
+                   },
+                   [&](const ENew &alloc) { stack.push_back(alloc.expr); },
+                   [&](const EArrayAccess &access) {
+                     stack.push_back(access.index);
+                   },
+                   [](const auto &) {},
+               },
+               expr);
+  }
+  return true;
+}
+
+void check_interning() {
+  TypeContext context;
+  auto p = context.pointer_to(TypeContext::int_type);
+  check(context.pointer_to(TypeContext::int_type) == p, "int* is interned");
+  check(context.pointer_to(TypeContext::char_type) != p, "char* is not int*");
+  auto s = context.struct_type(7, Symbol{});
+  check(context.struct_type(7, Symbol{}) == s &&
+            context.struct_type(8, Symbol{}) != s,
+        "struct types are their declaration");
+  check(context.pointer_to(TypeContext::error_type) == TypeContext::error_type,
+        "pointers to the error type are the error type");
+}
+
+// Deeply pointed types, and a deeply nested expression
+void check_deep() {
+  constexpr int depth = 100000;
+  std::string stars(depth, '*');
+  std::string text = "int main() {\n  int" + stars + " p = 0;\n  int" +
+                     stars + " q = p;\n  int" + stars.substr(1) +
+                     " r = q[0];\n  int x = ";
+  for (int i = 0; i < depth; ++i)
+    text.append("-(");
+  text.append("1");
+  text.append(depth, ')');
+  text.append(";\n  return x;\n}\n");
+  SourceManager sources;
+  ParseResult result;
+  auto checked = check_text(sources, text, result);
+  check(checked.parsed && checked.resolved && checked.types.ok(),
+        "deep pointers and expressions check");
+  // void, int, char, error and the pointer levels
+  check(checked.types.context.size() == 4 + depth,
+        fmt::format("{} types for {} pointer levels",
+                    checked.types.context.size(), depth));
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  auto source = source_argument(argc, argv);
+  if (!source)
+    return 1;
+  SourceManager sources;
+  ParseResult result;
+  auto checked = check_text(sources, std::string(source->view()), result);
+  check(checked.parsed && checked.resolved && checked.types.ok(),
+        "test program type checks");
+  if (checked.types.ok() && result.ok()) {
+    for (const auto *global : result.prog->globals) {
+      if (const auto *var = std::get_if<GVarDef>(global))
+        check(typed(*var->value), fmt::format("{} is typed", var->name));
+    }
+  }
+
+  for (const auto &unit : units)
+    check_unit(unit);
+  check_interning();
+  check_deep();
+
+  return finish("type_checker_test");
+}